@@ -0,0 +1,58 @@
+#include <algorithm>
+
+#include "ast.hpp"
+
+namespace poppy {
+
+uint32_t Ast::add(AstKind kind, uint32_t a, uint32_t b, uint32_t c) {
+    _nodes.push_back(AstNode{ kind, 0, 0, a, b, c });
+    _positions.push_back(AstNone);
+    return _nodes.size() - 1;
+}
+
+uint32_t Ast::addInt(int64_t value) {
+    uint64_t u = static_cast<uint64_t>(value);
+    return add(AstKind::Int, static_cast<uint32_t>(u), static_cast<uint32_t>(u >> 32));
+}
+
+uint32_t Ast::addBinary(ItemCode op, uint32_t lhs, uint32_t rhs) {
+    uint32_t n = add(AstKind::Binary, lhs, rhs);
+    _nodes[n].op = static_cast<uint8_t>(op);
+    return n;
+}
+
+uint32_t Ast::addList(const std::vector<uint32_t> & elements) {
+    uint32_t list = _lists.size();
+    _lists.push_back(elements.size());
+    _lists.insert(_lists.end(), elements.begin(), elements.end());
+    return list;
+}
+
+void Ast::setPosition(uint32_t n, std::size_t offset) {
+    if (_positions[n] == AstNone) {
+        _positions[n] = static_cast<uint32_t>(std::min<std::size_t>(offset, AstNone - 1));
+    }
+}
+
+std::size_t Ast::bytes() const {
+    return (
+        _nodes.capacity() * sizeof(AstNode) +
+        _lists.capacity() * sizeof(uint32_t) +
+        _positions.capacity() * sizeof(uint32_t) +
+        _roots.capacity() * sizeof(uint32_t)
+    );
+}
+
+void Ast::clear() {
+    _nodes.clear();
+    _positions.clear();
+    _lists.clear();
+    _roots.clear();
+}
+
+void Ast::reserve(std::size_t nodes) {
+    _nodes.reserve(nodes);
+    _positions.reserve(nodes);
+}
+
+} // namespace poppy
@@ -0,0 +1,104 @@
+#ifndef AST_HPP
+#define AST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "itemattrs.hpp"
+
+namespace poppy {
+
+/*  A compact syntax tree for the optimising front end. All the nodes of a
+    compilation live in one Ast, which bump-allocates them in a vector and
+    frees them all at once. Nodes are 16 bytes and refer to their children
+    by 32-bit index. Variable-length children (parameters, loop bounds)
+    are runs in a separate list array, stored as a count followed by the
+    elements. The source positions of the nodes are kept to one side, so
+    that the passes do not have to carry them.
+
+    Nodes are always added after their children, so a child's index is
+    less than its parent's. A pass that walks the nodes in index order
+    therefore sees every child before its parent.
+*/
+
+enum class AstKind : uint8_t {
+    Skip,       //  Plants nothing.
+    Int,        //  a, b: low and high words of the value.
+    Bool,       //  a: 0 or 1.
+    Var,        //  a: symbol.
+    Symbol,     //  a: symbol, the value of a quoted word.
+    Call,       //  a: symbol, b: arguments or AstNone.
+    Binary,     //  op, a: lhs, b: rhs.
+    Assign,     //  a: symbol, b: value.
+    VarDecl,    //  a: symbol, b: value.
+    Seq,        //  a: list of statements.
+    Block,      //  a: body, planted in a scope of its own.
+    If,         //  a: condition, b: then, c: else or AstNone.
+    For,        //  a: symbol, b: list of from, by, to, c: body.
+    Lambda,     //  a: list of parameter symbols, b: body.
+    Return,     //  a: value or AstNone.
+    Try,        //  a: body, b: symbol of the handler's variable, c: handler.
+    Throw,      //  a: value.
+    Switch,     //  a: value, b: list of Cases.
+    Case,       //  a: list of Int, Bool or Symbol keys, or AstNone for the default, b: body.
+    Define,     //  a: symbol, b: list of parameter symbols, c: body.
+};
+
+constexpr uint32_t AstNone = 0xFFFFFFFF;
+
+struct AstNode {
+    AstKind kind;
+    uint8_t op;         //  An ItemCode, for Binary nodes.
+    uint16_t spare;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+
+    inline ItemCode opCode() const { return static_cast<ItemCode>(op); }
+    inline int64_t intValue() const { return static_cast<int64_t>(static_cast<uint64_t>(b) << 32 | a); }
+};
+
+static_assert(sizeof(AstNode) == 16, "AstNodes should be 16 bytes");
+
+class Ast {
+private:
+    std::vector<AstNode> _nodes;
+    std::vector<uint32_t> _positions;   //  Parallel to _nodes.
+    std::vector<uint32_t> _lists;
+    std::vector<uint32_t> _roots;       //  The Define nodes, in order.
+
+public:
+    inline AstNode & operator[](uint32_t n) { return _nodes[n]; }
+    inline const AstNode & operator[](uint32_t n) const { return _nodes[n]; }
+    inline std::size_t size() const { return _nodes.size(); }
+
+    uint32_t add(AstKind kind, uint32_t a = AstNone, uint32_t b = AstNone, uint32_t c = AstNone);
+    uint32_t addInt(int64_t value);
+    uint32_t addBinary(ItemCode op, uint32_t lhs, uint32_t rhs);
+    uint32_t addList(const std::vector<uint32_t> & elements);
+
+    //  The byte offset in the source that a node came from, or AstNone.
+    //  A node keeps the first position it is given, so the innermost
+    //  construct wins.
+    inline uint32_t position(uint32_t n) const { return _positions[n]; }
+    void setPosition(uint32_t n, std::size_t offset);
+
+    inline uint32_t listSize(uint32_t list) const { return _lists[list]; }
+    inline uint32_t listAt(uint32_t list, uint32_t i) const { return _lists[list + 1 + i]; }
+
+    inline void addRoot(uint32_t n) { _roots.push_back(n); }
+    inline const std::vector<uint32_t> & roots() const { return _roots; }
+
+    //  Bytes in use, including the list array.
+    std::size_t bytes() const;
+
+    //  Frees every node at once.
+    void clear();
+
+    void reserve(std::size_t nodes);
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,346 @@
+/*  Syntax tree allocation benchmark.
+
+    Usage: ast_bench [REPEATS]
+
+    Parses a few megabytes of generated definitions into an Ast, then
+    rebuilds the same tree in two ways and reports the best time for each
+    phase:
+
+        build       - replaying the nodes into a fresh tree
+        optimise    - constant folding and dead-branch pruning
+        free        - releasing the whole tree
+
+    The arena is the Ast used by the compiler: 16-byte nodes in one vector,
+    optimised by a linear sweep and freed at once. The pointer tree is the
+    conventional alternative, one heap allocation per node with a vector of
+    child pointers, optimised recursively and freed node by node.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "astparser.hpp"
+#include "astpasses.hpp"
+#include "itemizer.hpp"
+#include "sourcebuffer.hpp"
+
+using namespace poppy;
+
+static const char * sample =
+    "define scaled_total_of_squares( upper_limit, scale ):\n"
+    "    var running_total := 0;\n"
+    "    for index from 1 by 1 to upper_limit do\n"
+    "        running_total + index * index * scale -> running_total\n"
+    "    endfor;\n"
+    "    if False then\n"
+    "        running_total * 60 * 60 * 24\n"
+    "    elseif True then\n"
+    "        running_total - 1 + 2 * 3\n"
+    "    else\n"
+    "        0\n"
+    "    endif\n"
+    "enddefine\n"
+    "\n"
+    "def adder(x):\n"
+    "    val offset := 1_000 * 1_000;\n"
+    "    fn(y): x + y + offset endfn\n"
+    "end\n\n";
+
+struct PtrNode {
+    AstKind kind;
+    ItemCode op;
+    int64_t value = 0;
+    uint32_t symbol = AstNone;
+    std::vector<uint32_t> params;
+    std::vector<PtrNode *> kids;    //  nullptr for an absent child.
+
+    PtrNode(const AstNode & node) : kind(node.kind), op(node.opCode()) {}
+
+    ~PtrNode() {
+        for (PtrNode * kid : kids) delete kid;
+    }
+};
+
+static std::size_t ptr_allocations = 0;
+static std::size_t ptr_bytes = 0;
+
+static PtrNode * copyTree(const Ast & ast, uint32_t n);
+
+static void copyKid(PtrNode * p, const Ast & ast, uint32_t n) {
+    p->kids.push_back(n == AstNone ? nullptr : copyTree(ast, n));
+}
+
+static void copyParams(PtrNode * p, const Ast & ast, uint32_t list) {
+    for (uint32_t i = 0; i < ast.listSize(list); i++) {
+        p->params.push_back(ast.listAt(list, i));
+    }
+    ptr_allocations += 1;
+    ptr_bytes += p->params.capacity() * sizeof(uint32_t);
+}
+
+static PtrNode * copyTree(const Ast & ast, uint32_t n) {
+    const AstNode & node = ast[n];
+    PtrNode * p = new PtrNode(node);
+    switch (node.kind) {
+        case AstKind::Skip:
+            break;
+        case AstKind::Int:
+            p->value = node.intValue();
+            break;
+        case AstKind::Bool:
+            p->value = node.a;
+            break;
+        case AstKind::Var:
+        case AstKind::Symbol:
+            p->symbol = node.a;
+            break;
+        case AstKind::Call:
+        case AstKind::Assign:
+        case AstKind::VarDecl:
+            p->symbol = node.a;
+            copyKid(p, ast, node.b);
+            break;
+        case AstKind::Binary:
+            copyKid(p, ast, node.a);
+            copyKid(p, ast, node.b);
+            break;
+        case AstKind::Seq:
+            for (uint32_t i = 0; i < ast.listSize(node.a); i++) {
+                copyKid(p, ast, ast.listAt(node.a, i));
+            }
+            break;
+        case AstKind::Block:
+        case AstKind::Return:
+        case AstKind::Throw:
+            copyKid(p, ast, node.a);
+            break;
+        case AstKind::Try:
+            p->symbol = node.b;
+            copyKid(p, ast, node.a);
+            copyKid(p, ast, node.c);
+            break;
+        case AstKind::Switch:
+            copyKid(p, ast, node.a);
+            for (uint32_t i = 0; i < ast.listSize(node.b); i++) {
+                copyKid(p, ast, ast.listAt(node.b, i));
+            }
+            break;
+        case AstKind::Case:
+            if (node.a != AstNone) {
+                for (uint32_t i = 0; i < ast.listSize(node.a); i++) {
+                    copyKid(p, ast, ast.listAt(node.a, i));
+                }
+            }
+            copyKid(p, ast, node.b);
+            break;
+        case AstKind::If:
+            copyKid(p, ast, node.a);
+            copyKid(p, ast, node.b);
+            copyKid(p, ast, node.c);
+            break;
+        case AstKind::For:
+            p->symbol = node.a;
+            for (uint32_t i = 0; i < 3; i++) {
+                copyKid(p, ast, ast.listAt(node.b, i));
+            }
+            copyKid(p, ast, node.c);
+            break;
+        case AstKind::Lambda:
+            copyParams(p, ast, node.a);
+            copyKid(p, ast, node.b);
+            break;
+        case AstKind::Define:
+            p->symbol = node.a;
+            copyParams(p, ast, node.b);
+            copyKid(p, ast, node.c);
+            break;
+    }
+    ptr_allocations += p->kids.empty() ? 1 : 2;
+    ptr_bytes += sizeof(PtrNode) + p->kids.capacity() * sizeof(PtrNode *);
+    return p;
+}
+
+//  The recursive equivalent of AstOptimiser, returns the replacement.
+static PtrNode * optimise(PtrNode * p, int & changes) {
+    for (PtrNode * & kid : p->kids) {
+        if (kid != nullptr) kid = optimise(kid, changes);
+    }
+    if (p->kind == AstKind::Binary) {
+        PtrNode * lhs = p->kids[0];
+        PtrNode * rhs = p->kids[1];
+        if (lhs->kind != AstKind::Int || rhs->kind != AstKind::Int) return p;
+        int truth = -1;
+        switch (p->op) {
+            case ItemCode::lt_code: truth = lhs->value < rhs->value; break;
+            case ItemCode::lte_code: truth = lhs->value <= rhs->value; break;
+            case ItemCode::gt_code: truth = lhs->value > rhs->value; break;
+            case ItemCode::gte_code: truth = lhs->value >= rhs->value; break;
+            case ItemCode::equal_code:
+            case ItemCode::exact_equal_code: truth = lhs->value == rhs->value; break;
+            case ItemCode::not_equal_code:
+            case ItemCode::not_exact_equal_code: truth = lhs->value != rhs->value; break;
+            default: break;
+        }
+        if (truth >= 0) {
+            delete lhs;
+            delete rhs;
+            p->kids.clear();
+            p->kind = AstKind::Bool;
+            p->value = truth;
+            changes += 1;
+            return p;
+        }
+        int64_t r;
+        bool overflow;
+        switch (p->op) {
+            case ItemCode::add_code: overflow = __builtin_add_overflow(lhs->value, rhs->value, &r); break;
+            case ItemCode::sub_code: overflow = __builtin_sub_overflow(lhs->value, rhs->value, &r); break;
+            case ItemCode::mul_code: overflow = __builtin_mul_overflow(lhs->value, rhs->value, &r); break;
+            default: return p;
+        }
+        if (overflow) return p;
+        delete lhs;
+        delete rhs;
+        p->kids.clear();
+        p->kind = AstKind::Int;
+        p->value = r;
+        changes += 1;
+    } else if (p->kind == AstKind::If) {
+        PtrNode * cond = p->kids[0];
+        if (cond->kind != AstKind::Bool && cond->kind != AstKind::Int) return p;
+        bool taken = cond->kind == AstKind::Int || cond->value != 0;
+        PtrNode * & branch = p->kids[taken ? 1 : 2];
+        PtrNode * result = branch;
+        branch = nullptr;
+        delete p;
+        changes += 1;
+        if (result == nullptr) {
+            result = new PtrNode(AstNode{ AstKind::Skip, 0, 0, AstNone, AstNone, AstNone });
+        }
+        return result;
+    }
+    return p;
+}
+
+static uint32_t copyList(const Ast & from, Ast & to, uint32_t list) {
+    std::vector<uint32_t> elements;
+    for (uint32_t i = 0; i < from.listSize(list); i++) {
+        elements.push_back(from.listAt(list, i));
+    }
+    return to.addList(elements);
+}
+
+//  Replays the nodes of an Ast into another through the same interface
+//  that AstParser uses.
+static void copyArena(const Ast & from, Ast & to) {
+    for (uint32_t n = 0; n < from.size(); n++) {
+        AstNode node = from[n];
+        switch (node.kind) {
+            case AstKind::Seq:
+            case AstKind::Lambda:
+                node.a = copyList(from, to, node.a);
+                break;
+            case AstKind::For:
+            case AstKind::Define:
+                node.b = copyList(from, to, node.b);
+                break;
+            default:
+                break;
+        }
+        to[to.add(node.kind, node.a, node.b, node.c)].op = node.op;
+    }
+    for (uint32_t n : from.roots()) {
+        to.addRoot(n);
+    }
+}
+
+class Timer {
+    std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+public:
+    double ms() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    }
+};
+
+static void row(const char * name, double arena, double ptr) {
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << arena << " ms" << std::setw(10) << ptr << " ms"
+              << std::setw(8) << std::setprecision(1) << ptr / arena << "x" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    int repeats = argc > 1 ? std::stoi(argv[1]) : 5;
+    std::string source;
+    while (source.size() < (4 << 20)) source += sample;
+
+    SymbolTable symbols;
+    Ast ast;
+    Timer parse;
+    {
+        std::istringstream in(source);
+        SourceBuffer buffer(in);
+        Itemizer items(buffer, symbols);
+        AstParser(ast, items, symbols).parseDefinitions();
+    }
+    double parse_ms = parse.ms();
+
+    double best[2][3] = { { 1e9, 1e9, 1e9 }, { 1e9, 1e9, 1e9 } };
+    int arena_changes = 0;
+    int ptr_changes = 0;
+    std::size_t arena_bytes = 0;
+    for (int i = 0; i < repeats; i++) {
+        {
+            Ast * arena = new Ast();
+            Timer build;
+            copyArena(ast, *arena);
+            best[0][0] = std::min(best[0][0], build.ms());
+            arena_bytes = arena->bytes();
+            Timer opt;
+            AstOptimiser optimiser(*arena);
+            optimiser.run();
+            best[0][1] = std::min(best[0][1], opt.ms());
+            arena_changes = optimiser.folded + optimiser.pruned;
+            Timer free;
+            delete arena;
+            best[0][2] = std::min(best[0][2], free.ms());
+        }
+        {
+            ptr_allocations = 0;
+            ptr_bytes = 0;
+            std::vector<PtrNode *> roots;
+            Timer build;
+            for (uint32_t n : ast.roots()) roots.push_back(copyTree(ast, n));
+            best[1][0] = std::min(best[1][0], build.ms());
+            Timer opt;
+            ptr_changes = 0;
+            for (PtrNode * & p : roots) p = optimise(p, ptr_changes);
+            best[1][1] = std::min(best[1][1], opt.ms());
+            Timer free;
+            for (PtrNode * p : roots) delete p;
+            best[1][2] = std::min(best[1][2], free.ms());
+        }
+    }
+
+    std::cout << "Parsed " << source.size() << " bytes into " << ast.size() << " nodes, "
+              << ast.roots().size() << " definitions in " << std::fixed << std::setprecision(1)
+              << parse_ms << " ms" << std::endl;
+    std::cout << "arena:   " << arena_bytes << " bytes in 3 blocks" << std::endl;
+    std::cout << "pointer: " << ptr_bytes << " bytes in " << ptr_allocations << " allocations" << std::endl;
+    std::cout << std::setw(32) << "arena" << std::setw(13) << "pointer" << std::endl;
+    row("build", best[0][0], best[1][0]);
+    row("optimise", best[0][1], best[1][1]);
+    row("free", best[0][2], best[1][2]);
+    row("total", best[0][0] + best[0][1] + best[0][2], best[1][0] + best[1][1] + best[1][2]);
+
+    if (arena_changes != ptr_changes) {
+        std::cerr << "Optimisations disagree: " << arena_changes << " vs " << ptr_changes << std::endl;
+        return 1;
+    }
+    return 0;
+}
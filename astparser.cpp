@@ -0,0 +1,290 @@
+#include <vector>
+
+#include "astparser.hpp"
+#include "precedences.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+uint32_t AstParser::parseDefinition() {
+    if (!peek()) {
+        return AstNone;
+    }
+    Item item = next();
+    if (item.itemCode() != ItemCode::define_code && item.itemCode() != ItemCode::def_code) {
+        unexpected(item, "define");
+    }
+    Item procname = next();
+    if (procname.itemCode() != ItemCode::word_code) {
+        unexpected(procname, "a name");
+    }
+    uint32_t params = parseParameters();
+    tryRead(ItemCode::colon_code);
+    uint32_t body = parseStatements();
+    mustReadEnd(ItemCode::enddefine_code);
+    uint32_t n = _ast.add(AstKind::Define, procname.symbol(), params, body);
+    _ast.addRoot(n);
+    return n;
+}
+
+int AstParser::parseDefinitions() {
+    int n = 0;
+    while (parseDefinition() != AstNone) {
+        n += 1;
+    }
+    return n;
+}
+
+//  Returns a list of parameter symbols.
+uint32_t AstParser::parseParameters() {
+    std::vector<uint32_t> params;
+    mustRead(ItemCode::oparen_code);
+    if (!tryRead(ItemCode::cparen_code)) {
+        do {
+            Item item = next();
+            if (item.itemCode() != ItemCode::word_code) {
+                unexpected(item, "a name");
+            }
+            params.push_back(item.symbol());
+        } while (tryRead(ItemCode::comma_code));
+        mustRead(ItemCode::cparen_code);
+    }
+    return _ast.addList(params);
+}
+
+uint32_t AstParser::parseStatements() {
+    std::vector<uint32_t> statements;
+    for (;;) {
+        std::optional<Item> item = peek();
+        if (!item || isStatementTerminator(item->itemCode())) {
+            break;
+        }
+        statements.push_back(parseExpr(prec_max));
+        if (!tryRead(ItemCode::semi_code)) {
+            break;
+        }
+    }
+    if (statements.size() == 1) {
+        return statements[0];
+    } else if (statements.empty()) {
+        return _ast.add(AstKind::Skip);
+    } else {
+        return _ast.add(AstKind::Seq, _ast.addList(statements));
+    }
+}
+
+uint32_t AstParser::parseBlock() {
+    return _ast.add(AstKind::Block, parseStatements());
+}
+
+uint32_t AstParser::parseExpr(int limit) {
+    Item item = next();
+    uint32_t lhs = parsePrefix(item);
+    _ast.setPosition(lhs, item.position());
+    for (;;) {
+        std::optional<Item> op = peek();
+        int prec;
+        if (!op || !infixPrecedence(op->itemCode(), prec) || prec >= limit) {
+            return lhs;
+        }
+        next();
+        if (op->itemCode() == ItemCode::assign_code) {
+            Item target = next();
+            if (target.itemCode() != ItemCode::word_code) {
+                unexpected(target, "a name");
+            }
+            lhs = _ast.add(AstKind::Assign, target.symbol(), lhs);
+        } else {
+            uint32_t rhs = parseExpr(prec);
+            lhs = _ast.addBinary(op->itemCode(), lhs, rhs);
+        }
+        _ast.setPosition(lhs, op->position());
+    }
+}
+
+uint32_t AstParser::parsePrefix(const Item & item) {
+    switch (item.itemCode()) {
+        case ItemCode::int_code:
+        case ItemCode::bigint_code:
+            return _ast.addInt(intValue(item));
+        case ItemCode::word_code:
+            if (isQuote(item)) {
+                return _ast.add(AstKind::Symbol, readQuoted());
+            }
+            return parseIdentifier(item);
+        case ItemCode::True_code:
+            return _ast.add(AstKind::Bool, 1);
+        case ItemCode::False_code:
+            return _ast.add(AstKind::Bool, 0);
+        case ItemCode::oparen_code: {
+            if (tryRead(ItemCode::cparen_code)) {
+                return _ast.add(AstKind::Skip);
+            }
+            uint32_t e = parseExpr(prec_max);
+            mustRead(ItemCode::cparen_code);
+            return e;
+        }
+        case ItemCode::sub_code: {
+            uint32_t zero = _ast.addInt(0);
+            return _ast.addBinary(ItemCode::sub_code, zero, parseExpr(prec_negate));
+        }
+        case ItemCode::var_code:
+        case ItemCode::val_code:
+            return parseVar();
+        case ItemCode::if_code:
+            return parseIf();
+        case ItemCode::for_code:
+            return parseFor();
+        case ItemCode::fn_code:
+            return parseLambda();
+        case ItemCode::return_code:
+            return parseReturn();
+        case ItemCode::try_code:
+            return parseTry();
+        case ItemCode::throw_code:
+            return parseThrow();
+        case ItemCode::switch_code:
+            return parseSwitch();
+        default:
+            unexpected(item, "an expression");
+    }
+}
+
+uint32_t AstParser::parseVar() {
+    Item item = next();
+    if (item.itemCode() != ItemCode::word_code) {
+        unexpected(item, "a name");
+    }
+    mustRead(ItemCode::bind_code);
+    uint32_t value = parseExpr(prec_comma);
+    return _ast.add(AstKind::VarDecl, item.symbol(), value);
+}
+
+uint32_t AstParser::parseIdentifier(const Item & item) {
+    if (tryRead(ItemCode::oparen_code)) {
+        uint32_t args = AstNone;
+        if (!tryRead(ItemCode::cparen_code)) {
+            args = parseExpr(prec_max);
+            mustRead(ItemCode::cparen_code);
+        }
+        return _ast.add(AstKind::Call, item.symbol(), args);
+    } else if (tryRead(ItemCode::bind_code)) {
+        uint32_t value = parseExpr(prec_comma);
+        return _ast.add(AstKind::Assign, item.symbol(), value);
+    } else {
+        return _ast.add(AstKind::Var, item.symbol());
+    }
+}
+
+//  elseif chains become nested Ifs in the else part.
+uint32_t AstParser::parseIf() {
+    uint32_t cond = parseExpr(prec_max);
+    mustRead(ItemCode::then_code);
+    uint32_t then_part = parseBlock();
+    Item item = next();
+    switch (item.itemCode()) {
+        case ItemCode::elseif_code: {
+            uint32_t else_part = parseIf();
+            return _ast.add(AstKind::If, cond, then_part, else_part);
+        }
+        case ItemCode::else_code: {
+            uint32_t else_part = parseBlock();
+            mustReadEnd(ItemCode::endif_code);
+            return _ast.add(AstKind::If, cond, then_part, else_part);
+        }
+        case ItemCode::endif_code:
+        case ItemCode::end_code:
+            return _ast.add(AstKind::If, cond, then_part, AstNone);
+        default:
+            unexpected(item, "endif");
+    }
+}
+
+uint32_t AstParser::parseFor() {
+    Item var = next();
+    if (var.itemCode() != ItemCode::word_code) {
+        unexpected(var, "a name");
+    }
+    uint32_t from = tryRead(ItemCode::from_code) ? parseExpr(prec_max) : _ast.addInt(1);
+    uint32_t by = tryRead(ItemCode::by_code) ? parseExpr(prec_max) : _ast.addInt(1);
+    mustRead(ItemCode::to_code);
+    uint32_t to = parseExpr(prec_max);
+    mustRead(ItemCode::do_code);
+    uint32_t body = parseBlock();
+    mustReadEnd(ItemCode::endfor_code);
+    return _ast.add(AstKind::For, var.symbol(), _ast.addList({ from, by, to }), body);
+}
+
+uint32_t AstParser::parseLambda() {
+    uint32_t params = parseParameters();
+    tryRead(ItemCode::colon_code);
+    uint32_t body = parseStatements();
+    mustReadEnd(ItemCode::endfn_code);
+    return _ast.add(AstKind::Lambda, params, body);
+}
+
+uint32_t AstParser::parseReturn() {
+    std::optional<Item> item = peek();
+    uint32_t value = AstNone;
+    if (item && !isStatementTerminator(item->itemCode())) {
+        value = parseExpr(prec_max);
+    }
+    return _ast.add(AstKind::Return, value);
+}
+
+//  The handler is planted in a scope of its own, with its variable.
+uint32_t AstParser::parseTry() {
+    uint32_t body = parseBlock();
+    mustRead(ItemCode::catch_code);
+    Item var = next();
+    if (var.itemCode() != ItemCode::word_code) {
+        unexpected(var, "a name");
+    }
+    tryRead(ItemCode::colon_code);
+    uint32_t handler = parseStatements();
+    mustReadEnd(ItemCode::endtry_code);
+    return _ast.add(AstKind::Try, body, var.symbol(), handler);
+}
+
+uint32_t AstParser::parseThrow() {
+    return _ast.add(AstKind::Throw, parseExpr(prec_max));
+}
+
+//  The cases are kept in order, the default among them.
+uint32_t AstParser::parseSwitch() {
+    uint32_t value = parseExpr(prec_max);
+    std::vector<uint32_t> cases;
+    for (;;) {
+        Item item = next();
+        switch (item.itemCode()) {
+            case ItemCode::case_code: {
+                std::vector<uint32_t> keys;
+                do {
+                    Cell key = readCaseKey();
+                    if (key.isSmall()) {
+                        keys.push_back(_ast.addInt(key.i64 >> TAG_WIDTH));
+                    } else if (key.IsBoolean()) {
+                        keys.push_back(_ast.add(AstKind::Bool, key.u64 == TrueValue.u64));
+                    } else {
+                        keys.push_back(_ast.add(AstKind::Symbol, key.getSymbolIndex()));
+                    }
+                } while (tryRead(ItemCode::comma_code));
+                mustRead(ItemCode::colon_code);
+                uint32_t list = _ast.addList(keys);
+                cases.push_back(_ast.add(AstKind::Case, list, parseBlock()));
+                break;
+            }
+            case ItemCode::default_code:
+                tryRead(ItemCode::colon_code);
+                cases.push_back(_ast.add(AstKind::Case, AstNone, parseBlock()));
+                break;
+            case ItemCode::endswitch_code:
+            case ItemCode::end_code:
+                return _ast.add(AstKind::Switch, value, _ast.addList(cases));
+            default:
+                unexpected(item, "endswitch");
+        }
+    }
+}
+
+} // namespace poppy
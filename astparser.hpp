@@ -0,0 +1,56 @@
+#ifndef ASTPARSER_HPP
+#define ASTPARSER_HPP
+
+#include <cstdint>
+
+#include "ast.hpp"
+#include "itemreader.hpp"
+
+namespace poppy {
+
+/*  The optimising front end. It accepts the same language as Parser but
+    builds an Ast instead of planting code, so that passes which need to
+    see a whole procedure can run before code generation. See astpasses
+    and astplanter for the other stages.
+*/
+
+class AstParser : public ItemReader {
+private:
+    Ast & _ast;
+
+public:
+    AstParser(Ast & ast, Itemizer & itemizer, SymbolTable & symbols) :
+        ItemReader(itemizer, symbols),
+        _ast(ast)
+    {}
+
+public:
+    //  Parses the next top-level definition, returning its Define node, or
+    //  AstNone at the end of input. Define nodes are also recorded as
+    //  roots of the Ast.
+    uint32_t parseDefinition();
+
+    //  Parses definitions to the end of input, returns how many.
+    int parseDefinitions();
+
+private:
+    uint32_t parseStatements();
+    uint32_t parseExpr(int limit);
+    uint32_t parsePrefix(const Item & item);
+    uint32_t parseParameters();
+    uint32_t parseBlock();
+
+    uint32_t parseVar();
+    uint32_t parseIdentifier(const Item & item);
+    uint32_t parseIf();
+    uint32_t parseFor();
+    uint32_t parseLambda();
+    uint32_t parseReturn();
+    uint32_t parseTry();
+    uint32_t parseThrow();
+    uint32_t parseSwitch();
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,88 @@
+#include "astpasses.hpp"
+#include "cell.hpp"
+
+namespace poppy {
+
+//  The range of a Small.
+static constexpr int64_t MaxSmall = (static_cast<int64_t>(1) << (63 - TAG_WIDTH)) - 1;
+static constexpr int64_t MinSmall = -MaxSmall - 1;
+
+void AstOptimiser::run() {
+    for (uint32_t n = 0; n < _ast.size(); n++) {
+        AstNode & node = _ast[n];
+        if (node.kind == AstKind::Binary) {
+            folded += fold(node);
+        } else if (node.kind == AstKind::If) {
+            pruned += prune(node);
+        }
+    }
+}
+
+bool AstOptimiser::fold(AstNode & node) {
+    const AstNode & lhs = _ast[node.a];
+    const AstNode & rhs = _ast[node.b];
+    if (lhs.kind != AstKind::Int || rhs.kind != AstKind::Int) {
+        return false;
+    }
+    int64_t x = lhs.intValue();
+    int64_t y = rhs.intValue();
+    int truth = -1;
+    switch (node.opCode()) {
+        case ItemCode::lt_code: truth = x < y; break;
+        case ItemCode::lte_code: truth = x <= y; break;
+        case ItemCode::gt_code: truth = x > y; break;
+        case ItemCode::gte_code: truth = x >= y; break;
+        case ItemCode::equal_code:
+        case ItemCode::exact_equal_code: truth = x == y; break;
+        case ItemCode::not_equal_code:
+        case ItemCode::not_exact_equal_code: truth = x != y; break;
+        default: break;
+    }
+    if (truth >= 0) {
+        node = AstNode{ AstKind::Bool, 0, 0, static_cast<uint32_t>(truth), AstNone, AstNone };
+        return true;
+    }
+    int64_t r;
+    bool overflow;
+    switch (node.opCode()) {
+        case ItemCode::add_code:
+            overflow = __builtin_add_overflow(x, y, &r);
+            break;
+        case ItemCode::sub_code:
+            overflow = __builtin_sub_overflow(x, y, &r);
+            break;
+        case ItemCode::mul_code:
+            overflow = __builtin_mul_overflow(x, y, &r);
+            break;
+        default:
+            return false;
+    }
+    if (overflow || r < MinSmall || r > MaxSmall) {
+        return false;
+    }
+    uint64_t u = static_cast<uint64_t>(r);
+    node = AstNode{ AstKind::Int, 0, 0, static_cast<uint32_t>(u), static_cast<uint32_t>(u >> 32), AstNone };
+    return true;
+}
+
+bool AstOptimiser::prune(AstNode & node) {
+    const AstNode & cond = _ast[node.a];
+    bool taken;
+    if (cond.kind == AstKind::Bool) {
+        taken = cond.a != 0;
+    } else if (cond.kind == AstKind::Int) {
+        taken = true;
+    } else {
+        return false;
+    }
+    uint32_t branch = taken ? node.b : node.c;
+    if (branch == AstNone) {
+        node = AstNode{ AstKind::Skip, 0, 0, AstNone, AstNone, AstNone };
+    } else {
+        //  The branches are Blocks or Ifs, so the scoping is unchanged.
+        node = _ast[branch];
+    }
+    return true;
+}
+
+} // namespace poppy
@@ -0,0 +1,41 @@
+#ifndef ASTPASSES_HPP
+#define ASTPASSES_HPP
+
+#include "ast.hpp"
+
+namespace poppy {
+
+/*  Optimisation passes over an Ast. Because children always precede
+    their parents, each pass is a single linear sweep over the node array
+    that rewrites nodes in place; nothing is allocated or freed.
+
+    -   Constant folding: + - * of two Ints become an Int. Folds that
+        would overflow a Small are left for run-time, where they trap, so
+        folding never changes behaviour. Comparisons of two Ints become a
+        Bool.
+    -   Dead branches: an If whose condition is a constant becomes the
+        branch that would be taken. Any Int is true, only False is false.
+*/
+
+class AstOptimiser {
+private:
+    Ast & _ast;
+
+public:
+    int folded = 0;
+    int pruned = 0;
+
+public:
+    AstOptimiser(Ast & ast) : _ast(ast) {}
+
+public:
+    void run();
+
+private:
+    bool fold(AstNode & node);
+    bool prune(AstNode & node);
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,249 @@
+#include <vector>
+
+#include "astplanter.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+std::string AstPlanter::name(uint32_t symbol) {
+    return std::string(_symbols.name(symbol));
+}
+
+void AstPlanter::plantDefinition(uint32_t define) {
+    const AstNode & node = _ast[define];
+    if (node.kind != AstKind::Define) {
+        throw Unreachable();
+    }
+    std::string procname = name(node.a);
+    CodePlanter planter(_engine);
+    planter.setSource(_source);
+    _planter = &planter;
+    if (_engine.getDictionary().lookup(procname) == nullptr) {
+        planter.global(procname);
+    }
+    plantParameters(planter, node.b);
+    plant(node.c);
+    planter.RETURN();
+    planter.buildAndBind(procname);
+    _planter = nullptr;
+}
+
+int AstPlanter::plantDefinitions() {
+    for (uint32_t n : _ast.roots()) {
+        plantDefinition(n);
+    }
+    return _ast.roots().size();
+}
+
+//  The arguments are on the stack, the last one on top.
+void AstPlanter::plantParameters(CodePlanter & planter, uint32_t params) {
+    uint32_t count = _ast.listSize(params);
+    for (uint32_t i = 0; i < count; i++) {
+        planter.local(name(_ast.listAt(params, i)));
+    }
+    for (uint32_t i = count; i > 0; i--) {
+        planter.POP_LOCAL(name(_ast.listAt(params, i - 1)));
+    }
+}
+
+void AstPlanter::plantInfix(const AstNode & node) {
+    switch (node.opCode()) {
+        case ItemCode::comma_code:
+            break;
+        case ItemCode::add_code:
+            _planter->ADD();
+            break;
+        case ItemCode::sub_code:
+            _planter->SUB();
+            break;
+        case ItemCode::mul_code:
+            _planter->MUL();
+            break;
+        case ItemCode::lt_code:
+            _planter->LT();
+            break;
+        case ItemCode::lte_code:
+            _planter->LTE();
+            break;
+        case ItemCode::gt_code:
+            _planter->GT();
+            break;
+        case ItemCode::gte_code:
+            _planter->GTE();
+            break;
+        //  Until there are values with structural equality, = is ==.
+        case ItemCode::equal_code:
+        case ItemCode::exact_equal_code:
+            _planter->EQ();
+            break;
+        case ItemCode::not_equal_code:
+        case ItemCode::not_exact_equal_code:
+            _planter->NEQ();
+            break;
+        default: {
+            const char * op = itemCodeToItemKey(node.opCode());
+            throw CompileTimeError("Operator not supported").culprit("Operator", op == nullptr ? "?" : op);
+        }
+    }
+}
+
+//  Operators, calls and throws are marked again after their operands.
+void AstPlanter::mark(uint32_t n) {
+    if (_ast.position(n) != AstNone) {
+        _planter->position(_ast.position(n));
+    }
+}
+
+void AstPlanter::plant(uint32_t n) {
+    const AstNode & node = _ast[n];
+    mark(n);
+    switch (node.kind) {
+        case AstKind::Skip:
+            break;
+        case AstKind::Int:
+            _planter->PUSHQ(node.intValue());
+            break;
+        case AstKind::Bool:
+            _planter->PUSHQ(node.a ? TrueValue : FalseValue);
+            break;
+        case AstKind::Var:
+            _planter->PUSH(name(node.a));
+            break;
+        case AstKind::Symbol:
+            _planter->PUSHQ(Cell::makeSymbol(node.a));
+            break;
+        case AstKind::Call:
+            if (node.b != AstNone) {
+                plant(node.b);
+            }
+            mark(n);
+            _planter->CALL(name(node.a));
+            break;
+        case AstKind::Binary:
+            plant(node.a);
+            plant(node.b);
+            mark(n);
+            plantInfix(node);
+            break;
+        case AstKind::Assign:
+            plant(node.b);
+            _planter->POP(name(node.a));
+            break;
+        case AstKind::VarDecl:
+            plant(node.b);
+            _planter->local(name(node.a));
+            _planter->POP_LOCAL(name(node.a));
+            break;
+        case AstKind::Seq:
+            for (uint32_t i = 0; i < _ast.listSize(node.a); i++) {
+                plant(_ast.listAt(node.a, i));
+            }
+            break;
+        case AstKind::Block: {
+            int scope = _planter->enterScope();
+            plant(node.a);
+            _planter->exitScope(scope);
+            break;
+        }
+        case AstKind::If: {
+            Label otherwise = _planter->newLabel();
+            plant(node.a);
+            _planter->IFNOT(otherwise);
+            plant(node.b);
+            if (node.c == AstNone) {
+                _planter->LABEL(otherwise);
+            } else {
+                Label done = _planter->newLabel();
+                _planter->GOTO(done);
+                _planter->LABEL(otherwise);
+                plant(node.c);
+                _planter->LABEL(done);
+            }
+            break;
+        }
+        case AstKind::For: {
+            for (uint32_t i = 0; i < 3; i++) {
+                plant(_ast.listAt(node.b, i));
+            }
+            std::string var = name(node.a);
+            int scope = _planter->enterScope();
+            _planter->local(var);
+            ForRange loop = _planter->newForRange(var);
+            _planter->FOR_RANGE_INIT(loop);
+            plant(node.c);
+            _planter->FOR_RANGE_NEXT(loop);
+            _planter->exitScope(scope);
+            break;
+        }
+        case AstKind::Lambda: {
+            CodePlanter * outer = _planter;
+            CodePlanter & lambda = outer->lambda();
+            _planter = &lambda;
+            plantParameters(lambda, node.a);
+            plant(node.b);
+            lambda.RETURN();
+            _planter = outer;
+            _planter->CLOSURE(lambda);
+            break;
+        }
+        case AstKind::Return:
+            if (node.a != AstNone) {
+                plant(node.a);
+            }
+            _planter->RETURN();
+            break;
+        case AstKind::Try: {
+            TryBlock block = _planter->newTryBlock();
+            _planter->TRY(block);
+            plant(node.a);
+            _planter->CATCH(block);
+            std::string var = name(node.b);
+            int scope = _planter->enterScope();
+            _planter->local(var);
+            _planter->POP_LOCAL(var);
+            plant(node.c);
+            _planter->exitScope(scope);
+            _planter->ENDTRY(block);
+            break;
+        }
+        case AstKind::Throw:
+            plant(node.a);
+            mark(n);
+            _planter->THROW();
+            break;
+        case AstKind::Switch: {
+            plant(node.a);
+            SwitchBlock block = _planter->newSwitchBlock();
+            _planter->SWITCH(block);
+            for (uint32_t i = 0; i < _ast.listSize(node.b); i++) {
+                const AstNode & arm = _ast[_ast.listAt(node.b, i)];
+                if (arm.a == AstNone) {
+                    _planter->DEFAULT(block);
+                } else {
+                    std::vector<Cell> keys;
+                    for (uint32_t j = 0; j < _ast.listSize(arm.a); j++) {
+                        const AstNode & key = _ast[_ast.listAt(arm.a, j)];
+                        if (key.kind == AstKind::Int) {
+                            keys.push_back(Cell::makeSmall(key.intValue()));
+                        } else if (key.kind == AstKind::Bool) {
+                            keys.push_back(key.a ? TrueValue : FalseValue);
+                        } else {
+                            keys.push_back(Cell::makeSymbol(key.a));
+                        }
+                    }
+                    _planter->CASE(block, keys);
+                }
+                plant(arm.b);
+            }
+            _planter->ENDSWITCH(block);
+            break;
+        }
+        case AstKind::Case:
+            //  Planted by its Switch.
+            throw Unreachable();
+        case AstKind::Define:
+            throw CompileTimeError("Nested definitions are not supported");
+    }
+}
+
+} // namespace poppy
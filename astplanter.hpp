@@ -0,0 +1,50 @@
+#ifndef ASTPLANTER_HPP
+#define ASTPLANTER_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "ast.hpp"
+#include "engine.hpp"
+#include "codeplanter.hpp"
+
+namespace poppy {
+
+//  Generates code for the Define nodes of an Ast through CodePlanter,
+//  binding each procedure to its global. Run the AstOptimiser first.
+class AstPlanter {
+private:
+    Engine & _engine;
+    Ast & _ast;
+    SymbolTable & _symbols;
+    CodePlanter * _planter = nullptr;
+    uint64_t _source = 0;
+
+public:
+    AstPlanter(Engine & engine, Ast & ast) :
+        _engine(engine),
+        _ast(ast),
+        _symbols(engine.getSymbolTable())
+    {}
+
+public:
+    void plantDefinition(uint32_t define);
+
+    //  Plants every root of the Ast, returns how many.
+    int plantDefinitions();
+
+    //  The source of the Ast, an index from Engine::addSource, for the
+    //  line tables of the code. Zero, the default, means none.
+    void setSource(uint64_t source) { _source = source; }
+
+private:
+    std::string name(uint32_t symbol);
+    void mark(uint32_t n);
+    void plant(uint32_t n);
+    void plantParameters(CodePlanter & planter, uint32_t params);
+    void plantInfix(const AstNode & node);
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,670 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <unistd.h>
+
+#include "bytecodecache.hpp"
+#include "heap.hpp"
+#include "layout.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+static constexpr uint64_t Magic = 0x3143425950504F50;    //  "POPPYBC1"
+
+//  What a relocated cell refers to. The index is into the names, except
+//  for Procedure where it is into the procedures of the file. A Native
+//  cell keeps the arity, which must match the native's when loaded. A
+//  Source is the source of a line table, by name. Inlined is the callee
+//  of an INLINED marker, by the name of its global, and keeps the hash of
+//  the callee's code, see CodeHasher. It is loaded as the procedure that
+//  the file binds to the name, or else as the global's value if that
+//  still has the same code, so that the marker matches it. Otherwise the
+//  site is deoptimised when it is registered.
+enum class Relocation : uint8_t {
+    Symbol,
+    Ident,
+    Procedure,
+    RecordKey,
+    Native,
+    Source,
+    Inlined
+};
+
+static constexpr uint64_t FnvBasis = 14695981039346656037ULL;
+static constexpr uint64_t FnvPrime = 1099511628211ULL;
+
+static uint64_t fnv1a(uint64_t h, const void * data, std::size_t n) {
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * FnvPrime;
+    }
+    return h;
+}
+
+static uint64_t sourceHash(const SourceBuffer & source) {
+    return fnv1a(FnvBasis, source.begin(), source.size());
+}
+
+BytecodeCache::BytecodeCache(Engine & engine, const std::string & directory) :
+    _engine(engine),
+    _directory(directory)
+{
+}
+
+//  Covers the instruction set, including the numbering of the opcodes and
+//  their operand counts, and the procedure layout.
+uint64_t BytecodeCache::version() const {
+    static const char compiler[] = "poppy bytecode 6";
+    uint64_t h = fnv1a(FnvBasis, compiler, sizeof(compiler));
+    int header = ProcedureLayout::HeaderSize;
+    h = fnv1a(h, &header, sizeof(header));
+    for (auto & [inst, addr] : _engine._opcode_map) {
+        int nargs;
+        unsigned int bitmask;
+        const char * name = instructionInfo(inst, nargs, bitmask);
+        h = fnv1a(h, name, std::strlen(name) + 1);
+        h = fnv1a(h, &nargs, sizeof(nargs));
+    }
+    return h;
+}
+
+std::string BytecodeCache::pathFor(const SourceBuffer & source) const {
+    uint64_t key = version() ^ sourceHash(source);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.pbc", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(_directory) / name).string();
+}
+
+//  Hashes the code of a procedure, by opcode number and by the names of
+//  what its operands refer to, so that the hash is the same in every
+//  process. Quickening does not change it, see genericForm.
+class CodeHasher {
+public:
+    std::map<void *, Instruction> opcodes;
+    std::map<Ident *, std::string> ident_names;
+
+private:
+    Engine & _engine;
+
+public:
+    CodeHasher(Engine & engine, const std::map<Instruction, void *> & opcode_map) : _engine(engine) {
+        for (auto & [inst, addr] : opcode_map) {
+            opcodes[addr] = inst;
+        }
+        _engine.getDictionary().forEach([&](std::string_view name, Ident & ident) {
+            ident_names[&ident] = std::string(name);
+        });
+    }
+
+    uint64_t hash(Cell * key) {
+        key = _engine.expanded(key);
+        uint64_t h = fnv1a(FnvBasis, &key[ProcedureLayout::NumLocalsOffset], sizeof(Cell));
+        const Cell * end = key + key[ProcedureLayout::QBlockOffset].getSmall();
+        for (const Cell * c = key + ProcedureLayout::InstructionsOffset; c < end; ) {
+            auto it = opcodes.find(c->ref);
+            if (it == opcodes.end()) {
+                throw Unreachable();
+            }
+            Instruction inst = genericForm(it->second);
+            h = fnv1a(h, &inst, sizeof(inst));
+            int nargs;
+            unsigned int bitmask;
+            instructionInfo(inst, nargs, bitmask);
+            for (int k = 0; k < nargs; k++) {
+                Cell operand = c[1 + k];
+                switch (operandKind(inst, k)) {
+                    case OperandKind::Ident:
+                        h = text(h, ident_names[operand.refIdent]);
+                        break;
+                    case OperandKind::Native:
+                        h = text(h, static_cast<const NativeFunction *>(operand.ref)->name);
+                        break;
+                    case OperandKind::Literal:
+                        if (operand.getTag() == Tag::Special && operand.getUpperTag() == UpperTag::Symbol) {
+                            h = text(h, _engine.getSymbolTable().name(operand.getSymbolIndex()));
+                        } else if (operand.isProcedure()) {
+                            uint64_t nested = hash(operand.deref());
+                            h = fnv1a(h, &nested, sizeof(nested));
+                        } else if (operand.isRecordKey()) {
+                            Cell classname = operand.deref()[RecordKeyLayout::ClassNameOffset];
+                            h = text(h, _engine.getSymbolTable().name(classname.getSymbolIndex()));
+                        } else {
+                            h = fnv1a(h, &operand, sizeof(operand));
+                        }
+                        break;
+                    default:
+                        //  Leaving out the type feedback of ADD, SUB and MUL.
+                        if (inst != Instruction::ADD && inst != Instruction::SUB && inst != Instruction::MUL) {
+                            h = fnv1a(h, &operand, sizeof(operand));
+                        }
+                        break;
+                }
+            }
+            c += 1 + nargs;
+        }
+        return h;
+    }
+
+private:
+    static uint64_t text(uint64_t h, std::string_view s) {
+        return fnv1a(h, s.data(), s.size() + 1);
+    }
+};
+
+//  Collects the procedures reachable from the bindings, and the names they
+//  use, in the order they are written.
+class BytecodeWriter {
+private:
+    Engine & _engine;
+    CodeHasher _code;
+
+public:
+    std::vector<std::string> names;
+    std::map<std::string, uint64_t> name_index;
+    std::vector<Cell *> procedures;
+    std::map<Cell *, uint64_t> procedure_index;
+    std::vector<uint64_t> words;
+
+public:
+    BytecodeWriter(Engine & engine, const std::map<Instruction, void *> & opcode_map) : _engine(engine), _code(engine, opcode_map) {
+    }
+
+public:
+    uint64_t name(const std::string & name) {
+        auto it = name_index.find(name);
+        if (it != name_index.end()) {
+            return it->second;
+        }
+        names.push_back(name);
+        return name_index[name] = names.size() - 1;
+    }
+
+    //  A stub is written as the procedure it stands for.
+    uint64_t procedure(Cell * key) {
+        key = _engine.expanded(key);
+        auto it = procedure_index.find(key);
+        if (it != procedure_index.end()) {
+            return it->second;
+        }
+        procedures.push_back(key);
+        return procedure_index[key] = procedures.size() - 1;
+    }
+
+    //  Writes the procedures in order, including any they refer to.
+    void writeProcedures() {
+        for (std::size_t i = 0; i < procedures.size(); i++) {
+            writeProcedure(procedures[i]);
+        }
+    }
+
+private:
+    std::string symbolName(Cell c) {
+        return std::string(_engine.getSymbolTable().name(c.getSymbolIndex()));
+    }
+
+    void writeProcedure(Cell * key) {
+        Cell * start = key - ProcedureLayout::KeyOffsetFromStart;
+        std::size_t ncells = ProcedureLayout::KeyOffsetFromStart + key[ProcedureLayout::LengthOffset].getSmall();
+        std::size_t code_end = ProcedureLayout::KeyOffsetFromStart + key[ProcedureLayout::QBlockOffset].getSmall();
+        std::vector<uint64_t> cells(ncells);
+        std::vector<uint64_t> relocations;
+        for (std::size_t n = 0; n < ncells; n++) {
+            cells[n] = start[n].u64;
+        }
+        auto relocate = [&](std::size_t offset, Relocation kind, uint64_t index) {
+            cells[offset] = 0;
+            relocations.push_back(offset << 8 | static_cast<uint64_t>(kind));
+            relocations.push_back(index);
+        };
+
+        relocate(0, Relocation::Symbol, name(symbolName(start[0])));
+        for (std::size_t n = ProcedureLayout::HeaderSize; n < code_end; ) {
+            auto it = _code.opcodes.find(start[n].ref);
+            if (it == _code.opcodes.end()) {
+                throw Unreachable();
+            }
+            Instruction inst = it->second;
+            cells[n] = static_cast<uint64_t>(inst);
+            int nargs;
+            unsigned int bitmask;
+            instructionInfo(inst, nargs, bitmask);
+            for (int k = 0; k < nargs; k++) {
+                std::size_t m = n + 1 + k;
+                Cell c = start[m];
+                switch (operandKind(inst, k)) {
+                    case OperandKind::Ident:
+                        relocate(m, Relocation::Ident, name(_code.ident_names.at(c.refIdent)));
+                        break;
+                    case OperandKind::Native: {
+                        const NativeFunction * native = static_cast<const NativeFunction *>(c.ref);
+                        relocate(m, Relocation::Native, name(native->name));
+                        cells[m] = static_cast<uint64_t>(native->arity);
+                        break;
+                    }
+                    case OperandKind::Literal:
+                        if (c.getTag() == Tag::Special && c.getUpperTag() == UpperTag::Symbol) {
+                            relocate(m, Relocation::Symbol, name(symbolName(c)));
+                        } else if (inst == Instruction::INLINED && k == 1) {
+                            relocate(m, Relocation::Inlined, name(_code.ident_names.at(start[m - 1].refIdent)));
+                            cells[m] = _code.hash(c.deref());
+                        } else if (c.isProcedure()) {
+                            relocate(m, Relocation::Procedure, procedure(c.deref()));
+                        } else if (c.isRecordKey()) {
+                            Cell classname = c.deref()[RecordKeyLayout::ClassNameOffset];
+                            relocate(m, Relocation::RecordKey, name(symbolName(classname)));
+                        } else if (!c.isSmall() && c.getTag() != Tag::Special) {
+                            throw Mishap("Cannot cache literal").culprit("Literal", static_cast<int64_t>(c.i64));
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+            n += 1 + nargs;
+        }
+
+        const Cell * count = start + ncells - 1;
+        const Cell * h = count - count->u64 * HandlerLayout::Size;
+        uint64_t source = h[LineTableLayout::SourceOffset].u64;
+        if (source != 0) {
+            relocate(h + LineTableLayout::SourceOffset - start, Relocation::Source, name(std::string(_engine.sourceName(source))));
+        }
+
+        words.push_back(ncells);
+        words.push_back(relocations.size() / 2);
+        words.insert(words.end(), cells.begin(), cells.end());
+        words.insert(words.end(), relocations.begin(), relocations.end());
+    }
+};
+
+void BytecodeCache::store(const SourceBuffer & source, const std::vector<std::string> & globals) {
+    BytecodeWriter writer(_engine, _engine._opcode_map);
+    std::vector<uint64_t> bindings;
+    for (auto & g : globals) {
+        Ident * ident = _engine.getDictionary().lookup(g);
+        if (ident == nullptr || !ident->value().isProcedure()) {
+            throw Mishap("Cannot cache a global that is not a procedure").culprit("Name", g);
+        }
+        bindings.push_back(writer.name(g));
+        bindings.push_back(writer.procedure(ident->value().deref()));
+    }
+    writer.writeProcedures();
+
+    std::vector<uint64_t> out = {
+        Magic, version(), sourceHash(source), source.size(),
+        writer.names.size(), writer.procedures.size(), bindings.size() / 2
+    };
+    for (auto & name : writer.names) {
+        out.push_back(name.size());
+        std::size_t at = out.size();
+        out.resize(at + (name.size() + 7) / 8);
+        std::memcpy(&out[at], name.data(), name.size());
+    }
+    out.insert(out.end(), writer.words.begin(), writer.words.end());
+    out.insert(out.end(), bindings.begin(), bindings.end());
+
+    //  Written aside and renamed, so that a concurrent load sees either the
+    //  old file or the new one.
+    std::filesystem::create_directories(_directory);
+    std::string path = pathFor(source);
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(out.data()), out.size() * sizeof(uint64_t));
+        if (!file) {
+            throw Mishap("Cannot write bytecode cache").culprit("File", temp);
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw Mishap("Cannot write bytecode cache").culprit("File", path);
+    }
+}
+
+//  Bounds-checked reading of the words of a mapped file, which need not
+//  be aligned.
+class WordReader {
+private:
+    const char * _start;
+    std::size_t _count;
+    std::size_t _at = 0;
+
+public:
+    bool ok = true;
+
+public:
+    WordReader(const SourceBuffer & file) : _start(file.begin()), _count(file.size() / 8) {}
+
+    uint64_t next() {
+        if (_at >= _count) {
+            ok = false;
+            return 0;
+        }
+        uint64_t w;
+        std::memcpy(&w, _start + 8 * _at++, sizeof(w));
+        return w;
+    }
+
+    std::size_t remaining() const { return _count - _at; }
+
+    std::string string(std::size_t length) {
+        std::size_t nwords = (length + 7) / 8;
+        if (nwords > remaining()) {
+            ok = false;
+            return std::string();
+        }
+        std::string s(_start + 8 * _at, length);
+        _at += nwords;
+        return s;
+    }
+};
+
+bool BytecodeCache::load(const SourceBuffer & source, bool compact) {
+    std::string path = pathFor(source);
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    SourceBuffer file(path);
+    WordReader in(file);
+    if (
+        in.next() != Magic || in.next() != version() ||
+        in.next() != sourceHash(source) || in.next() != source.size()
+    ) {
+        return false;
+    }
+    uint64_t nnames = in.next();
+    uint64_t nprocedures = in.next();
+    uint64_t nbindings = in.next();
+    if (!in.ok || nnames > in.remaining() || nprocedures > in.remaining() || nbindings > in.remaining()) {
+        return false;
+    }
+
+    std::vector<std::string> names;
+    for (uint64_t i = 0; i < nnames && in.ok; i++) {
+        names.push_back(in.string(in.next()));
+    }
+
+    //  Check and relocate each procedure in a staging area, so that nothing
+    //  is allocated, declared or interned unless the whole file is good.
+    //  The opcodes stay as numbers until we know which form the procedure
+    //  will take.
+    struct NameRef {
+        uint64_t procedure;
+        std::size_t offset;
+        Relocation kind;
+        uint64_t name;
+    };
+    struct ProcedureRef {
+        uint64_t from;
+        std::size_t offset;
+        uint64_t to;
+    };
+    std::vector<std::vector<Cell>> staged(nprocedures);
+    std::vector<std::size_t> code_ends;
+    std::vector<NameRef> name_refs;
+    std::vector<ProcedureRef> procedure_refs;
+    std::vector<std::pair<uint64_t, std::size_t>> source_refs;
+    std::vector<std::pair<uint64_t, std::size_t>> sparse_tables;
+    auto & dictionary = _engine.getDictionary();
+    for (uint64_t i = 0; i < nprocedures && in.ok; i++) {
+        uint64_t ncells = in.next();
+        uint64_t nrelocations = in.next();
+        if (!in.ok || ncells < ProcedureLayout::HeaderSize || ncells > in.remaining()) {
+            return false;
+        }
+        std::vector<Cell> & cells = staged[i];
+        cells.resize(ncells);
+        for (auto & c : cells) {
+            c.u64 = in.next();
+        }
+        if (cells[ProcedureLayout::KeyOffsetFromStart].u64 != ProcedureKeyValue.u64) {
+            return false;
+        }
+
+        std::size_t code_end = ProcedureLayout::KeyOffsetFromStart + cells[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::QBlockOffset].getSmall();
+        if (code_end > ncells) {
+            return false;
+        }
+        for (std::size_t n = ProcedureLayout::HeaderSize; n < code_end; ) {
+            if (cells[n].u64 >= _engine._opcode_map.size()) {
+                return false;
+            }
+            auto it = _engine._opcode_map.find(static_cast<Instruction>(cells[n].u64));
+            if (it == _engine._opcode_map.end()) {
+                return false;
+            }
+            int nargs;
+            unsigned int bitmask;
+            instructionInfo(it->first, nargs, bitmask);
+            if (it->first == Instruction::SWITCH_SPARSE) {
+                //  The table of CASEs, with the default after them.
+                uint64_t ncases = cells[n + 1].u64;
+                int64_t table = static_cast<int64_t>(n + 2) + cells[n + 2].i64;
+                if (table < static_cast<int64_t>(ProcedureLayout::HeaderSize) || table >= static_cast<int64_t>(code_end) || ncases >= (code_end - table) / CaseLayout::Size) {
+                    return false;
+                }
+                sparse_tables.emplace_back(i, n);
+            }
+            n += 1 + nargs;
+        }
+        code_ends.push_back(code_end);
+
+        //  The handler table ends the procedure and points into the code.
+        //  The line table comes before it and its source is relocated.
+        uint64_t nhandlers = cells[ncells - 1].u64;
+        if (code_end + LineTableLayout::Size >= ncells || nhandlers > (ncells - 1 - code_end - LineTableLayout::Size) / HandlerLayout::Size) {
+            return false;
+        }
+        std::size_t h = ncells - 1 - nhandlers * HandlerLayout::Size;
+        for (std::size_t n = h; n < ncells - 1; n++) {
+            if (cells[n].u64 > code_end - ProcedureLayout::KeyOffsetFromStart) {
+                return false;
+            }
+        }
+        uint64_t nbytes = cells[h + LineTableLayout::BytesOffset].u64;
+        if (cells[h + LineTableLayout::SourceOffset].u64 != 0 || nbytes > 8 * (h - LineTableLayout::Size - code_end)) {
+            return false;
+        }
+
+        for (uint64_t r = 0; r < nrelocations && in.ok; r++) {
+            uint64_t word = in.next();
+            uint64_t index = in.next();
+            std::size_t offset = word >> 8;
+            Relocation kind = static_cast<Relocation>(word & 0xFF);
+            if (offset >= ncells || (kind == Relocation::Procedure ? index >= nprocedures : index >= nnames)) {
+                return false;
+            }
+            switch (kind) {
+                case Relocation::Symbol:
+                case Relocation::Ident:
+                case Relocation::Inlined:
+                    name_refs.push_back(NameRef{ i, offset, kind, index });
+                    break;
+                case Relocation::RecordKey: {
+                    Ident * ident = dictionary.lookup(names[index]);
+                    if (ident == nullptr || !ident->value().isRecordClass()) {
+                        return false;
+                    }
+                    cells[offset] = Cell::makeRecordKey(ident->value().deref());
+                    break;
+                }
+                case Relocation::Procedure:
+                    procedure_refs.push_back(ProcedureRef{ i, offset, index });
+                    break;
+                case Relocation::Native: {
+                    const NativeFunction * native = _engine.native(names[index]);
+                    if (native == nullptr || static_cast<uint64_t>(native->arity) != cells[offset].u64) {
+                        return false;
+                    }
+                    cells[offset] = Cell{ .ref = const_cast<NativeFunction *>(native) };
+                    break;
+                }
+                //  Only positions in the source being loaded can be resolved.
+                case Relocation::Source:
+                    if (names[index] == source.name()) {
+                        source_refs.emplace_back(i, offset);
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> bindings;
+    for (uint64_t i = 0; i < nbindings && in.ok; i++) {
+        uint64_t name = in.next();
+        uint64_t procedure = in.next();
+        if (name >= nnames || procedure >= nprocedures) {
+            return false;
+        }
+        bindings.emplace_back(name, procedure);
+    }
+    if (!in.ok) {
+        return false;
+    }
+
+    //  An inlined callee is either bound by this file, in which case it is
+    //  resolved once the procedures have keys, or must be a global that
+    //  still holds the code that was inlined. If it is not, the marker is
+    //  given a literal that no global matches, so the site is deoptimised.
+    std::map<uint64_t, uint64_t> bound;
+    for (auto & [name, procedure] : bindings) {
+        bound[name] = procedure;
+    }
+    std::vector<std::pair<const NameRef *, uint64_t>> inlined_refs;
+    std::optional<CodeHasher> hasher;
+    for (auto & ref : name_refs) {
+        if (ref.kind != Relocation::Inlined) {
+            continue;
+        }
+        auto it = bound.find(ref.name);
+        if (it != bound.end()) {
+            inlined_refs.emplace_back(&ref, it->second);
+            continue;
+        }
+        Cell & cell = staged[ref.procedure][ref.offset];
+        Ident * ident = dictionary.lookup(names[ref.name]);
+        if (ident != nullptr && ident->value().isProcedure()) {
+            if (!hasher) {
+                hasher.emplace(_engine, _engine._opcode_map);
+            }
+            if (hasher->hash(ident->value().deref()) == cell.u64) {
+                cell = ident->value();
+                continue;
+            }
+        }
+        cell = FalseValue;
+    }
+
+    for (auto & ref : name_refs) {
+        Cell & cell = staged[ref.procedure][ref.offset];
+        if (ref.kind == Relocation::Symbol) {
+            cell = Cell::makeSymbol(_engine.symbolIndex(names[ref.name]));
+        } else if (ref.kind == Relocation::Ident) {
+            bool redeclared;
+            cell = Cell::makeRefIdent(dictionary.declare(names[ref.name], redeclared));
+        }
+    }
+    //  Symbols are numbered in the order they are interned, so the keys of
+    //  a sparse table that has symbols among them may be out of order now.
+    //  Each CASE that moves keeps its target.
+    for (auto & [i, n] : sparse_tables) {
+        Cell * pc = staged[i].data() + n + 1;
+        uint64_t ncases = pc[0].u64;
+        Cell * cases = pc + 1 + pc[1].i64;
+        std::vector<std::pair<Cell, int64_t>> entries;
+        for (uint64_t k = 0; k < ncases; k++) {
+            Cell * c = cases + k * CaseLayout::Size;
+            entries.emplace_back(c[CaseLayout::KeyOffset], c[CaseLayout::BranchOffset].i64 + static_cast<int64_t>(k * CaseLayout::Size));
+        }
+        std::sort(entries.begin(), entries.end(), [](auto & x, auto & y) { return x.first.u64 < y.first.u64; });
+        for (uint64_t k = 0; k < ncases; k++) {
+            Cell * c = cases + k * CaseLayout::Size;
+            c[CaseLayout::KeyOffset] = entries[k].first;
+            c[CaseLayout::BranchOffset] = Cell::makeI64(entries[k].second - static_cast<int64_t>(k * CaseLayout::Size));
+        }
+    }
+    if (!source_refs.empty()) {
+        uint64_t index = _engine.addSource(source);
+        for (auto & [i, offset] : source_refs) {
+            staged[i][offset] = Cell::makeU64(index);
+        }
+    }
+
+    std::vector<Cell *> keys;
+    if (compact) {
+        //  Every procedure gets its stub first, so that the procedures
+        //  refer to each other through the stubs.
+        CompactLibrary & library = _engine.addCompactLibrary();
+        for (auto & cells : staged) {
+            keys.push_back(library.addProcedure(_engine, cells[0]));
+        }
+        for (auto & ref : procedure_refs) {
+            staged[ref.from][ref.offset] = Cell::makePtr(keys[ref.to]);
+        }
+        for (auto & [ref, to] : inlined_refs) {
+            staged[ref->procedure][ref->offset] = Cell::makePtr(keys[to]);
+        }
+        for (std::size_t i = 0; i < staged.size(); i++) {
+            library.encode(i, staged[i].data(), code_ends[i], staged[i].size());
+            std::vector<Cell>().swap(staged[i]);
+        }
+        library.finish();
+        for (auto & [name, procedure] : bindings) {
+            bool redeclared;
+            Ident * ident = dictionary.declare(names[name], redeclared);
+            _engine.assign(ident, Cell::makePtr(keys[procedure]));
+            library.bind(procedure, ident);
+        }
+        return true;
+    }
+
+    //  The INLINED markers, as (procedure, offset), are registered once
+    //  the globals they depend on are bound.
+    std::vector<std::pair<std::size_t, std::size_t>> markers;
+    for (std::size_t i = 0; i < staged.size(); i++) {
+        std::vector<Cell> & cells = staged[i];
+        for (std::size_t n = ProcedureLayout::HeaderSize; n < code_ends[i]; ) {
+            Instruction inst = static_cast<Instruction>(cells[n].u64);
+            int nargs;
+            unsigned int bitmask;
+            instructionInfo(inst, nargs, bitmask);
+            cells[n].ref = _engine._opcode_map.at(inst);
+            if (inst == Instruction::INLINED) {
+                markers.emplace_back(i, n);
+            }
+            n += 1 + nargs;
+        }
+        Builder builder(_engine.getHeap());
+        for (std::size_t n = 0; n < cells.size(); n++) {
+            if (n == ProcedureLayout::KeyOffsetFromStart) {
+                builder.addKey(cells[n]);
+            } else {
+                builder.addCell(cells[n]);
+            }
+        }
+        keys.push_back(builder.object());
+    }
+    for (auto & ref : procedure_refs) {
+        keys[ref.from][ref.offset - ProcedureLayout::KeyOffsetFromStart] = Cell::makePtr(keys[ref.to]);
+    }
+    for (auto & [ref, to] : inlined_refs) {
+        keys[ref->procedure][ref->offset - ProcedureLayout::KeyOffsetFromStart] = Cell::makePtr(keys[to]);
+    }
+    for (auto & [name, procedure] : bindings) {
+        bool redeclared;
+        _engine.assign(dictionary.declare(names[name], redeclared), Cell::makePtr(keys[procedure]));
+    }
+    for (auto & [i, n] : markers) {
+        _engine.registerInlineSite(keys[i] - ProcedureLayout::KeyOffsetFromStart + n);
+    }
+    return true;
+}
+
+} // namespace poppy
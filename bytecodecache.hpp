@@ -0,0 +1,63 @@
+#ifndef BYTECODECACHE_HPP
+#define BYTECODECACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+#include "sourcebuffer.hpp"
+
+namespace poppy {
+
+/*  A persistent cache of compiled procedures, so that an unchanged source
+    does not have to be compiled again. Each source has one file in the
+    cache directory, named by a hash of its text and of the instruction
+    set, so an edit to either simply misses.
+
+    Procedures are saved in a position-independent form: instructions are
+    opcode numbers, and every operand that refers to the heap or to the
+    process (Idents, symbols, record classes, nested procedures, natives,
+    inlined callees and the source of the line table) is zeroed and
+    listed in a relocation table by name. Loading maps the file and copies each
+    procedure into the heap. A relinking pass then turns the opcodes back
+    into _opcode_map addresses and applies the relocations.
+
+    A file is a sequence of 64-bit words:
+
+        magic, version, source hash, source size,
+        #names, #procedures, #bindings,
+        names       length, then the bytes padded to a word,
+        procedures  #cells, #relocations, cells, (offset << 8 | kind, index) ...
+        bindings    (name, procedure) ...
+*/
+
+class BytecodeCache {
+private:
+    Engine & _engine;
+    std::string _directory;
+
+public:
+    BytecodeCache(Engine & engine, const std::string & directory);
+
+public:
+    //  The cache file for a source, whether or not it exists.
+    std::string pathFor(const SourceBuffer & source) const;
+
+    //  Binds the procedures cached for this source. Returns false if there
+    //  is no cache file or it is stale or unreadable, in which case
+    //  nothing has been bound. If compact, the procedures are kept in
+    //  their compact form until they are first called, see compactcode.
+    bool load(const SourceBuffer & source, bool compact = false);
+
+    //  Saves the global procedures named, which must have been compiled
+    //  from this source, replacing any previous cache file atomically.
+    void store(const SourceBuffer & source, const std::vector<std::string> & globals);
+
+private:
+    uint64_t version() const;
+};
+
+} // namespace poppy
+
+#endif
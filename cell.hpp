@@ -46,7 +46,7 @@ namespace poppy {
     };
 
     constexpr uint64_t FALSE_VALUE = (static_cast<int>(UpperTag::False) << TAG_WIDTH) | static_cast<int>(Tag::Special);
-    constexpr uint64_t TRUE_VALUE  = (static_cast<int>(UpperTag::True) << TAG_WIDTH) | static_cast<int>(Tag::Small);
+    constexpr uint64_t TRUE_VALUE  = (static_cast<int>(UpperTag::True) << TAG_WIDTH) | static_cast<int>(Tag::Special);
 
     //  System keys
     enum class KeyCode {
@@ -55,9 +55,18 @@ namespace poppy {
         BooleanKeyCode,         // 0001_0011 <- Boolean key
         IntKeyCode,             // 0001_1011 <- Int vector key
         SymbolCode,             // 0010_1011 <- Symbol key
+        ClosureKeyCode,         // 0010_1011 <- Closure key
+        BoxKeyCode,             // 0011_0011 <- Box key (mutable captured variable)
     };
 
     constexpr uint64_t PROCEDURE_KEY_VALUE = (((int)KeyCode::ProcedureKeyCode) << TAG_WIDTH) | (int)Tag::Key;
+    constexpr uint64_t KEY_KEY_VALUE = (((int)KeyCode::KeyKeyCode) << TAG_WIDTH) | (int)Tag::Key;
+    constexpr uint64_t CLOSURE_KEY_VALUE = (((int)KeyCode::ClosureKeyCode) << TAG_WIDTH) | (int)Tag::Key;
+    constexpr uint64_t BOX_KEY_VALUE = (((int)KeyCode::BoxKeyCode) << TAG_WIDTH) | (int)Tag::Key;
+
+    //  Key cells below this limit are system keys. Above it the key cell
+    //  is the address of a key object (e.g. a record class) tagged as a key.
+    constexpr uint64_t SYSTEM_KEY_LIMIT = 0x100;
 
 
     class Cell {
@@ -91,6 +100,10 @@ namespace poppy {
             return Cell{ .i64 = n };
         }
 
+        inline static Cell makeRecordKey( Cell * keyObject ) {
+            return Cell{ .u64 = ((uint64_t)keyObject | (int)Tag::Key) };
+        }
+
         inline static Cell makeSymbol( std::size_t n ) {
             constexpr uint8_t SymbolWideTag = (static_cast<uint8_t>(UpperTag::Symbol) << TAG_WIDTH) | static_cast<uint8_t>(Tag::Special);
             return Cell{ .u64 = ( (n << BOTH_WIDTH) | SymbolWideTag ) };
@@ -116,6 +129,26 @@ namespace poppy {
             return isTaggedPtr() && (deref()->u64 == PROCEDURE_KEY_VALUE);
         }
 
+        inline bool isClosure() const {
+            return isTaggedPtr() && (deref()->u64 == CLOSURE_KEY_VALUE);
+        }
+
+        inline bool isBox() const {
+            return isTaggedPtr() && (deref()->u64 == BOX_KEY_VALUE);
+        }
+
+        inline bool isRecordKey() const {
+            return isKey() && u64 >= SYSTEM_KEY_LIMIT;
+        }
+
+        inline bool isRecordClass() const {
+            return isTaggedPtr() && (deref()->u64 == KEY_KEY_VALUE);
+        }
+
+        inline bool isRecord() const {
+            return isTaggedPtr() && deref()->isRecordKey();
+        }
+
     public:
         inline int getSymbolIndex() const {
             return (u64 >> BOTH_WIDTH);
@@ -152,6 +185,9 @@ namespace poppy {
         inline bool isntNull() const { return cellRef != nullptr; }
         inline bool isKey() const { return (cellRef->u64 & TAG_MASK) == (uint64_t)Tag::Key; }
         inline bool isProcedure() const { return cellRef->u64 == PROCEDURE_KEY_VALUE; }
+        inline bool isRecordClass() const { return cellRef->u64 == KEY_KEY_VALUE; }
+        inline bool isClosure() const { return cellRef->u64 == CLOSURE_KEY_VALUE; }
+        inline bool isRecord() const { return cellRef->isRecordKey(); }
         inline Cell procName() const { return cellRef[ProcedureLayout::ProcNameOffset]; }
         inline KeyCode keyCode() const { return static_cast<KeyCode>((cellRef->u64 >> TAG_WIDTH) & 0xFFFFFFFF); }
     public:
@@ -162,14 +198,22 @@ namespace poppy {
     class Ident {
     private:
         class Cell _value;
+        bool _inlined = false;
     public:
+        Ident() : _value(Cell::makeSmall(0)) {}
         Ident(Cell value) : _value(value) {}
         inline Cell & value() { return _value; }
+        //  Whether some code has inlined the value, see Engine::assign.
+        inline bool isInlined() const { return _inlined; }
+        inline void setInlined(bool inlined) { _inlined = inlined; }
     };
 
     constexpr Cell FalseValue{ .u64 = FALSE_VALUE };
     constexpr Cell TrueValue{ .u64 = TRUE_VALUE };
     constexpr Cell ProcedureKeyValue{ .u64 = PROCEDURE_KEY_VALUE };
+    constexpr Cell KeyKeyValue{ .u64 = KEY_KEY_VALUE };
+    constexpr Cell ClosureKeyValue{ .u64 = CLOSURE_KEY_VALUE };
+    constexpr Cell BoxKeyValue{ .u64 = BOX_KEY_VALUE };
     constexpr Cell BooleanKeyValue{ .u64 = (((int)KeyCode::BooleanKeyCode) << TAG_WIDTH) | (int)Tag::Key };
 }
 
@@ -0,0 +1,181 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "charclass.hpp"
+
+namespace poppy {
+
+namespace {
+
+constexpr bool isSign(int ch) {
+    for (const char * s = "!#$%&*+-./:<=>?@\\^|~"; *s != 0; s++) {
+        if (*s == ch) return true;
+    }
+    return false;
+}
+
+constexpr uint8_t classify(int ch) {
+    return (
+        ch == ' ' || (ch >= '\t' && ch <= '\r') ? SpaceClass :
+        (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ? AlphaClass :
+        ch >= '0' && ch <= '9' ? DigitClass :
+        ch == '_' ? UnderscoreClass :
+        ch != 0 && isSign(ch) ? SignClass :
+        0
+    );
+}
+
+template <uint8_t Classes>
+inline const char * skipScalar(const char * p, const char * end) {
+    while (p < end && (charClassTable[static_cast<unsigned char>(*p)] & Classes) != 0) {
+        p += 1;
+    }
+    return p;
+}
+
+//  The vector predicates below only have to agree with the table on
+//  ASCII. Bytes >= 0x80 are negative as signed chars and so fall outside
+//  every range test, matching the table.
+
+#if defined(__AVX2__)
+
+constexpr int VectorSize = 32;
+typedef __m256i Vector;
+
+inline Vector load(const char * p) { return _mm256_loadu_si256(reinterpret_cast<const Vector *>(p)); }
+inline Vector splat(char ch) { return _mm256_set1_epi8(ch); }
+inline Vector eq(Vector a, Vector b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vector gt(Vector a, Vector b) { return _mm256_cmpgt_epi8(a, b); }
+inline Vector both(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+inline Vector either(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+inline uint32_t bits(Vector v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+constexpr uint32_t AllBits = 0xFFFFFFFFu;
+
+#elif defined(__SSE2__)
+
+constexpr int VectorSize = 16;
+typedef __m128i Vector;
+
+inline Vector load(const char * p) { return _mm_loadu_si128(reinterpret_cast<const Vector *>(p)); }
+inline Vector splat(char ch) { return _mm_set1_epi8(ch); }
+inline Vector eq(Vector a, Vector b) { return _mm_cmpeq_epi8(a, b); }
+inline Vector gt(Vector a, Vector b) { return _mm_cmpgt_epi8(a, b); }
+inline Vector both(Vector a, Vector b) { return _mm_and_si128(a, b); }
+inline Vector either(Vector a, Vector b) { return _mm_or_si128(a, b); }
+inline uint32_t bits(Vector v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+constexpr uint32_t AllBits = 0xFFFFu;
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+//  lo <= v <= hi, for lo > 0.
+inline Vector inRange(Vector v, char lo, char hi) {
+    return both(gt(v, splat(lo - 1)), gt(splat(hi + 1), v));
+}
+
+inline Vector spaceMask(Vector v) {
+    return either(eq(v, splat(' ')), inRange(v, '\t', '\r'));
+}
+
+inline Vector numberMask(Vector v) {
+    return either(inRange(v, '0', '9'), eq(v, splat('_')));
+}
+
+inline Vector identMask(Vector v) {
+    //  Folding to lower case maps no non-letter onto a letter.
+    Vector lower = either(v, splat(0x20));
+    return either(inRange(lower, 'a', 'z'), numberMask(v));
+}
+
+//  Most runs are short, so the first few bytes are checked one at a time
+//  before switching to whole vectors. Prefixes of 16, 32 and 64 bytes
+//  measured no faster than 8 with AVX2 or SSE2.
+constexpr int ScalarPrefix = 8;
+
+template <Vector (*Mask)(Vector), uint8_t Classes>
+inline const char * skipVector(const char * p, const char * end) {
+    const char * prefix_end = end - p > ScalarPrefix ? p + ScalarPrefix : end;
+    while (p < prefix_end) {
+        if ((charClassTable[static_cast<unsigned char>(*p)] & Classes) == 0) return p;
+        p += 1;
+    }
+    while (end - p >= VectorSize) {
+        uint32_t m = bits(Mask(load(p)));
+        if (m != AllBits) {
+            return p + __builtin_ctz(~m);
+        }
+        p += VectorSize;
+    }
+    return skipScalar<Classes>(p, end);
+}
+
+#endif
+
+} // namespace
+
+const uint8_t charClassTable[256] = {
+#define ROW(n) \
+    classify(n+0), classify(n+1), classify(n+2), classify(n+3), \
+    classify(n+4), classify(n+5), classify(n+6), classify(n+7)
+    ROW(0x00), ROW(0x08), ROW(0x10), ROW(0x18), ROW(0x20), ROW(0x28), ROW(0x30), ROW(0x38),
+    ROW(0x40), ROW(0x48), ROW(0x50), ROW(0x58), ROW(0x60), ROW(0x68), ROW(0x70), ROW(0x78),
+    ROW(0x80), ROW(0x88), ROW(0x90), ROW(0x98), ROW(0xA0), ROW(0xA8), ROW(0xB0), ROW(0xB8),
+    ROW(0xC0), ROW(0xC8), ROW(0xD0), ROW(0xD8), ROW(0xE0), ROW(0xE8), ROW(0xF0), ROW(0xF8),
+#undef ROW
+};
+
+const char * skipSpace(const char * p, const char * end) {
+    return skipScalar<SpaceClass>(p, end);
+}
+
+const char * skipIdent(const char * p, const char * end) {
+    return skipScalar<AlphaClass | DigitClass | UnderscoreClass>(p, end);
+}
+
+const char * skipNumber(const char * p, const char * end) {
+    return skipScalar<DigitClass | UnderscoreClass>(p, end);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+const char * skipSpaceVector(const char * p, const char * end) {
+    return skipVector<spaceMask, SpaceClass>(p, end);
+}
+
+const char * skipIdentVector(const char * p, const char * end) {
+    return skipVector<identMask, AlphaClass | DigitClass | UnderscoreClass>(p, end);
+}
+
+const char * skipNumberVector(const char * p, const char * end) {
+    return skipVector<numberMask, DigitClass | UnderscoreClass>(p, end);
+}
+
+#else
+
+const char * skipSpaceVector(const char * p, const char * end) {
+    return skipSpace(p, end);
+}
+
+const char * skipIdentVector(const char * p, const char * end) {
+    return skipIdent(p, end);
+}
+
+const char * skipNumberVector(const char * p, const char * end) {
+    return skipNumber(p, end);
+}
+
+#endif
+
+const char * charClassScanner() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace poppy
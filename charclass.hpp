@@ -0,0 +1,65 @@
+#ifndef CHARCLASS_HPP
+#define CHARCLASS_HPP
+
+#include <cstdint>
+
+namespace poppy {
+
+/*  Character classification for the itemizer. The classes follow the
+    "C" locale definitions of isspace/isalpha/isdigit, so bytes >= 0x80
+    belong to no class. Classification is a single table lookup rather
+    than a locale-aware libc call.
+
+    The run scanners return a pointer to the first byte in [p, end) that
+    is not in the run. They go a byte at a time through the table. The
+    *Vector versions examine 16 or 32 bytes per step when compiled with
+    SSE2 or AVX2, but most runs in source are too short for that to pay:
+    itemizer_bench on an AVX2 machine runs the mixed sample at about 1100
+    MB/s with the table and 940 MB/s with AVX2, and the vector versions
+    only win in an optimised build restricted to SSE2 (880 against 770).
+    So the itemizer uses the table and the vector versions are kept for
+    the benchmark.
+*/
+
+enum CharClass : uint8_t {
+    SpaceClass = 0x1,
+    AlphaClass = 0x2,
+    DigitClass = 0x4,
+    UnderscoreClass = 0x8,
+    SignClass = 0x10,       //  Runs of these form a single item, such as -> or :=
+};
+
+extern const uint8_t charClassTable[256];
+
+inline bool isCharClass(char ch, uint8_t classes) {
+    return (charClassTable[static_cast<unsigned char>(ch)] & classes) != 0;
+}
+
+inline bool isSpaceChar(char ch) { return isCharClass(ch, SpaceClass); }
+inline bool isDigitChar(char ch) { return isCharClass(ch, DigitClass); }
+inline bool isSignChar(char ch) { return isCharClass(ch, SignClass); }
+
+//  Can start an identifier.
+inline bool isIdentStartChar(char ch) { return isCharClass(ch, AlphaClass | UnderscoreClass); }
+
+//  Can continue an identifier.
+inline bool isIdentChar(char ch) { return isCharClass(ch, AlphaClass | DigitClass | UnderscoreClass); }
+
+//  Can continue a number, '_' being a digit separator.
+inline bool isNumberChar(char ch) { return isCharClass(ch, DigitClass | UnderscoreClass); }
+
+const char * skipSpace(const char * p, const char * end);
+const char * skipIdent(const char * p, const char * end);
+const char * skipNumber(const char * p, const char * end);
+
+const char * skipSpaceVector(const char * p, const char * end);
+const char * skipIdentVector(const char * p, const char * end);
+const char * skipNumberVector(const char * p, const char * end);
+
+//  Names what the *Vector scanners were compiled for: "avx2", "sse2" or
+//  "scalar".
+const char * charClassScanner();
+
+} // namespace poppy
+
+#endif
@@ -1,5 +1,8 @@
 
+#include <algorithm>
+#include <array>
 #include <cstdlib>
+#include <deque>
 #include <vector>   
 #include <fstream>
 #include <iostream>
@@ -41,8 +44,17 @@ void Label::setLabel() {
 }
 
 
+CodePlanter::CodePlanter(Engine & engine, CodePlanter * parent) :
+    CodePlanter(engine)
+{
+    _parent = parent;
+    _tier = parent->_tier;
+    _source = parent->_source;
+}
+
 CodePlanter::CodePlanter(Engine & engine) : 
     _engine(engine),
+    _tier(engine.defaultTier()),
     _builder(engine.getHeap())
 {
     _builder.addCell(Cell{});                               // proc name
@@ -54,6 +66,7 @@ CodePlanter::CodePlanter(Engine & engine) :
     _builder.addKey(ProcedureKeyValue);     // key
     _builder.addCell(Cell::makeSmall(0));                   // num locals
     _num_locals = _builder.placeHolderJustPlanted();
+    _builder.addCell(StackNeeds::make(0, 0));               // stack, set by optimise
 }
 
 void CodePlanter::debugDisplay() {
@@ -89,10 +102,15 @@ void CodePlanter::debugDisplay() {
             n += 1;
         }
     }
+
+    if (_built != nullptr) {
+        std::cout << "Q-block offset: " << _built[ProcedureLayout::QBlockOffset].getSmall() << std::endl;
+    }
+    std::cout << "Q-block size:   " << _q_offsets.size() << std::endl;
 }
 
 void CodePlanter::addInstruction(Instruction inst) {
-    Ref label_addr = _engine._opcode_map[inst];
+    Ref label_addr = _engine._opcode_map.at(inst);
     _builder.addCell(Cell{ .ref = label_addr });
 }
 
@@ -105,17 +123,28 @@ void CodePlanter::addDataQ(Cell cell) {
     _builder.addCell(cell);
 }
 
+//  Items saturate their positions, so MaxPosition is not a real offset
+//  and the code keeps the position it had.
+void CodePlanter::position(size_t offset) {
+    if (offset >= Item::MaxPosition) {
+        return;
+    }
+    uint32_t here = static_cast<uint32_t>(offset);
+    if (!_lines.empty() && _lines.back().position == _builder.size()) {
+        _lines.back().offset = here;
+    } else if (_lines.empty() || _lines.back().offset != here) {
+        _lines.push_back(LineMark{ _builder.size(), here });
+    }
+}
+
 void CodePlanter::addRawUInt(uint64_t n) {
     _builder.addCell( Cell{ .u64 = n } );
 }
 
 void CodePlanter::addGlobal(const std::string & name, Instruction inst) {
     addInstruction(inst);
-    auto & dict = _engine.getDictionary();
-    if (dict.find(name) == dict.end()) {
-        std::cerr << "Global not declared: " << name << std::endl;
-    }
-    _builder.addCell(Cell::makeRefIdent(dict[name]));
+    _global_refs.push_back(GlobalRef{ _builder.size(), name });
+    _builder.addCell(Cell{});
 }
 
 void CodePlanter::addLocal(const std::string & varname, Instruction inst) {
@@ -124,25 +153,328 @@ void CodePlanter::addLocal(const std::string & varname, Instruction inst) {
     }
 }
 
-bool CodePlanter::tryAddLocal(const std::string & varname, Instruction inst) {
+int CodePlanter::localIndex(const std::string & name) {
     for (int i = locals.size(); i > 0; i--) {
-        if (locals[i-1] == varname) {
-            addInstruction(inst);
-            addRawUInt(i);  // This needs to become max_level - i.
-            PlaceHolder p = _builder.placeHolderJustPlanted();
-            local_fixups.push_back(p);
-            return true;
+        if (locals[i-1] == name) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void CodePlanter::addLocalOperand(int i) {
+    addRawUInt(i);  // This needs to become max_level - i.
+    PlaceHolder p = _builder.placeHolderJustPlanted();
+    local_fixups.push_back(p);
+}
+
+void CodePlanter::plantLocal(Instruction inst, int i, Instruction boxed) {
+    _var_accesses.push_back(VarAccess{ _builder.size(), false, i, boxed });
+    addInstruction(inst);
+    addLocalOperand(i);
+}
+
+static Instruction boxedLocalInstruction(Instruction inst) {
+    switch (inst) {
+        case Instruction::PUSH_LOCAL: return Instruction::PUSH_LOCAL_BOXED;
+        case Instruction::POP_LOCAL: return Instruction::POP_LOCAL_BOXED;
+        case Instruction::CALL_LOCAL: return Instruction::CALL_LOCAL_BOXED;
+        default: throw Unreachable();
+    }
+}
+
+bool CodePlanter::tryAddLocal(const std::string & varname, Instruction inst) {
+    int i = localIndex(varname);
+    if (i == 0) {
+        return false;
+    }
+    Instruction boxed = boxedLocalInstruction(inst);
+    if (inst == Instruction::POP_LOCAL) {
+        //  The first POP is the one that initialises the local.
+        if (local_info[i-1].assignments == 0) {
+            boxed = Instruction::INIT_LOCAL_BOXED;
         }
+        local_info[i-1].assignments += 1;
+    }
+    plantLocal(inst, i, boxed);
+    return true;
+}
+
+//  Returns the index of the captured variable, capturing it from the
+//  enclosing planters if necessary, or -1 if it is not an outer local.
+int CodePlanter::captureIndex(const std::string & name) {
+    for (size_t k = 0; k < _captures.size(); k++) {
+        if (_captures[k].name == name) {
+            return k;
+        }
+    }
+    if (_parent == nullptr) {
+        return -1;
+    }
+    int i = _parent->localIndex(name);
+    if (i != 0) {
+        _captures.push_back(Capture{ name, true, i });
+        return _captures.size() - 1;
     }
-    return false;
+    int k = _parent->captureIndex(name);
+    if (k >= 0) {
+        _captures.push_back(Capture{ name, false, k });
+        return _captures.size() - 1;
+    }
+    return -1;
+}
+
+void CodePlanter::markAssignedInClosure(int k) {
+    Capture & c = _captures[k];
+    if (c.fromLocal) {
+        _parent->local_info[c.index-1].assignedInClosure = true;
+    } else {
+        _parent->markAssignedInClosure(c.index);
+    }
+}
+
+//  The instruction is expressed in terms of its local-variable form.
+bool CodePlanter::tryAddCaptured(const std::string & varname, Instruction inst) {
+    int k = captureIndex(varname);
+    if (k < 0) {
+        return false;
+    }
+    switch (inst) {
+        case Instruction::PUSH_LOCAL:
+            _var_accesses.push_back(VarAccess{ _builder.size(), true, k, Instruction::PUSH_CAPTURED_BOXED });
+            addInstruction(Instruction::PUSH_CAPTURED);
+            addRawUInt(k);
+            break;
+        case Instruction::POP_LOCAL:
+            markAssignedInClosure(k);
+            addInstruction(Instruction::POP_CAPTURED_BOXED);
+            addRawUInt(k);
+            break;
+        case Instruction::CALL_LOCAL:
+            _var_accesses.push_back(VarAccess{ _builder.size(), true, k, Instruction::PUSH_CAPTURED_BOXED });
+            addInstruction(Instruction::PUSH_CAPTURED);
+            addRawUInt(k);
+            addInstruction(Instruction::APPLY);
+            break;
+        default:
+            throw Unreachable();
+    }
+    return true;
 }
 
 void CodePlanter::addLocalOrGlobal(const std::string & name, Instruction instLocal, Instruction instGlobal) {
-    if (!tryAddLocal(name, instLocal)) {
+    if (!tryAddLocal(name, instLocal) && !tryAddCaptured(name, instLocal)) {
         addGlobal(name, instGlobal);
     }
 }
 
+//  The instructions that inlined code may contain: straight-line code
+//  without calls, closures or boxes, so that its frame is just its locals.
+static bool isInlinable(Instruction inst) {
+    switch (inst) {
+        case Instruction::ADD:
+        case Instruction::CALL_NATIVE:
+        case Instruction::EQ:
+        case Instruction::GET_FIELD:
+        case Instruction::GT:
+        case Instruction::GTE:
+        case Instruction::LT:
+        case Instruction::LTE:
+        case Instruction::MUL:
+        case Instruction::NEQ:
+        case Instruction::NEW_RECORD:
+        case Instruction::POP_GLOBAL:
+        case Instruction::POP_LOCAL:
+        case Instruction::PUSH_GLOBAL:
+        case Instruction::PUSH_LOCAL:
+        case Instruction::PUSHQ:
+        case Instruction::PUSHS:
+        case Instruction::R_ADD:
+        case Instruction::R_LOADQ:
+        case Instruction::R_MOVE:
+        case Instruction::R_MUL:
+        case Instruction::R_SUB:
+        case Instruction::SET_FIELD:
+        case Instruction::SUB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//  Whether operand 0 is a local that the instruction writes.
+static bool writesLocal(Instruction inst) {
+    switch (inst) {
+        case Instruction::POP_LOCAL:
+        case Instruction::R_ADD:
+        case Instruction::R_LOADQ:
+        case Instruction::R_MOVE:
+        case Instruction::R_MUL:
+        case Instruction::R_SUB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//  Plants the body of the global procedure currently bound to name in
+//  place of a call, if it is no bigger than the engine's inline limit,
+//  is inlinable straight-line code ending in its only RETURN, and writes
+//  each local before reading it. Its locals are remapped onto anonymous
+//  locals of this procedure, which are shared by all the code inlined
+//  here, as none of it can be running at once.
+//
+//  The call is kept out of line, see plantInlineFallbacks, so that the
+//  inlined code can be deoptimised when the global is assigned.
+bool CodePlanter::tryInline(const std::string & name) {
+    size_t limit = _engine.inlineLimit();
+    Ident * ident = limit == 0 ? nullptr : _engine.getDictionary().lookup(name);
+    if (ident == nullptr || !ident->value().isProcedure()) {
+        return false;
+    }
+    Cell * callee = ident->value().deref();
+    const Cell * code = callee + ProcedureLayout::InstructionsOffset;
+    const Cell * code_end = callee + callee[ProcedureLayout::QBlockOffset].getSmall();
+    if (code_end - code > static_cast<std::ptrdiff_t>(limit) + 1) {
+        return false;
+    }
+    std::map<void *, Instruction> rev_map;
+    for (auto & [inst, addr] : _engine._opcode_map) {
+        rev_map[addr] = inst;
+    }
+
+    struct Step {
+        Instruction inst;
+        const Cell * args;
+    };
+    std::vector<Step> body;
+    uint64_t nlocals = callee[ProcedureLayout::NumLocalsOffset].u64;
+    std::vector<bool> written(nlocals);
+    bool returns = false;
+    for (const Cell * c = code; c < code_end && !returns; ) {
+        auto it = rev_map.find(c->ref);
+        if (it == rev_map.end()) {
+            return false;
+        }
+        Instruction inst = genericForm(it->second);
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(inst, nargs, bitmask);
+        if (inst == Instruction::RETURN) {
+            returns = c + 1 == code_end;
+            if (!returns) return false;
+            continue;
+        }
+        if (!isInlinable(inst)) {
+            return false;
+        }
+        for (int k = 0; k < nargs; k++) {
+            if (operandKind(inst, k) != OperandKind::Local) continue;
+            if (c[1 + k].u64 >= nlocals) {
+                return false;
+            }
+            if (!(k == 0 && writesLocal(inst)) && !written[c[1 + k].u64]) {
+                return false;
+            }
+        }
+        if (writesLocal(inst)) {
+            written[c[1].u64] = true;
+        }
+        body.push_back(Step{ inst, c + 1 });
+        c += 1 + nargs;
+    }
+    if (!returns || body.empty()) {
+        return false;
+    }
+
+    while (_inline_locals.size() < nlocals) {
+        _inline_locals.push_back(anonymousLocal());
+    }
+    size_t start = _builder.size();
+    for (auto & step : body) {
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(step.inst, nargs, bitmask);
+        addInstruction(step.inst);
+        for (int k = 0; k < nargs; k++) {
+            Cell c = step.args[k];
+            if (operandKind(step.inst, k) == OperandKind::Local) {
+                //  Slot n of the callee is its local nlocals - n.
+                addLocalOperand(_inline_locals[nlocals - c.u64 - 1]);
+            } else if (step.inst == Instruction::ADD || step.inst == Instruction::SUB || step.inst == Instruction::MUL) {
+                //  A new site starts without type feedback.
+                addRawUInt(0);
+            } else if (bitmask & (1u << k)) {
+                addDataQ(c);
+            } else {
+                addData(c);
+            }
+        }
+    }
+    _inline_sites.push_back(InlineSite{ name, callee, start, _builder.size() });
+    return true;
+}
+
+//  Each inlined call is followed, after the end of the code, by
+//
+//      INLINED global, callee, -> inlined code
+//      CALL_GLOBAL global
+//      GOTO -> end of the inlined code
+//
+//  The marker is never run. Its branch makes the inlined code a stretch of
+//  its own that starts with a CHECK_STACK, see optimise, which is where
+//  Engine::deoptimiseSite plants a GOTO to the call. The call is covered
+//  by the handlers that cover the inlined code.
+void CodePlanter::plantInlineFallbacks() {
+    const size_t nhandlers = _handlers.size();
+    for (auto & site : _inline_sites) {
+        for (auto it = _lines.rbegin(); it != _lines.rend(); ++it) {
+            if (it->position <= site.start) {
+                position(it->offset);
+                break;
+            }
+        }
+        size_t fallback = _builder.size();
+        addGlobal(site.name, Instruction::INLINED);
+        site.position = _builder.size() - 1;
+        addDataQ(Cell::makePtr(site.callee));
+        addData(Cell::makeI64(static_cast<int64_t>(site.start) - static_cast<int64_t>(_builder.size())));
+        addGlobal(site.name, Instruction::CALL_GLOBAL);
+        addRawUInt(0);
+        addInstruction(Instruction::GOTO);
+        addData(Cell::makeI64(static_cast<int64_t>(site.end) - static_cast<int64_t>(_builder.size())));
+        for (size_t h = 0; h < nhandlers; h++) {
+            if (_handlers[h].start <= site.start && site.start < _handlers[h].end) {
+                _handlers.push_back(Handler{ fallback, _builder.size(), _handlers[h].handler });
+            }
+        }
+    }
+}
+
+//  Record classes are resolved when the code is planted, so that field
+//  access at run-time is just a key check and a fixed offset.
+Cell * CodePlanter::recordClass(const std::string & classname) {
+    Ident * ident = _engine.getDictionary().lookup(classname);
+    if (ident == nullptr || !ident->value().isRecordClass()) {
+        throw CompileTimeError("Not a record class").culprit("Name", classname);
+    }
+    return ident->value().deref();
+}
+
+void CodePlanter::addField(const std::string & classname, const std::string & fieldname, Instruction inst) {
+    Cell * key = recordClass(classname);
+    int nfields = key[RecordKeyLayout::NumFieldsOffset].getSmall();
+    auto sym = _engine.getSymbolTable().find(fieldname);
+    for (int i = 0; sym && i < nfields; i++) {
+        if (key[RecordKeyLayout::FieldNamesOffset + i].getSymbolIndex() == static_cast<int>(*sym)) {
+            addInstruction(inst);
+            addDataQ(Cell::makeRecordKey(key));
+            addRawUInt(RecordLayout::FieldsOffset + i);
+            return;
+        }
+    }
+    throw CompileTimeError("Unknown field").culprit("Record class", classname).culprit("Field", fieldname);
+}
 
 void CodePlanter::local(const std::string & name) {
     for (int i = locals.size(); i > scope_level; i--) {
@@ -151,25 +483,795 @@ void CodePlanter::local(const std::string & name) {
         }
     }
     locals.push_back(name);
+    local_info.emplace_back();
+    if (locals.size() > max_level) {
+        max_level = locals.size();
+    }
+}
+
+//  Anonymous locals have an empty name, which cannot be an identifier.
+int CodePlanter::anonymousLocal() {
+    locals.push_back("");
+    local_info.emplace_back();
     if (locals.size() > max_level) {
         max_level = locals.size();
     }
+    return locals.size();
+}
+
+int CodePlanter::enterScope() {
+    int outer = scope_level;
+    scope_level = locals.size();
+    return outer;
+}
+
+//  Renaming to "" hides the locals but keeps their slots and their
+//  boxing information, which is needed when the procedure is finished.
+void CodePlanter::exitScope(int outer) {
+    for (size_t i = scope_level; i < locals.size(); i++) {
+        locals[i] = "";
+    }
+    scope_level = outer;
 }
 
 void CodePlanter::global(const std::string & name) {
     _engine.declareGlobal(name);
 }
 
-Cell * CodePlanter::build() {
-    // Add the Q-block
-    _qblock.setCell(Cell::makeSmall(_builder.size() - ProcedureLayout::KeyOffsetFromStart));
-    for (auto &q : _q_offsets) {
-        this->addRawUInt(q);
+//  Which operand of an instruction is a branch offset, -1 if none.
+static int branchOperand(Instruction inst) {
+    int nargs;
+    unsigned int bitmask;
+    instructionInfo(inst, nargs, bitmask);
+    for (int k = 0; k < nargs; k++) {
+        if (operandKind(inst, k) == OperandKind::Branch) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+//  The fused form of a comparison followed by IFSO, or by IFNOT if negated.
+//  The orderings can be negated because they mishap on anything but Smalls.
+static bool fusedBranch(Instruction compare, bool negated, Instruction & fused) {
+    switch (compare) {
+        case Instruction::EQ:
+            fused = negated ? Instruction::IF_NEQ : Instruction::IF_EQ;
+            return true;
+        case Instruction::NEQ:
+            fused = negated ? Instruction::IF_EQ : Instruction::IF_NEQ;
+            return true;
+        case Instruction::LT:
+            fused = negated ? Instruction::IF_GTE : Instruction::IF_LT;
+            return true;
+        case Instruction::LTE:
+            fused = negated ? Instruction::IF_GT : Instruction::IF_LTE;
+            return true;
+        case Instruction::GT:
+            fused = negated ? Instruction::IF_LTE : Instruction::IF_GT;
+            return true;
+        case Instruction::GTE:
+            fused = negated ? Instruction::IF_LT : Instruction::IF_GTE;
+            return true;
+        default:
+            return false;
     }
+}
 
+//  A switch and the CASEs of its table always branch.
+static bool isUnconditionalExit(Instruction inst) {
+    switch (inst) {
+        case Instruction::CASE:
+        case Instruction::GOTO:
+        case Instruction::HALT:
+        case Instruction::RETURN:
+        case Instruction::SWITCH:
+        case Instruction::SWITCH_SPARSE:
+        case Instruction::THROW:
+            return true;
+        default:
+            return false;
+    }
+}
 
-    _length.setCell( Cell::makeSmall( _builder.size() - ProcedureLayout::KeyOffsetFromStart) );
-    _num_locals.setCell( Cell::makeU64(max_level) );
+//  Folds arithmetic on two Smalls exactly as L_ADD, L_SUB and L_MUL do,
+//  returning false where they would mishap.
+static bool foldArithmetic(Instruction inst, Cell a, Cell b, Cell & result) {
+    if (!a.isSmall() || !b.isSmall()) {
+        return false;
+    }
+    int64_t r;
+    bool overflow;
+    switch (inst) {
+        case Instruction::ADD:
+            overflow = __builtin_add_overflow(a.i64, b.i64, &r);
+            break;
+        case Instruction::SUB:
+            overflow = __builtin_sub_overflow(a.i64, b.i64, &r);
+            break;
+        case Instruction::MUL:
+            overflow = __builtin_mul_overflow(a.i64 >> TAG_WIDTH, b.i64, &r);
+            break;
+        default:
+            return false;
+    }
+    if (overflow) {
+        return false;
+    }
+    result = Cell{ .i64 = r };
+    return true;
+}
+
+namespace {
+
+//  An instruction of the code being optimised. Its operands are in the
+//  code unless it has been rewritten.
+struct Op {
+    size_t position;
+    Instruction inst;
+    int nargs;
+    const Cell * args;
+    size_t target = 0;      // Index of the op branched to, if any.
+    bool live = false;
+    bool isTarget = false;
+};
+
+//  A value that stack code would have pushed by now.
+struct Pending {
+    enum Kind { Slot, Constant, Temp } kind;
+    Cell value;             // The local operand, the constant or the depth.
+};
+
+} // namespace
+
+//  The number of CASEs in the table of a switch, which follow the first,
+//  its branch target, or zero for any other instruction.
+static size_t tableSize(const Op & op) {
+    if (op.inst == Instruction::SWITCH || op.inst == Instruction::SWITCH_SPARSE) {
+        return op.args[0].u64 + 1;
+    }
+    return 0;
+}
+
+//  Constants that R_LOADQ may load. Pointers are left to PUSHQ, as its
+//  operand may still be a placeholder.
+static bool isRegisterConstant(Cell c) {
+    return c.isSmall() || c.getTag() == Tag::Special;
+}
+
+//  The temporary for stack depth p. Temporaries go above the locals, so
+//  they are numbered down from the top of the frame, at -1 - p, until
+//  every local operand is moved up by the number of temporaries.
+static Cell tempSlot(size_t p) {
+    return Cell{ .i64 = -1 - static_cast<int64_t>(p) };
+}
+
+static Instruction registerForm(Instruction inst) {
+    switch (inst) {
+        case Instruction::ADD: return Instruction::R_ADD;
+        case Instruction::SUB: return Instruction::R_SUB;
+        case Instruction::MUL: return Instruction::R_MUL;
+        default: throw Unreachable();
+    }
+}
+
+//  Rewrites each straight-line run of PUSH_LOCAL, PUSHQ and ADD|SUB|MUL
+//  into register instructions, where that takes fewer dispatches. The run
+//  is evaluated on a stack of pending values, so that only the arithmetic
+//  is planted, into the temporary for its depth. A POP_LOCAL of the only
+//  pending value becomes the destination of the last instruction, and
+//  anything else still pending is pushed at the end of the run. Moving the
+//  pushes is safe because nothing in a run writes a local.
+//
+//  The new instructions reuse the ops of the run, so branch targets are
+//  unaffected, and keep their operands in operands. Returns the number of
+//  temporaries needed.
+static size_t registerise(std::vector<Op> & ops, std::deque<std::array<Cell, 3>> & operands) {
+    struct Planted {
+        Instruction inst;
+        std::array<Cell, 3> args;
+    };
+    std::vector<Pending> pending;
+    std::vector<Planted> planted;
+    size_t ntemps = 0;
+    for (size_t i = 0; i < ops.size(); ) {
+        pending.clear();
+        planted.clear();
+        size_t depth = 0;
+        //  A constant operand is loaded into the temporary for its depth.
+        auto operand = [&](const Pending & v, size_t p) {
+            if (v.kind == Pending::Constant) {
+                planted.push_back(Planted{ Instruction::R_LOADQ, { tempSlot(p), v.value } });
+            }
+            return v.kind == Pending::Slot ? v.value : tempSlot(p);
+        };
+        size_t j = i;
+        for (; j < ops.size(); j++) {
+            Op & op = ops[j];
+            if (!op.live || (j > i && op.isTarget)) break;
+            if (op.inst == Instruction::PUSH_LOCAL) {
+                pending.push_back(Pending{ Pending::Slot, op.args[0] });
+            } else if (op.inst == Instruction::PUSHQ && isRegisterConstant(op.args[0])) {
+                pending.push_back(Pending{ Pending::Constant, op.args[0] });
+            } else if ((op.inst == Instruction::ADD || op.inst == Instruction::SUB || op.inst == Instruction::MUL) && pending.size() >= 2) {
+                size_t p = pending.size() - 2;
+                Pending b = pending.back();
+                pending.pop_back();
+                Pending a = pending.back();
+                pending.pop_back();
+                Cell result;
+                if (a.kind == Pending::Constant && b.kind == Pending::Constant && foldArithmetic(op.inst, a.value, b.value, result)) {
+                    pending.push_back(Pending{ Pending::Constant, result });
+                    continue;
+                }
+                Cell x = operand(a, p);
+                Cell y = operand(b, p + 1);
+                planted.push_back(Planted{ registerForm(op.inst), { tempSlot(p), x, y } });
+                pending.push_back(Pending{ Pending::Temp, Cell{ .u64 = p } });
+                depth = std::max(depth, b.kind == Pending::Slot ? p + 1 : p + 2);
+            } else {
+                break;
+            }
+        }
+        size_t consumed = j - i;
+        if (pending.size() == 1 && j < ops.size() && ops[j].live && !ops[j].isTarget && ops[j].inst == Instruction::POP_LOCAL) {
+            Cell local = ops[j].args[0];
+            Pending & v = pending.back();
+            if (v.kind == Pending::Temp) {
+                planted.back().args[0] = local;
+            } else if (v.kind == Pending::Slot) {
+                planted.push_back(Planted{ Instruction::R_MOVE, { local, v.value } });
+            } else {
+                planted.push_back(Planted{ Instruction::R_LOADQ, { local, v.value } });
+            }
+            pending.clear();
+            consumed += 1;
+        }
+        for (size_t p = 0; p < pending.size(); p++) {
+            const Pending & v = pending[p];
+            if (v.kind == Pending::Constant) {
+                planted.push_back(Planted{ Instruction::PUSHQ, { v.value } });
+            } else {
+                planted.push_back(Planted{ Instruction::PUSH_LOCAL, { v.kind == Pending::Slot ? v.value : tempSlot(p) } });
+            }
+        }
+        if (planted.size() < consumed) {
+            for (size_t k = 0; k < consumed; k++) {
+                Op & op = ops[i + k];
+                if (k < planted.size()) {
+                    unsigned int bitmask;
+                    op.inst = planted[k].inst;
+                    instructionInfo(op.inst, op.nargs, bitmask);
+                    operands.push_back(planted[k].args);
+                    op.args = operands.back().data();
+                } else {
+                    op.live = false;
+                }
+            }
+            ntemps = std::max(ntemps, depth);
+        }
+        i += std::max<size_t>(consumed, 1);
+    }
+    return ntemps;
+}
+
+static bool isCall(Instruction inst) {
+    switch (inst) {
+        case Instruction::APPLY:
+        case Instruction::CALL_GLOBAL:
+        case Instruction::CALL_LOCAL:
+        case Instruction::CALL_LOCAL_BOXED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//  How many values an instruction pops from the value stack and then
+//  pushes. A call only counts the procedure that APPLY pops, as the
+//  callee checks its own needs.
+static void stackEffect(const Op & op, int64_t & pops, int64_t & pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (op.inst) {
+        case Instruction::PUSH_CAPTURED:
+        case Instruction::PUSH_CAPTURED_BOXED:
+        case Instruction::PUSH_GLOBAL:
+        case Instruction::PUSH_LOCAL:
+        case Instruction::PUSH_LOCAL_BOX:
+        case Instruction::PUSH_LOCAL_BOXED:
+        case Instruction::PUSHQ:
+        case Instruction::CATCH:
+            pushes = 1;
+            break;
+        case Instruction::APPLY:
+        case Instruction::IFNOT:
+        case Instruction::IFSO:
+        case Instruction::SWITCH:
+        case Instruction::SWITCH_SPARSE:
+        case Instruction::THROW:
+        case Instruction::POP_CAPTURED_BOXED:
+        case Instruction::POP_GLOBAL:
+        case Instruction::POP_LOCAL:
+        case Instruction::POP_LOCAL_BOXED:
+        case Instruction::INIT_LOCAL_BOXED:
+            pops = 1;
+            break;
+        case Instruction::PUSHS:
+            pops = 1;
+            pushes = 2;
+            break;
+        case Instruction::GET_FIELD:
+            pops = 1;
+            pushes = 1;
+            break;
+        case Instruction::ADD:
+        case Instruction::SUB:
+        case Instruction::MUL:
+        case Instruction::EQ:
+        case Instruction::GT:
+        case Instruction::GTE:
+        case Instruction::LT:
+        case Instruction::LTE:
+        case Instruction::NEQ:
+            pops = 2;
+            pushes = 1;
+            break;
+        case Instruction::IF_EQ:
+        case Instruction::IF_GT:
+        case Instruction::IF_GTE:
+        case Instruction::IF_LT:
+        case Instruction::IF_LTE:
+        case Instruction::IF_NEQ:
+        case Instruction::SET_FIELD:
+            pops = 2;
+            break;
+        case Instruction::FOR_RANGE_INIT:
+            pops = 3;
+            break;
+        case Instruction::MAKE_CLOSURE:
+            pops = 1 + static_cast<int64_t>(op.args[0].u64);
+            pushes = 1;
+            break;
+        case Instruction::NEW_RECORD:
+            pops = op.args[0].deref()[RecordKeyLayout::NumFieldsOffset].getSmall();
+            pushes = 1;
+            break;
+        case Instruction::CALL_NATIVE:
+            pops = static_cast<const NativeFunction *>(op.args[0].ref)->arity;
+            pushes = 1;
+            break;
+        default:
+            //  Branches, calls and the register tier leave the stack alone.
+            break;
+    }
+}
+
+//  Works out the stack word for each stretch of the live code, so that
+//  the engine need not check its pushes and pops. A stretch starts at the
+//  entry, after a call or at a check, and ends at a call, a return or the
+//  next check; the engine checks its word as it is entered. Within a
+//  stretch the depth of the stack must be the same however an instruction
+//  is reached. Where it is not, as at the top of a loop that leaves a value
+//  each time round, the instruction becomes a check, to be preceded by a
+//  CHECK_STACK, and the analysis starts again.
+//
+//  Fills in the word of each instruction that starts a stretch.
+static void verifyStack(const std::vector<Op> & ops, const std::vector<size_t> & next_live, std::vector<bool> & check, std::vector<Cell> & word) {
+    const size_t end = ops.size();
+    const int64_t unseen = INT64_MIN;
+    std::vector<int64_t> depth_at(ops.size(), unseen);
+    std::vector<size_t> touched;
+    std::vector<std::pair<size_t, int64_t>> work;
+
+    //  Returns false if it found a new check.
+    auto stretch = [&](size_t origin) {
+        for (size_t i : touched) {
+            depth_at[i] = unseen;
+        }
+        touched.clear();
+        work.clear();
+        work.emplace_back(origin, 0);
+        int64_t need = 0;
+        int64_t growth = 0;
+        while (!work.empty()) {
+            auto [i, d] = work.back();
+            work.pop_back();
+            if (i == end || (i != origin && check[i])) continue;
+            if (depth_at[i] != unseen) {
+                if (depth_at[i] == d || check[i]) continue;
+                check[i] = true;
+                return false;
+            }
+            depth_at[i] = d;
+            touched.push_back(i);
+            const Op & op = ops[i];
+            int64_t pops, pushes;
+            stackEffect(op, pops, pushes);
+            need = std::max(need, pops - d);
+            d += pushes - pops;
+            growth = std::max(growth, d);
+            if (isCall(op.inst)) continue;
+            if (branchOperand(op.inst) >= 0) {
+                work.emplace_back(op.target, d);
+            }
+            for (size_t k = 1; k < tableSize(op); k++) {
+                work.emplace_back(op.target + k, d);
+            }
+            if (!isUnconditionalExit(op.inst)) {
+                work.emplace_back(next_live[i], d);
+            }
+        }
+        if (need >= static_cast<int64_t>(StackNeeds::Limit) || growth >= static_cast<int64_t>(StackNeeds::Limit)) {
+            throw CompileTimeError("Procedure needs too deep a stack").culprit("Values", std::max(need, growth));
+        }
+        word[origin] = StackNeeds::make(need, growth);
+        return true;
+    };
+
+    if (ops.empty()) return;
+    for (bool done = false; !done; ) {
+        done = stretch(0);
+        for (size_t i = 0; done && i < ops.size(); i++) {
+            if (!ops[i].live) continue;
+            if (check[i]) {
+                done = stretch(i);
+            }
+            if (done && isCall(ops[i].inst) && next_live[i] != end) {
+                done = stretch(next_live[i]);
+            }
+        }
+    }
+}
+
+//  A peephole pass over the finished code, which is rebuilt without:
+//
+//  -   instructions that cannot be reached,
+//  -   jumps to jumps, which are threaded to their final destination,
+//  -   GOTOs to the next instruction; a GOTO to a RETURN or HALT
+//      becomes that instruction,
+//  -   PUSHQ a, PUSHQ b, ADD|SUB|MUL on Smalls, which becomes PUSHQ of
+//      the result unless it would overflow, so the run-time trap is kept,
+//  -   PUSHQ k, IFNOT|IFSO, which becomes a GOTO or nothing,
+//  -   a comparison and IFNOT|IFSO, which become one IF_ instruction.
+//
+//  For the register tier, arithmetic on locals is then rewritten to
+//  register instructions, see registerise. Finally the stack needs of the
+//  code are verified, see verifyStack, and recorded in the header, in the
+//  calls and in any CHECK_STACK instructions that are needed.
+//
+//  Branch offsets, the Q-block offsets and the handlers are recomputed
+//  for the new layout. Local variable operands are position independent,
+//  apart from moving up to make room for any temporaries.
+void CodePlanter::optimise() {
+    std::vector<Cell> & code = _builder._codelist;
+    std::map<void *, Instruction> rev_map;
+    for (auto & [inst, addr] : _engine._opcode_map) {
+        rev_map[addr] = inst;
+    }
+
+    std::vector<Op> ops;
+    std::vector<size_t> op_at(code.size() + 1, SIZE_MAX);
+    for (size_t n = ProcedureLayout::HeaderSize; n < code.size(); ) {
+        auto it = rev_map.find(code[n].ref);
+        if (it == rev_map.end()) {
+            throw Unreachable();
+        }
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(it->second, nargs, bitmask);
+        op_at[n] = ops.size();
+        ops.push_back(Op{ n, it->second, nargs, code.data() + n + 1 });
+        n += 1 + nargs;
+    }
+    //  Branching to the end of the code is allowed, as a sentinel op.
+    const size_t end = ops.size();
+    op_at[code.size()] = end;
+
+    for (auto & op : ops) {
+        int k = branchOperand(op.inst);
+        if (k >= 0) {
+            size_t operand = op.position + 1 + k;
+            int64_t there = static_cast<int64_t>(operand) + code[operand].i64;
+            if (there < ProcedureLayout::HeaderSize || there > static_cast<int64_t>(code.size()) || op_at[there] == SIZE_MAX) {
+                throw CompileTimeError("Branch into the middle of an instruction").culprit("Offset", static_cast<int64_t>(operand));
+            }
+            op.target = op_at[there];
+        }
+    }
+
+    //  The handlers in terms of ops.
+    std::vector<Handler> handlers;
+    for (auto & h : _handlers) {
+        handlers.push_back(Handler{ op_at[h.start], op_at[h.end], op_at[h.handler] });
+        if (handlers.back().start == SIZE_MAX || handlers.back().end == SIZE_MAX || handlers.back().handler == SIZE_MAX) {
+            throw Unreachable();
+        }
+    }
+
+    //  A conditional branch on a constant, that cannot be entered between
+    //  the PUSHQ and the test, is decided now. The PUSHQ, and the branch if
+    //  it is not taken, become GOTOs to the next instruction, which are
+    //  dropped below.
+    std::vector<bool> branched_to(ops.size() + 1);
+    for (auto & op : ops) {
+        if (branchOperand(op.inst) >= 0) {
+            branched_to[op.target] = true;
+        }
+    }
+    for (size_t i = 1; i < ops.size(); i++) {
+        Op & test = ops[i];
+        Op & push = ops[i - 1];
+        if ((test.inst != Instruction::IFNOT && test.inst != Instruction::IFSO) || push.inst != Instruction::PUSHQ || branched_to[i]) {
+            continue;
+        }
+        bool is_false = code[push.position + 1].isFalse();
+        bool taken = test.inst == Instruction::IFNOT ? is_false : !is_false;
+        push.inst = Instruction::GOTO;
+        push.target = i;
+        test.inst = Instruction::GOTO;
+        if (!taken) {
+            test.target = i + 1;
+        }
+    }
+
+    //  Likewise a comparison feeding a conditional branch is fused with it,
+    //  and the branch becomes a GOTO to the next instruction.
+    for (size_t i = 1; i < ops.size(); i++) {
+        Op & test = ops[i];
+        Op & compare = ops[i - 1];
+        Instruction fused;
+        if ((test.inst != Instruction::IFNOT && test.inst != Instruction::IFSO) || branched_to[i] || !fusedBranch(compare.inst, test.inst == Instruction::IFNOT, fused)) {
+            continue;
+        }
+        compare.inst = fused;
+        compare.nargs = test.nargs;
+        compare.args = test.args;
+        compare.target = test.target;
+        test.inst = Instruction::GOTO;
+        test.target = i + 1;
+    }
+
+    //  Thread jumps. The step count stops us chasing a loop of GOTOs.
+    for (auto & op : ops) {
+        if (branchOperand(op.inst) < 0) continue;
+        for (size_t steps = 0; steps < ops.size() && op.target != end && ops[op.target].inst == Instruction::GOTO; steps++) {
+            op.target = ops[op.target].target;
+        }
+        if (op.inst == Instruction::GOTO && op.target != end) {
+            Instruction there = ops[op.target].inst;
+            if (there == Instruction::RETURN || there == Instruction::HALT) {
+                op.inst = there;
+                op.nargs = 0;
+            }
+        }
+    }
+
+    //  Reachability from the first instruction. Only live branches make
+    //  their targets into join points. A live switch makes its whole table
+    //  live. The out-of-line call for some
+    //  inlined code is live if the inlined code is, and a handler is live
+    //  if any of the code it covers is.
+    std::vector<size_t> work;
+    if (!ops.empty()) {
+        work.push_back(0);
+    }
+    while (!work.empty()) {
+        while (!work.empty()) {
+            size_t i = work.back();
+            work.pop_back();
+            if (i == end || ops[i].live) continue;
+            ops[i].live = true;
+            if (branchOperand(ops[i].inst) >= 0) {
+                if (ops[i].target != end) {
+                    ops[ops[i].target].isTarget = true;
+                }
+                work.push_back(ops[i].target);
+            }
+            for (size_t k = 1; k < tableSize(ops[i]); k++) {
+                work.push_back(ops[i].target + k);
+            }
+            if (!isUnconditionalExit(ops[i].inst)) {
+                work.push_back(i + 1);
+            }
+        }
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (ops[i].inst == Instruction::INLINED && !ops[i].live && ops[i].target != end && ops[ops[i].target].live) {
+                work.push_back(i);
+            }
+        }
+        for (auto & h : handlers) {
+            for (size_t i = h.start; i < h.end && !ops[h.handler].live; i++) {
+                if (ops[i].live) {
+                    work.push_back(h.handler);
+                    break;
+                }
+            }
+        }
+    }
+    //  Nothing is folded or registerised across the ends of the code that
+    //  a handler covers, so that the code stays between them.
+    for (auto & h : handlers) {
+        for (size_t i : { h.start, h.end, h.handler }) {
+            if (i != end) {
+                ops[i].isTarget = true;
+            }
+        }
+    }
+    std::deque<std::array<Cell, 3>> operands;
+    size_t ntemps = _tier == CodeTier::Register ? registerise(ops, operands) : 0;
+
+    std::vector<size_t> next_live(ops.size() + 1, end);
+    for (size_t i = ops.size(); i > 0; i--) {
+        next_live[i - 1] = i < ops.size() && ops[i].live ? i : next_live[i];
+    }
+
+    std::vector<bool> check(ops.size());
+    for (auto & op : ops) {
+        if (op.live && op.inst == Instruction::INLINED) {
+            check[op.target] = true;
+        }
+    }
+    //  A handler is entered with whatever the stack held when the value
+    //  was thrown, so the check follows its CATCH, which sets the depth.
+    for (auto & h : handlers) {
+        if (ops[h.handler].live && next_live[h.handler] != end) {
+            check[next_live[h.handler]] = true;
+        }
+    }
+    std::vector<Cell> word(ops.size(), StackNeeds::make(0, 0));
+    verifyStack(ops, next_live, check, word);
+
+    std::vector<Cell> out(code.begin(), code.begin() + ProcedureLayout::HeaderSize);
+    if (!ops.empty()) {
+        out[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::StackOffset] = word[0];
+    }
+    std::vector<size_t> entry(ops.size() + 1);          // Where branches to the op land.
+    std::vector<size_t> new_position(ops.size() + 1);
+    std::vector<size_t> emitted;            // Indexes of the ops kept, in order.
+    std::vector<std::pair<size_t, size_t>> branches;    // Operand, target op.
+    for (size_t i = 0; i < ops.size(); i++) {
+        Op & op = ops[i];
+        entry[i] = out.size();
+        if (op.live && check[i]) {
+            out.push_back(Cell{ .ref = _engine._opcode_map.at(Instruction::CHECK_STACK) });
+            out.push_back(word[i]);
+        }
+        new_position[i] = out.size();
+        if (!op.live) continue;
+        if (op.inst == Instruction::GOTO && op.target == next_live[i]) {
+            //  Whatever jumped here now lands on the next instruction.
+            if (op.isTarget && op.target != end) {
+                ops[op.target].isTarget = true;
+            }
+            continue;
+        }
+        size_t m = emitted.size();
+        if (!op.isTarget && !check[i] && m >= 2) {
+            Op & x = ops[emitted[m - 2]];
+            Op & y = ops[emitted[m - 1]];
+            Cell result;
+            if (
+                x.inst == Instruction::PUSHQ && y.inst == Instruction::PUSHQ && !y.isTarget &&
+                foldArithmetic(op.inst, out[new_position[emitted[m - 2]] + 1], out[new_position[emitted[m - 1]] + 1], result)
+            ) {
+                out.resize(new_position[emitted[m - 1]]);
+                out[new_position[emitted[m - 2]] + 1] = result;
+                emitted.pop_back();
+                continue;
+            }
+        }
+        emitted.push_back(i);
+        out.push_back(Cell{ .ref = _engine._opcode_map.at(op.inst) });
+        for (int k = 0; k < op.nargs; k++) {
+            Cell c = op.args[k];
+            if (operandKind(op.inst, k) == OperandKind::Local) {
+                c.u64 += ntemps;
+            }
+            out.push_back(c);
+        }
+        if (isCall(op.inst)) {
+            out.back() = next_live[i] != end ? word[next_live[i]] : StackNeeds::make(0, 0);
+        }
+        int k = branchOperand(op.inst);
+        if (k >= 0) {
+            branches.emplace_back(new_position[i] + 1 + k, op.target);
+        }
+    }
+    new_position[end] = out.size();
+    entry[end] = out.size();
+
+    //  The deferred operands are all operand 0 of their instruction.
+    std::vector<bool> kept(ops.size());
+    for (size_t i : emitted) {
+        kept[i] = true;
+    }
+    auto relocate = [&](size_t & position) {
+        size_t i = op_at[position - 1];
+        position = i != SIZE_MAX && kept[i] ? new_position[i] + 1 : SIZE_MAX;
+    };
+    for (auto & site : _closure_sites) {
+        relocate(site.position);
+    }
+    for (auto & g : _global_refs) {
+        relocate(g.position);
+    }
+    for (auto & site : _inline_sites) {
+        relocate(site.position);
+    }
+
+    for (auto & [operand, target] : branches) {
+        out[operand] = Cell::makeI64(static_cast<int64_t>(entry[target]) - static_cast<int64_t>(operand));
+    }
+
+    _handlers.clear();
+    for (auto & h : handlers) {
+        if (ops[h.handler].live) {
+            _handlers.push_back(Handler{
+                entry[h.start] - ProcedureLayout::KeyOffsetFromStart,
+                entry[h.end] - ProcedureLayout::KeyOffsetFromStart,
+                entry[h.handler] - ProcedureLayout::KeyOffsetFromStart
+            });
+        }
+    }
+
+    //  The Q-block lists the operands that the collector must scan.
+    _q_offsets.clear();
+    for (size_t i : emitted) {
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(ops[i].inst, nargs, bitmask);
+        for (int k = 0; k < nargs; k++) {
+            if (bitmask & (1u << k)) {
+                _q_offsets.push_back(new_position[i] + 1 + k - ProcedureLayout::KeyOffsetFromStart);
+            }
+        }
+    }
+    //  Folding can leave a mark beyond the code that replaced the folded
+    //  ops, so the marks are kept in order from the back.
+    size_t limit = out.size() - ProcedureLayout::KeyOffsetFromStart;
+    for (auto it = _lines.rbegin(); it != _lines.rend(); ++it) {
+        size_t i = op_at[it->position];
+        if (i == SIZE_MAX) {
+            throw Unreachable();
+        }
+        limit = std::min(limit, entry[i] - ProcedureLayout::KeyOffsetFromStart);
+        it->position = limit;
+    }
+    while (!_lines.empty() && _lines.back().position + ProcedureLayout::KeyOffsetFromStart == out.size()) {
+        _lines.pop_back();
+    }
+
+    code.swap(out);
+    //  The temporaries are the topmost locals.
+    max_level += ntemps;
+}
+
+void CodePlanter::seal() {
+    if (_sealed) {
+        return;
+    }
+    _sealed = true;
+
+    //  The boxing of our captures was decided by our parent.
+    if (_parent != nullptr) {
+        for (auto & c : _captures) {
+            c.boxed = c.fromLocal ? _parent->local_info[c.index-1].isBoxed() : _parent->_captures[c.index].boxed;
+        }
+    }
+
+    //  Rewrite the accesses to boxed variables.
+    for (auto & a : _var_accesses) {
+        bool boxed = a.captured ? _captures[a.index].boxed : local_info[a.index-1].isBoxed();
+        if (boxed) {
+            _builder._codelist[a.position] = Cell{ .ref = _engine._opcode_map.at(a.boxed) };
+        }
+    }
+
+    //  Now the lambdas can be sealed, top-down.
+    for (auto & site : _closure_sites) {
+        site.lambda->seal();
+    }
 
     // Fix up the local variable offsets.
     for (auto & p : local_fixups) {
@@ -177,43 +1279,126 @@ Cell * CodePlanter::build() {
         uint64_t new_n = max_level - n;
         p.setCell( Cell{ .u64 = new_n } );
     }
+
+    plantInlineFallbacks();
+
+    //  The code is complete, so the placeholders into it are all spent and
+    //  it can be rearranged.
+    optimise();
+
+    // Add the Q-block, the line table and the handler table, see
+    // LineTableLayout and HandlerLayout.
+    _qblock.setCell(Cell::makeSmall(_builder.size() - ProcedureLayout::KeyOffsetFromStart));
+    for (auto &q : _q_offsets) {
+        this->addRawUInt(q);
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> lines;
+    for (auto & mark : _lines) {
+        lines.emplace_back(mark.position, mark.offset);
+    }
+    std::vector<uint64_t> cells;
+    size_t nbytes = encodeLineTable(lines, cells);
+    for (uint64_t c : cells) {
+        addRawUInt(c);
+    }
+    addRawUInt(_source);
+    addRawUInt(nbytes);
+    for (auto & h : _handlers) {
+        addRawUInt(h.start);
+        addRawUInt(h.end);
+        addRawUInt(h.handler);
+    }
+    addRawUInt(_handlers.size());
+
+    _length.setCell( Cell::makeSmall( _builder.size() - ProcedureLayout::KeyOffsetFromStart) );
+    _num_locals.setCell( Cell::makeU64(max_level) );
+}
+
+Cell * CodePlanter::commit() {
+    if (_built != nullptr) {
+        return _built;
+    }
+    seal();
+
+    std::vector<Cell> & code = _builder._codelist;
+    for (auto & site : _closure_sites) {
+        if (site.position != SIZE_MAX) {
+            code[site.position] = Cell::makePtr(site.lambda->commit());
+        }
+    }
+    auto & dict = _engine.getDictionary();
+    for (auto & g : _global_refs) {
+        if (g.position == SIZE_MAX) continue;
+        Ident * ident = dict.lookup(g.name);
+        if (ident == nullptr) {
+            std::cerr << "Global not declared: " << g.name << std::endl;
+            bool redeclared;
+            ident = dict.declare(g.name, redeclared);
+        }
+        code[g.position] = Cell::makeRefIdent(ident);
+    }
+    if (_parent != nullptr) {
+        _proc_name.setCell( Cell::makeSymbol(_engine.symbolIndex("lambda")) );
+    }
+
     Cell * p = _builder.object();
+    for (auto & site : _inline_sites) {
+        if (site.position != SIZE_MAX) {
+            _engine.registerInlineSite(p - ProcedureLayout::KeyOffsetFromStart + site.position - 1);
+        }
+    }
 
     //  Protect from garbage collection for the duration of this code planter.
     _xroots.emplace_back(&_engine._xrootsRegistry, Cell::makePtr(p));
 
+    _built = p;
     return p;
 }
 
-void CodePlanter::buildAndBind(const std::string & name) {
-    // Add the Q-block
-    std::cout << "Q-block offset: " << _builder.size()  - ProcedureLayout::KeyOffsetFromStart << std::endl;
-    std::cout << "Q-block size:   " << _q_offsets.size() << std::endl;
-    _qblock.setCell(Cell::makeSmall(_builder.size() - ProcedureLayout::KeyOffsetFromStart));
-    for (auto &q : _q_offsets) {
-        this->addRawUInt(q);
-    }
+Cell * CodePlanter::build() {
+    return commit();
+}
 
+void CodePlanter::buildAndBind(const std::string & name) {
     auto symN = _engine.symbolIndex(name);
     _proc_name.setCell( Cell::makeSymbol(symN) );
-    _length.setCell( Cell::makeSmall( _builder.size() - ProcedureLayout::KeyOffsetFromStart ) );
-    _num_locals.setCell( Cell::makeU64(max_level) );
 
-    // Fix up the local variable offsets.
-    for (auto & p : local_fixups) {
-        uint64_t n = p.getCell().u64;
-        uint64_t new_n = max_level - n;
-        p.setCell( Cell{ .u64 = new_n } );
+    Ident * ident = _engine.getDictionary().lookup(name);
+    if (ident == nullptr) {
+        throw Mishap("Binding undeclared global").culprit("Name", name);
     }
-
-    Cell * c = _builder.object();
-    _engine.getDictionary()[name]->value() = Cell::makePtr(c);
+    Cell * c = commit();
+    _engine.assign(ident, Cell::makePtr(c));
 }
 
 Label CodePlanter::newLabel() {
     return Label(_builder);
 }
 
+ForRange CodePlanter::newForRange(const std::string & var) {
+    int v = localIndex(var);
+    if (v == 0) {
+        throw CompileTimeError("Loop variable must be a local").culprit("Variable", var);
+    }
+    int counter = anonymousLocal();
+    anonymousLocal();       // limit
+    anonymousLocal();       // step
+    return ForRange(_builder, v, counter);
+}
+
+TryBlock CodePlanter::newTryBlock() {
+    return TryBlock(_builder, anonymousLocal());
+}
+
+SwitchBlock CodePlanter::newSwitchBlock() {
+    return SwitchBlock(_builder);
+}
+
+CodePlanter & CodePlanter::lambda() {
+    _lambdas.emplace_back(new CodePlanter(_engine, this));
+    return *_lambdas.back();
+}
+
 void CodePlanter::LABEL( Label & label ) {
     label.setLabel();
 }
@@ -233,16 +1418,158 @@ void CodePlanter::IFSO( Label & label ) {
     label.plantLabel();
 }
 
+//  The loop variable is written directly by the loop instructions. If it
+//  is boxed, because a closure captures it, each iteration gets a fresh
+//  box when it is next accessed.
+void CodePlanter::FOR_RANGE_INIT( ForRange & loop ) {
+    addInstruction(Instruction::FOR_RANGE_INIT);
+    addLocalOperand(loop._var);
+    addLocalOperand(loop._counter);
+    loop._exit.plantLabel();
+    loop._body.setLabel();
+}
+
+void CodePlanter::FOR_RANGE_NEXT( ForRange & loop ) {
+    addInstruction(Instruction::FOR_RANGE_NEXT);
+    addLocalOperand(loop._var);
+    addLocalOperand(loop._counter);
+    loop._body.plantLabel();
+    loop._exit.setLabel();
+}
+
+void CodePlanter::TRY( TryBlock & block ) {
+    addInstruction(Instruction::TRY);
+    addLocalOperand(block._depth);
+    block._start = _builder.size();
+}
+
+//  Handlers are recorded as their CATCHes are planted, which puts inner
+//  handlers before the handlers that enclose them.
+void CodePlanter::CATCH( TryBlock & block ) {
+    size_t end = _builder.size();
+    GOTO(block._done);
+    _handlers.push_back(Handler{ block._start, end, _builder.size() });
+    addInstruction(Instruction::CATCH);
+    addLocalOperand(block._depth);
+}
+
+void CodePlanter::ENDTRY( TryBlock & block ) {
+    block._done.setLabel();
+}
+
+void CodePlanter::THROW() {
+    addInstruction(Instruction::THROW);
+}
+
+//  The kind of switch and the size of its table are filled in by
+//  ENDSWITCH.
+void CodePlanter::SWITCH( SwitchBlock & block ) {
+    block._position = _builder.size();
+    addInstruction(Instruction::SWITCH_SPARSE);
+    addRawUInt(0);
+    block._table.plantLabel();
+}
+
+void CodePlanter::startCase( SwitchBlock & block ) {
+    if (!block._cases.empty()) {
+        GOTO(block._done);
+    }
+    block._cases.emplace_back(_builder);
+    block._cases.back().setLabel();
+}
+
+void CodePlanter::CASE( SwitchBlock & block, const std::vector<Cell> & keys ) {
+    for (Cell key : keys) {
+        bool symbol = key.getTag() == Tag::Special && key.getUpperTag() == UpperTag::Symbol;
+        if (!key.isSmall() && !key.IsBoolean() && !symbol) {
+            throw CompileTimeError("Case key must be an integer, a Boolean or a Symbol").culprit("Key", key.u64);
+        }
+        block._keys.emplace_back(key, block._cases.size());
+    }
+    startCase(block);
+}
+
+void CodePlanter::DEFAULT( SwitchBlock & block ) {
+    if (block._default) {
+        throw CompileTimeError("Switch has more than one default");
+    }
+    block._default = block._cases.size();
+    startCase(block);
+}
+
+void CodePlanter::plantCase( Cell key, Label & label ) {
+    addInstruction(Instruction::CASE);
+    addData(key);
+    label.plantLabel();
+}
+
+//  A dense table has a CASE for every Small from the least key to the
+//  greatest, the gaps going to the default. A sparse table is in the
+//  order of the key cells, which is what L_SWITCH_SPARSE searches by.
+void CodePlanter::ENDSWITCH( SwitchBlock & block ) {
+    if (!block._cases.empty()) {
+        GOTO(block._done);
+    }
+    auto & keys = block._keys;
+    std::sort(keys.begin(), keys.end(), [](auto & x, auto & y) { return x.first.u64 < y.first.u64; });
+    bool smalls = true;
+    int64_t least = INT64_MAX;
+    int64_t greatest = INT64_MIN;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Cell key = keys[i].first;
+        if (i > 0 && keys[i - 1].first.u64 == key.u64) {
+            throw CompileTimeError("Duplicate case key").culprit("Key", key.u64);
+        }
+        smalls = smalls && key.isSmall();
+        least = std::min(least, key.i64);
+        greatest = std::max(greatest, key.i64);
+    }
+    uint64_t span = keys.empty() ? 0 : ((static_cast<uint64_t>(greatest) - static_cast<uint64_t>(least)) >> TAG_WIDTH) + 1;
+    bool dense = !keys.empty() && smalls && span <= 2 * keys.size();
+
+    Label & otherwise = block._default ? block._cases[*block._default] : block._done;
+    block._table.setLabel();
+    if (dense) {
+        std::vector<Label *> slots(span, &otherwise);
+        for (auto & [key, n] : keys) {
+            slots[(static_cast<uint64_t>(key.i64) - static_cast<uint64_t>(least)) >> TAG_WIDTH] = &block._cases[n];
+        }
+        for (uint64_t i = 0; i < span; i++) {
+            plantCase(Cell{ .u64 = static_cast<uint64_t>(least) + (i << TAG_WIDTH) }, *slots[i]);
+        }
+        _builder._codelist[block._position] = Cell{ .ref = _engine._opcode_map.at(Instruction::SWITCH) };
+        _builder._codelist[block._position + 1] = Cell::makeU64(span);
+    } else {
+        for (auto & [key, n] : keys) {
+            plantCase(key, block._cases[n]);
+        }
+        _builder._codelist[block._position + 1] = Cell::makeU64(keys.size());
+    }
+    //  The key of the default is never read.
+    plantCase(Cell::makeSmall(0), otherwise);
+    block._done.setLabel();
+}
+
+//  Every call ends with the stack word of the code after it, which is
+//  filled in by optimise.
 void CodePlanter::CALL_GLOBAL(const std::string & name) {
-    addGlobal(name, Instruction::CALL_GLOBAL);
+    if (!tryInline(name)) {
+        addGlobal(name, Instruction::CALL_GLOBAL);
+        addRawUInt(0);
+    }
 }
 
 void CodePlanter::CALL_LOCAL(const std::string & name) {
     addLocal(name, Instruction::CALL_LOCAL);
+    addRawUInt(0);
 }
 
 void CodePlanter::CALL(const std::string & name) {
-    addLocalOrGlobal(name, Instruction::CALL_LOCAL, Instruction::CALL_GLOBAL);
+    if (tryAddLocal(name, Instruction::CALL_LOCAL) || tryAddCaptured(name, Instruction::CALL_LOCAL)) {
+        addRawUInt(0);
+    } else {
+        CALL_GLOBAL(name);
+    }
 }
 
 void CodePlanter::PUSH_GLOBAL(const std::string & name) {
@@ -274,16 +1601,89 @@ void CodePlanter::PUSHQ(int64_t i) {
     addDataQ(Cell::makeSmall(i));
 }
 
+void CodePlanter::PUSHQ(Cell c) {
+    addInstruction(Instruction::PUSHQ);
+    addDataQ(c);
+}
+
+//  Plants the code to push the captured values, followed by the lambda's
+//  procedure and a MAKE_CLOSURE. The procedure is filled in when this
+//  planter is built. A lambda without captures is just a procedure.
+void CodePlanter::CLOSURE(CodePlanter & lambda) {
+    if (lambda._parent != this) {
+        throw CompileTimeError("Closure planted outside its enclosing procedure");
+    }
+    for (auto & c : lambda._captures) {
+        if (c.fromLocal) {
+            local_info[c.index-1].captured = true;
+            plantLocal(Instruction::PUSH_LOCAL, c.index, Instruction::PUSH_LOCAL_BOX);
+        } else {
+            //  Pushes the raw captured cell, which is the box if boxed.
+            addInstruction(Instruction::PUSH_CAPTURED);
+            addRawUInt(c.index);
+        }
+    }
+    //  A placeholder that is neither a Small nor false, so the optimiser
+    //  treats it as the closure it will be.
+    addInstruction(Instruction::PUSHQ);
+    addDataQ(Cell::makePtr(nullptr));
+    _closure_sites.push_back(ClosureSite{ &lambda, _builder.size() - 1 });
+    if (!lambda._captures.empty()) {
+        addInstruction(Instruction::MAKE_CLOSURE);
+        addRawUInt(lambda._captures.size());
+    }
+}
+
+void CodePlanter::NEW_RECORD(const std::string & classname) {
+    addInstruction(Instruction::NEW_RECORD);
+    addDataQ(Cell::makeRecordKey(recordClass(classname)));
+}
+
+void CodePlanter::GET_FIELD(const std::string & classname, const std::string & fieldname) {
+    addField(classname, fieldname, Instruction::GET_FIELD);
+}
+
+void CodePlanter::SET_FIELD(const std::string & classname, const std::string & fieldname) {
+    addField(classname, fieldname, Instruction::SET_FIELD);
+}
+
 void CodePlanter::ADD() {
     addInstruction(Instruction::ADD);
+    addRawUInt(0);
 }
 
 void CodePlanter::SUB() {
     addInstruction(Instruction::SUB);
+    addRawUInt(0);
 }
 
 void CodePlanter::MUL() {
     addInstruction(Instruction::MUL);
+    addRawUInt(0);
+}
+
+void CodePlanter::LT() {
+    addInstruction(Instruction::LT);
+}
+
+void CodePlanter::LTE() {
+    addInstruction(Instruction::LTE);
+}
+
+void CodePlanter::GT() {
+    addInstruction(Instruction::GT);
+}
+
+void CodePlanter::GTE() {
+    addInstruction(Instruction::GTE);
+}
+
+void CodePlanter::EQ() {
+    addInstruction(Instruction::EQ);
+}
+
+void CodePlanter::NEQ() {
+    addInstruction(Instruction::NEQ);
 }
 
 void CodePlanter::RETURN() {
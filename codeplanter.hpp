@@ -6,6 +6,7 @@
 #include <fstream>
 #include <iostream>
 #include <ios>
+#include <deque>
 #include <map>
 #include <memory>
 
@@ -35,10 +36,51 @@ public:
     void setLabel();
 };
 
+//  A counted loop. The planter allocates three consecutive anonymous
+//  locals for the counter, limit and step.
+class ForRange {
+    friend class CodePlanter;
+    int _var;
+    int _counter;
+    Label _body;
+    Label _exit;
+
+public:
+    ForRange(Builder & b, int var, int counter) : _var(var), _counter(counter), _body(b), _exit(b) {}
+};
+
+//  A try block. The planter allocates an anonymous local for the depth of
+//  the value stack on entry, which its handler goes back to.
+class TryBlock {
+    friend class CodePlanter;
+    int _depth;
+    size_t _start = 0;
+    Label _done;
+
+public:
+    TryBlock(Builder & b, int depth) : _depth(depth), _done(b) {}
+};
+
+//  A switch. Each case is a label for its code and the keys that lead to
+//  it, which are only all known at the end, when the table is planted.
+class SwitchBlock {
+    friend class CodePlanter;
+    size_t _position = 0;           // Of the SWITCH.
+    std::deque<Label> _cases;
+    std::vector<std::pair<Cell, size_t>> _keys;     // Key, case.
+    std::optional<size_t> _default;
+    Label _table;
+    Label _done;
+
+public:
+    SwitchBlock(Builder & b) : _table(b), _done(b) {}
+};
+
 class CodePlanter {
 
 private:
     Engine & _engine;
+    CodeTier _tier;
     Builder _builder;
     size_t _before_instructions;
     PlaceHolder _length;
@@ -52,6 +94,95 @@ private:
     size_t max_level = 0;
     std::vector<PlaceHolder> local_fixups;
 
+    //  Free-variable analysis. A local is boxed if it is captured by a
+    //  closure and is either assigned inside a closure or assigned by this
+    //  procedure other than by the POP that initialises it. Any such
+    //  assignment may run after the capture, by way of a loop, wherever
+    //  it is in the text. Otherwise the closure simply gets a copy of its
+    //  value.
+    struct LocalInfo {
+        bool captured = false;
+        int assignments = 0;
+        bool assignedInClosure = false;
+        bool isBoxed() const { return captured && (assignments > 1 || assignedInClosure); }
+    };
+    std::vector<LocalInfo> local_info;      // Parallel to locals.
+
+    //  Closures. A lambda is a nested planter that captures the variables
+    //  of its enclosing planters; its captures are resolved through the
+    //  parent's locals and, transitively, the parent's own captures.
+    struct Capture {
+        std::string name;
+        bool fromLocal;         // index is a parent local (1-based) rather than a parent capture.
+        int index;
+        bool boxed = false;
+    };
+    CodePlanter * _parent = nullptr;
+    std::vector<Capture> _captures;
+    std::vector<std::unique_ptr<CodePlanter>> _lambdas;
+    Cell * _built = nullptr;
+
+    //  Boxing is only known once the whole procedure has been planted, so
+    //  we record the variable accesses that must be rewritten to their
+    //  boxed forms. The boxed forms take the same operands.
+    struct VarAccess {
+        size_t position;
+        bool captured;          // index is a capture index rather than a local.
+        int index;
+        Instruction boxed;
+    };
+    std::vector<VarAccess> _var_accesses;
+
+    //  Operands that are filled in when the planter is committed. Their
+    //  positions follow the code when it is optimised, and become npos if
+    //  the instruction is dropped.
+    struct ClosureSite {
+        CodePlanter * lambda;
+        size_t position;
+    };
+    std::vector<ClosureSite> _closure_sites;
+
+    struct GlobalRef {
+        size_t position;
+        std::string name;
+    };
+    std::vector<GlobalRef> _global_refs;
+    bool _sealed = false;
+
+    //  Calls that were inlined, see tryInline. The start and end of the
+    //  inlined code are positions in the code as planted, and the
+    //  position is that of the INLINED marker's first operand, which
+    //  follows the code like the other deferred operands.
+    struct InlineSite {
+        std::string name;
+        Cell * callee;
+        size_t start;
+        size_t end;
+        size_t position = SIZE_MAX;
+    };
+    std::vector<InlineSite> _inline_sites;
+    std::vector<int> _inline_locals;        // Shared by all the inlined code.
+
+    //  The exception handlers, innermost first, as positions in the code
+    //  as planted until optimise turns them into the offsets from the key
+    //  of HandlerLayout.
+    struct Handler {
+        size_t start;
+        size_t end;
+        size_t handler;
+    };
+    std::vector<Handler> _handlers;
+
+    //  The line table, as the byte offset in the source of the code from
+    //  each position on, see position. The positions are in the code as
+    //  planted until optimise turns them into offsets from the key.
+    struct LineMark {
+        size_t position;
+        uint32_t offset;
+    };
+    std::vector<LineMark> _lines;
+    uint64_t _source = 0;
+
     // Pointer offsets
     std::vector<int>  _q_offsets;
 
@@ -62,9 +193,27 @@ private:
 public:
     CodePlanter(Engine & engine);
 
+private:
+    CodePlanter(Engine & engine, CodePlanter * parent);
+
 public:
     void debugDisplay();
 
+    //  The tier is taken from the engine, or from the enclosing planter
+    //  for a lambda, and may be changed until the planter is sealed.
+    CodeTier tier() const { return _tier; }
+    void setTier(CodeTier tier) { _tier = tier; }
+
+    //  The source that the code comes from, an index from
+    //  Engine::addSource, or zero. Lambdas take it from their parent.
+    uint64_t source() const { return _source; }
+    void setSource(uint64_t source) { _source = source; }
+
+    //  The code planted from here on comes from this byte offset in the
+    //  source, until the next call. Used for the line table. An offset of
+    //  Item::MaxPosition or more is unknown and is ignored.
+    void position(size_t offset);
+
 public:
     void addInstruction(Instruction inst);
 
@@ -79,19 +228,64 @@ public:
     
     bool tryAddLocal(const std::string & varname, Instruction inst);
 
+    bool tryAddCaptured(const std::string & varname, Instruction inst);
+
     void addLocalOrGlobal(const std::string & name, Instruction instLocal, Instruction instGlobal);
 
+    void addField(const std::string & classname, const std::string & fieldname, Instruction inst);
+
+private:
+    Cell * recordClass(const std::string & classname);
+
+    int localIndex(const std::string & name);
+    void plantLocal(Instruction inst, int i, Instruction boxed);
+    void addLocalOperand(int i);
+    int anonymousLocal();
+    void startCase(SwitchBlock & block);
+    void plantCase(Cell key, Label & label);
+    int captureIndex(const std::string & name);
+    void markAssignedInClosure(int k);
+    bool tryInline(const std::string & name);
+    void plantInlineFallbacks();
+    void optimise();
+    Cell * commit();
+
 public:
     void local(const std::string & name);
 
     void global(const std::string & name);
 
+    //  Locals declared after enterScope are hidden again by the matching
+    //  exitScope. Their slots are not reused.
+    int enterScope();
+
+    void exitScope(int outer);
+
+    //  Finishes and optimises the code, without touching the heap, the
+    //  dictionary or the symbol table. Planting and sealing only read the
+    //  engine's shared state, so planters may be sealed on worker threads
+    //  while nothing else is being declared. Called by build if need be.
+    void seal();
+
+    //  Commits the procedure, and its lambdas, to the heap. Globals are
+    //  resolved at this point, declaring any that are still unknown.
     Cell * build();
 
     void buildAndBind(const std::string & name);
 
     Label newLabel();
 
+    ForRange newForRange(const std::string & var);
+
+    TryBlock newTryBlock();
+
+    SwitchBlock newSwitchBlock();
+
+    //  Creates a planter for a nested procedure that may refer to the
+    //  locals of this one. It is owned by this planter and is built when
+    //  this planter is built.
+    CodePlanter & lambda();
+
 public:
     void LABEL( Label & label );
 
@@ -101,6 +295,37 @@ public:
 
     void IFSO( Label & label );
 
+    //  Expects from, by and to on the stack.
+    void FOR_RANGE_INIT( ForRange & loop );
+
+    void FOR_RANGE_NEXT( ForRange & loop );
+
+    //  try STATEMENTS catch ... endtry is planted as TRY, the statements,
+    //  CATCH, the handler, which starts with the value thrown on the
+    //  stack, and ENDTRY.
+    void TRY( TryBlock & block );
+
+    void CATCH( TryBlock & block );
+
+    void ENDTRY( TryBlock & block );
+
+    //  Throws the value on top of the stack.
+    void THROW();
+
+    //  switch ... endswitch is planted as SWITCH, which pops the key, then
+    //  each case, started by CASE or DEFAULT and ended by a GOTO the end,
+    //  and then the table that the SWITCH branches through, planted by
+    //  ENDSWITCH. The keys must be Smalls, Booleans or Symbols. The table
+    //  is dense if the keys are Smalls that fill at least half their range,
+    //  and sorted for a binary search otherwise.
+    void SWITCH( SwitchBlock & block );
+
+    void CASE( SwitchBlock & block, const std::vector<Cell> & keys );
+
+    void DEFAULT( SwitchBlock & block );
+
+    void ENDSWITCH( SwitchBlock & block );
+
     void CALL_GLOBAL(const std::string & name);
 
     void CALL_LOCAL(const std::string & name);
@@ -121,12 +346,35 @@ public:
 
     void PUSHQ(int64_t i);
 
+    void PUSHQ(Cell c);
+
+    void CLOSURE(CodePlanter & lambda);
+
+    void NEW_RECORD(const std::string & classname);
+
+    void GET_FIELD(const std::string & classname, const std::string & fieldname);
+
+    void SET_FIELD(const std::string & classname, const std::string & fieldname);
+
     void ADD();
 
     void SUB();
 
     void MUL();
 
+    //  Comparisons push a Boolean, unless they feed a conditional branch.
+    void LT();
+
+    void LTE();
+
+    void GT();
+
+    void GTE();
+
+    void EQ();
+
+    void NEQ();
+
     void RETURN();
 
     void HALT();
@@ -134,6 +382,6 @@ public:
     void PUSHS();
 };
 
-#endif // CODEPLANTER_HPP
+} // namespace poppy
 
-} // namespace poppy
\ No newline at end of file
+#endif // CODEPLANTER_HPP
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include <cstring>
+
+#include "compactcode.hpp"
+#include "engine.hpp"
+#include "heap.hpp"
+#include "layout.hpp"
+#include "linetable.hpp"
+#include "mishap.hpp"
+#include "varint.hpp"
+
+namespace poppy {
+
+Cell * CompactLibrary::addProcedure(Engine & engine, Cell name) {
+    const int64_t code_end = ProcedureLayout::InstructionsOffset + 3;
+    Builder builder(engine.getHeap());
+    builder.addCell(name);
+    builder.addCell(Cell::makeSmall(code_end));                  // qblock
+    builder.addCell(Cell::makeSmall(code_end + 3));              // length
+    builder.addKey(ProcedureKeyValue);
+    builder.addCell(Cell::makeU64(0));                           // num locals
+    builder.addCell(StackNeeds::make(0, 0));                     // stack
+    builder.addCell(Cell{ .ref = engine._opcode_map.at(Instruction::EXPAND) });
+    builder.addCell(Cell{ .ref = this });
+    builder.addCell(Cell::makeU64(_entries.size()));
+    builder.addCell(Cell::makeU64(0));                           // no source
+    builder.addCell(Cell::makeU64(0));                           // no line table
+    builder.addCell(Cell::makeU64(0));                           // no handlers
+    _entries.push_back(Entry{ 0, 0 });
+    _stubs.push_back(builder.object());
+    return _stubs.back();
+}
+
+void CompactLibrary::encode(std::size_t n, const Cell * start, std::size_t code_end, std::size_t ncells) {
+    _entries[n].offset = _code.size();
+    _entries[n].ncells = code_end - ProcedureLayout::HeaderSize;
+    writeVarint(_code, start[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::NumLocalsOffset].u64);
+    writeVarint(_code, start[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::StackOffset].u64);
+    for (std::size_t i = ProcedureLayout::HeaderSize; i < code_end; ) {
+        if (start[i].u64 > UINT8_MAX) {
+            throw Unreachable();
+        }
+        Instruction inst = static_cast<Instruction>(start[i].u64);
+        _code.push_back(static_cast<uint8_t>(start[i].u64));
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(inst, nargs, bitmask);
+        for (int k = 0; k < nargs; k++) {
+            Cell c = start[i + 1 + k];
+            switch (operandKind(inst, k)) {
+                case OperandKind::Branch:
+                    writeVarint(_code, zigzag(c.i64));
+                    break;
+                case OperandKind::Ident: {
+                    auto [it, added] = _ident_index.try_emplace(c.refIdent, _idents.size());
+                    if (added) {
+                        _idents.push_back(c.refIdent);
+                    }
+                    writeVarint(_code, it->second);
+                    break;
+                }
+                case OperandKind::Literal: {
+                    auto [it, added] = _literal_index.try_emplace(c.u64, _literals.size());
+                    if (added) {
+                        _literals.push_back(c);
+                    }
+                    writeVarint(_code, it->second);
+                    break;
+                }
+                default:
+                    writeVarint(_code, c.u64);
+                    break;
+            }
+        }
+        i += 1 + nargs;
+    }
+    const Cell * count = start + ncells - 1;
+    const Cell * h = count - count->u64 * HandlerLayout::Size;
+    uint64_t nbytes = h[LineTableLayout::BytesOffset].u64;
+    const uint8_t * lines = reinterpret_cast<const uint8_t *>(h - LineTableLayout::Size - lineTableCells(nbytes));
+    writeVarint(_code, nbytes);
+    writeVarint(_code, h[LineTableLayout::SourceOffset].u64);
+    _code.insert(_code.end(), lines, lines + nbytes);
+    writeVarint(_code, count->u64);
+    for (; h < count; h++) {
+        writeVarint(_code, h->u64);
+    }
+}
+
+void CompactLibrary::finish() {
+    std::unordered_map<Ident *, uint64_t>().swap(_ident_index);
+    std::unordered_map<uint64_t, uint64_t>().swap(_literal_index);
+    _code.shrink_to_fit();
+    _idents.shrink_to_fit();
+    _literals.shrink_to_fit();
+    _entries.shrink_to_fit();
+    _stubs.shrink_to_fit();
+}
+
+std::size_t CompactLibrary::expanded() const {
+    std::size_t n = 0;
+    for (auto & e : _entries) {
+        n += e.expanded != nullptr;
+    }
+    return n;
+}
+
+std::size_t CompactLibrary::bytes() const {
+    return sizeof(*this) + _code.capacity() + _idents.capacity() * sizeof(Ident *) + _literals.capacity() * sizeof(Cell) + _entries.capacity() * sizeof(Entry) + _stubs.capacity() * sizeof(Cell *);
+}
+
+Cell * CompactLibrary::expand(Engine & engine, std::size_t n) {
+    Entry & entry = _entries[n];
+    if (entry.expanded != nullptr) {
+        return entry.expanded;
+    }
+    std::vector<Cell> cells;
+    cells.reserve(ProcedureLayout::HeaderSize + entry.ncells);
+    const uint8_t * p = _code.data() + entry.offset;
+    cells.push_back(_stubs[n][ProcedureLayout::ProcNameOffset]);
+    cells.push_back(Cell{});                                //  qblock
+    cells.push_back(Cell{});                                //  length
+    cells.push_back(ProcedureKeyValue);
+    cells.push_back(Cell::makeU64(readVarint(p)));
+    cells.push_back(Cell{ .u64 = readVarint(p) });
+    std::vector<uint64_t> q_offsets;
+    std::vector<std::size_t> markers;
+    while (cells.size() < ProcedureLayout::HeaderSize + entry.ncells) {
+        Instruction inst = static_cast<Instruction>(*p++);
+        if (inst == Instruction::INLINED) {
+            markers.push_back(cells.size());
+        }
+        cells.push_back(Cell{ .ref = engine._opcode_map.at(inst) });
+        int nargs;
+        unsigned int bitmask;
+        instructionInfo(inst, nargs, bitmask);
+        for (int k = 0; k < nargs; k++) {
+            uint64_t operand = readVarint(p);
+            switch (operandKind(inst, k)) {
+                case OperandKind::Branch:
+                    cells.push_back(Cell::makeI64(unzigzag(operand)));
+                    break;
+                case OperandKind::Ident:
+                    cells.push_back(Cell::makeRefIdent(_idents[operand]));
+                    break;
+                case OperandKind::Literal:
+                    cells.push_back(_literals[operand]);
+                    break;
+                default:
+                    cells.push_back(Cell{ .u64 = operand });
+                    break;
+            }
+            if (bitmask & (1u << k)) {
+                q_offsets.push_back(cells.size() - 1 - ProcedureLayout::KeyOffsetFromStart);
+            }
+        }
+    }
+    cells[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::QBlockOffset] = Cell::makeSmall(cells.size() - ProcedureLayout::KeyOffsetFromStart);
+    for (uint64_t q : q_offsets) {
+        cells.push_back(Cell{ .u64 = q });
+    }
+    uint64_t nbytes = readVarint(p);
+    uint64_t source = readVarint(p);
+    std::size_t lines = cells.size();
+    cells.resize(lines + lineTableCells(nbytes));
+    std::memcpy(cells.data() + lines, p, nbytes);
+    p += nbytes;
+    cells.push_back(Cell{ .u64 = source });
+    cells.push_back(Cell{ .u64 = nbytes });
+    uint64_t nhandlers = readVarint(p);
+    for (uint64_t i = 0; i < nhandlers * HandlerLayout::Size; i++) {
+        cells.push_back(Cell{ .u64 = readVarint(p) });
+    }
+    cells.push_back(Cell{ .u64 = nhandlers });
+    cells[ProcedureLayout::KeyOffsetFromStart + ProcedureLayout::LengthOffset] = Cell::makeSmall(cells.size() - ProcedureLayout::KeyOffsetFromStart);
+
+    Builder builder(engine.getHeap());
+    for (std::size_t i = 0; i < cells.size(); i++) {
+        if (i == ProcedureLayout::KeyOffsetFromStart) {
+            builder.addKey(cells[i]);
+        } else {
+            builder.addCell(cells[i]);
+        }
+    }
+    entry.expanded = builder.object();
+    for (std::size_t i : markers) {
+        engine.registerInlineSite(entry.expanded - ProcedureLayout::KeyOffsetFromStart + i);
+    }
+
+    //  The stub and the procedure are the same value as far as any inlined
+    //  code is concerned, so this is not an Engine::assign.
+    if (entry.binding != nullptr && entry.binding->value().isProcedure() && entry.binding->value().deref() == _stubs[n]) {
+        entry.binding->value() = Cell::makePtr(entry.expanded);
+    }
+    return entry.expanded;
+}
+
+} // namespace poppy
@@ -0,0 +1,87 @@
+#ifndef COMPACTCODE_HPP
+#define COMPACTCODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "cell.hpp"
+#include "dictionary.hpp"
+
+namespace poppy {
+
+class Engine;
+
+/*  A library of procedures held in a dense form until they are first
+    called, so that a large library costs little more than its compact
+    size if most of it never runs.
+
+    Each procedure is bound to a stub, a procedure whose only instruction
+    is EXPAND. On the first call it expands the compact form into an
+    ordinary procedure on the heap, rebinds the global that was bound to
+    the stub and enters the expansion. Later calls through the stub go
+    straight to the expansion.
+
+    A procedure is its number of locals and its stack word followed by its
+    instructions. Each instruction is a one-byte opcode followed by its
+    operands as LEB128 varints:
+
+    -   branch offsets are zigzag encoded, and need no fixing up because
+        each instruction expands to the cells it had,
+    -   Idents and literals are indexes into the tables of the library,
+    -   locals and raw operands are stored as they are.
+
+    The instructions are followed by the number of bytes of the line table
+    and its source, as varints, then the bytes as they are, and then by
+    the number of exception handlers and their cells, as varints. See
+    LineTableLayout and HandlerLayout.
+*/
+
+class CompactLibrary {
+private:
+    struct Entry {
+        uint32_t offset;                    //  Into _code.
+        uint32_t ncells;                    //  Instruction cells once expanded.
+        Ident * binding = nullptr;
+        Cell * expanded = nullptr;
+    };
+    std::vector<Entry> _entries;
+    std::vector<uint8_t> _code;
+    std::vector<Ident *> _idents;
+    std::vector<Cell> _literals;
+    std::vector<Cell *> _stubs;
+    std::unordered_map<Ident *, uint64_t> _ident_index;
+    std::unordered_map<uint64_t, uint64_t> _literal_index;
+
+public:
+    //  Allocates the stub for a new procedure, which must be encoded
+    //  before it is called, and returns its key.
+    Cell * addProcedure(Engine & engine, Cell name);
+
+    //  Encodes procedure n from a procedure whose instructions are still
+    //  Instruction numbers rather than addresses. The cells run from its
+    //  proc name to the end of its code, and on to the end of the
+    //  procedure for its handlers.
+    void encode(std::size_t n, const Cell * start, std::size_t code_end, std::size_t ncells);
+
+    //  Records the global bound to the stub, to be rebound on expansion.
+    void bind(std::size_t n, Ident * ident) { _entries[n].binding = ident; }
+
+    //  The procedure key of the expansion, expanding it if need be.
+    Cell * expand(Engine & engine, std::size_t n);
+
+    //  Drops the indexes used for encoding, once every procedure has been
+    //  encoded.
+    void finish();
+
+    std::size_t size() const { return _entries.size(); }
+    std::size_t expanded() const;
+
+    //  The memory held outside the heap, excluding the stubs.
+    std::size_t bytes() const;
+};
+
+} // namespace poppy
+
+#endif
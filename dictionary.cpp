@@ -0,0 +1,37 @@
+#include "dictionary.hpp"
+
+namespace poppy {
+
+Ident * Dictionary::lookup(std::string_view name) const {
+    auto n = _symbols.find(name);
+    if (n && *n < _bySymbol.size()) {
+        return _bySymbol[*n];
+    }
+    return nullptr;
+}
+
+Ident * Dictionary::allocate() {
+    if (_count % SlabSize == 0) {
+        _slabs.emplace_back(new Ident[SlabSize]);
+    }
+    Ident * ident = &_slabs.back()[_count % SlabSize];
+    _count += 1;
+    return ident;
+}
+
+Ident * Dictionary::declare(std::string_view name, bool & redeclared) {
+    std::size_t n = _symbols.intern(name);
+    if (n >= _bySymbol.size()) {
+        _bySymbol.resize(n + 1, nullptr);
+    }
+    Ident * ident = _bySymbol[n];
+    redeclared = ident != nullptr;
+    if (!redeclared) {
+        ident = allocate();
+        _names.push_back(n);
+        _bySymbol[n] = ident;
+    }
+    return ident;
+}
+
+} // namespace poppy
@@ -0,0 +1,64 @@
+#ifndef DICTIONARY_HPP
+#define DICTIONARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "cell.hpp"
+#include "symboltable.hpp"
+
+namespace poppy {
+
+/*  The global dictionary maps names to Idents. Names are hashed by the
+    runtime's symbol table, so a lookup is one probe of the symbol hash
+    index followed by an array access. The Idents themselves are
+    allocated in fixed-size slabs that are never freed or moved, so
+    planted code can hold raw Ident pointers, PUSH_GLOBAL touches densely
+    packed memory and the garbage collector can treat the slabs as a
+    contiguous set of roots.
+*/
+
+class Dictionary {
+private:
+    static constexpr std::size_t SlabSize = 256;
+
+    SymbolTable & _symbols;
+    std::vector<std::unique_ptr<Ident[]>> _slabs;
+    std::size_t _count = 0;
+
+    //  Indexed by symbol index, nullptr if not declared.
+    std::vector<Ident *> _bySymbol;
+
+    //  The symbol index of each Ident, in order of allocation.
+    std::vector<uint32_t> _names;
+
+public:
+    Dictionary(SymbolTable & symbols) : _symbols(symbols) {}
+
+public:
+    //  Returns nullptr if the name has not been declared.
+    Ident * lookup(std::string_view name) const;
+
+    //  Returns the existing Ident if the name is already declared.
+    Ident * declare(std::string_view name, bool & redeclared);
+
+    inline std::size_t size() const { return _count; }
+
+    //  Visit every Ident in order of declaration.
+    template <typename F>
+    void forEach(F && f) {
+        for (std::size_t n = 0; n < _count; n++) {
+            f(_symbols.name(_names[n]), _slabs[n / SlabSize][n % SlabSize]);
+        }
+    }
+
+private:
+    Ident * allocate();
+};
+
+} // namespace poppy
+
+#endif
@@ -7,6 +7,7 @@
 #include <ios>
 #include <map>
 #include <memory>
+#include <sstream>
 
 #include "itemizer.hpp"
 #include "itemrole.hpp"
@@ -27,6 +28,14 @@ namespace poppy {
         bitmask = 0;
 
         switch (inst) {
+            case Instruction::GET_FIELD:
+            case Instruction::SET_FIELD:
+                //  The first argument is a record key, which addresses the
+                //  record class key object.
+                nargs = 2;
+                bitmask = 0b1;
+                break;
+            case Instruction::NEW_RECORD:
             case Instruction::PUSHQ:   
                 bitmask = 0b1;
                 // fallthrough!
@@ -34,16 +43,72 @@ namespace poppy {
             case Instruction::POP_LOCAL:
             case Instruction::PUSH_GLOBAL:
             case Instruction::PUSH_LOCAL:        
-            case Instruction::CALL_GLOBAL:
-            case Instruction::CALL_LOCAL:
+            case Instruction::APPLY:
+            case Instruction::CALL_NATIVE:
+            case Instruction::CATCH:
+            case Instruction::CHECK_STACK:
+            case Instruction::INIT_LOCAL_BOXED:
+            case Instruction::MAKE_CLOSURE:
+            case Instruction::POP_CAPTURED_BOXED:
+            case Instruction::POP_LOCAL_BOXED:
+            case Instruction::PUSH_CAPTURED:
+            case Instruction::PUSH_CAPTURED_BOXED:
+            case Instruction::PUSH_LOCAL_BOX:
+            case Instruction::PUSH_LOCAL_BOXED:
+            case Instruction::TRY:
             case Instruction::GOTO:
             case Instruction::IFSO:
             case Instruction::IFNOT:
+            case Instruction::IF_EQ:
+            case Instruction::IF_GT:
+            case Instruction::IF_GTE:
+            case Instruction::IF_LT:
+            case Instruction::IF_LTE:
+            case Instruction::IF_NEQ:
+            //  The type feedback, see ArithmeticFeedback.
+            case Instruction::ADD:
+            case Instruction::ADD_SS:
+            case Instruction::MUL:
+            case Instruction::MUL_SS:
+            case Instruction::SUB:
+            case Instruction::SUB_SS:
                 nargs = 1;
                 break;
+            case Instruction::INLINED:
+                //  The global, the procedure that was inlined and a branch
+                //  to the inlined code.
+                nargs = 3;
+                bitmask = 0b10;
+                break;
+            //  A switch has the number of keys in its table and a branch to
+            //  the table, and each CASE of the table a key and a branch.
+            case Instruction::CASE:
+            case Instruction::SWITCH:
+            case Instruction::SWITCH_SPARSE:
+                nargs = 2;
+                break;
+            case Instruction::R_LOADQ:
+                bitmask = 0b10;
+                // fallthrough!
+            //  A call's last operand is the stack word for the code after it
+            //  returns, see StackNeeds.
+            case Instruction::CALL_GLOBAL:
+            case Instruction::CALL_LOCAL:
+            case Instruction::CALL_LOCAL_BOXED:
+            case Instruction::EXPAND:
             case Instruction::PASSIGN:
+            case Instruction::R_MOVE:
                 nargs = 2;
                 break;
+            case Instruction::R_ADD:
+            case Instruction::R_MUL:
+            case Instruction::R_SUB:
+                nargs = 3;
+                break;
+            case Instruction::FOR_RANGE_INIT:
+            case Instruction::FOR_RANGE_NEXT:
+                nargs = 3;
+                break;
             default:
                 //  zero nargs & empty bitmask.
                 break;
@@ -51,35 +116,268 @@ namespace poppy {
 
         switch (inst) {
             case Instruction::ADD: return "ADD";
+            case Instruction::ADD_SS: return "ADD_SS";
+            case Instruction::APPLY: return "APPLY";
             case Instruction::CALL_GLOBAL: return "CALL_GLOBAL";
             case Instruction::CALL_LOCAL: return "CALL_LOCAL";
+            case Instruction::CALL_LOCAL_BOXED: return "CALL_LOCAL_BOXED";
+            case Instruction::CALL_NATIVE: return "CALL_NATIVE";
+            case Instruction::CASE: return "CASE";
+            case Instruction::CATCH: return "CATCH";
+            case Instruction::CHECK_STACK: return "CHECK_STACK";
+            case Instruction::EQ: return "EQ";
+            case Instruction::EXPAND: return "EXPAND";
+            case Instruction::FOR_RANGE_INIT: return "FOR_RANGE_INIT";
+            case Instruction::FOR_RANGE_NEXT: return "FOR_RANGE_NEXT";
+            case Instruction::IF_EQ: return "IF_EQ";
+            case Instruction::IF_GT: return "IF_GT";
+            case Instruction::IF_GTE: return "IF_GTE";
+            case Instruction::IF_LT: return "IF_LT";
+            case Instruction::IF_LTE: return "IF_LTE";
+            case Instruction::IF_NEQ: return "IF_NEQ";
             case Instruction::IFNOT: return "IFNOT";
             case Instruction::IFSO: return "IFSO";
+            case Instruction::INLINED: return "INLINED";
             case Instruction::GOTO: return "GOTO";
+            case Instruction::GT: return "GT";
+            case Instruction::GTE: return "GTE";
             case Instruction::HALT: return "HALT";
+            case Instruction::INIT_LOCAL_BOXED: return "INIT_LOCAL_BOXED";
+            case Instruction::GET_FIELD: return "GET_FIELD";
+            case Instruction::LT: return "LT";
+            case Instruction::LTE: return "LTE";
+            case Instruction::MAKE_CLOSURE: return "MAKE_CLOSURE";
             case Instruction::MUL: return "MUL";
+            case Instruction::MUL_SS: return "MUL_SS";
+            case Instruction::NEQ: return "NEQ";
+            case Instruction::NEW_RECORD: return "NEW_RECORD";
             case Instruction::PASSIGN: return "PASSIGN";
+            case Instruction::POP_CAPTURED_BOXED: return "POP_CAPTURED_BOXED";
             case Instruction::POP_GLOBAL: return "POP_GLOBAL";
             case Instruction::POP_LOCAL: return "POP_LOCAL";
+            case Instruction::POP_LOCAL_BOXED: return "POP_LOCAL_BOXED";
+            case Instruction::PUSH_CAPTURED: return "PUSH_CAPTURED";
+            case Instruction::PUSH_CAPTURED_BOXED: return "PUSH_CAPTURED_BOXED";
             case Instruction::PUSH_GLOBAL: return "PUSH_GLOBAL";
             case Instruction::PUSH_LOCAL: return "PUSH_LOCAL";
+            case Instruction::PUSH_LOCAL_BOX: return "PUSH_LOCAL_BOX";
+            case Instruction::PUSH_LOCAL_BOXED: return "PUSH_LOCAL_BOXED";
             case Instruction::PUSHQ: return "PUSHQ";
             case Instruction::PUSHS: return "PUSHS";
             case Instruction::RETURN: return "RETURN";
+            case Instruction::R_ADD: return "R_ADD";
+            case Instruction::R_LOADQ: return "R_LOADQ";
+            case Instruction::R_MOVE: return "R_MOVE";
+            case Instruction::R_MUL: return "R_MUL";
+            case Instruction::R_SUB: return "R_SUB";
+            case Instruction::SET_FIELD: return "SET_FIELD";
             case Instruction::SUB: return "SUB";
+            case Instruction::SUB_SS: return "SUB_SS";
+            case Instruction::SWITCH: return "SWITCH";
+            case Instruction::SWITCH_SPARSE: return "SWITCH_SPARSE";
+            case Instruction::THROW: return "THROW";
+            case Instruction::TRY: return "TRY";
         }
 
         // Unreachable.
         __builtin_unreachable();
     }
 
+    OperandKind operandKind( const Instruction inst, int n ) {
+        switch (inst) {
+            case Instruction::GOTO:
+            case Instruction::IFSO:
+            case Instruction::IFNOT:
+            case Instruction::IF_EQ:
+            case Instruction::IF_GT:
+            case Instruction::IF_GTE:
+            case Instruction::IF_LT:
+            case Instruction::IF_LTE:
+            case Instruction::IF_NEQ:
+                return OperandKind::Branch;
+            case Instruction::FOR_RANGE_INIT:
+            case Instruction::FOR_RANGE_NEXT:
+                return n == 2 ? OperandKind::Branch : OperandKind::Local;
+            //  The key of a CASE may be a Symbol, which must be relocated.
+            case Instruction::CASE:
+                return n == 1 ? OperandKind::Branch : OperandKind::Literal;
+            case Instruction::SWITCH:
+            case Instruction::SWITCH_SPARSE:
+                return n == 1 ? OperandKind::Branch : OperandKind::Raw;
+            case Instruction::CALL_LOCAL:
+            case Instruction::CALL_LOCAL_BOXED:
+                return n == 0 ? OperandKind::Local : OperandKind::Raw;
+            case Instruction::CATCH:
+            case Instruction::TRY:
+            case Instruction::INIT_LOCAL_BOXED:
+            case Instruction::POP_LOCAL:
+            case Instruction::POP_LOCAL_BOXED:
+            case Instruction::PUSH_LOCAL:
+            case Instruction::PUSH_LOCAL_BOX:
+            case Instruction::PUSH_LOCAL_BOXED:
+            case Instruction::R_ADD:
+            case Instruction::R_MOVE:
+            case Instruction::R_MUL:
+            case Instruction::R_SUB:
+                return OperandKind::Local;
+            case Instruction::R_LOADQ:
+                return n == 0 ? OperandKind::Local : OperandKind::Literal;
+            case Instruction::POP_GLOBAL:
+            case Instruction::PUSH_GLOBAL:
+                return OperandKind::Ident;
+            case Instruction::CALL_GLOBAL:
+                return n == 0 ? OperandKind::Ident : OperandKind::Raw;
+            case Instruction::CALL_NATIVE:
+                return OperandKind::Native;
+            case Instruction::PASSIGN:
+                return n == 0 ? OperandKind::Ident : OperandKind::Literal;
+            case Instruction::INLINED:
+                return n == 0 ? OperandKind::Ident : n == 1 ? OperandKind::Literal : OperandKind::Branch;
+            case Instruction::PUSHQ:
+            case Instruction::NEW_RECORD:
+                return OperandKind::Literal;
+            case Instruction::GET_FIELD:
+            case Instruction::SET_FIELD:
+                return n == 0 ? OperandKind::Literal : OperandKind::Raw;
+            default:
+                return OperandKind::Raw;
+        }
+    }
+
+    Instruction genericForm( const Instruction inst ) {
+        switch (inst) {
+            case Instruction::ADD_SS: return Instruction::ADD;
+            case Instruction::MUL_SS: return Instruction::MUL;
+            case Instruction::SUB_SS: return Instruction::SUB;
+            default: return inst;
+        }
+    }
+
+    //  As file:line:column, the way compilers report them.
+    static std::string positionString(const SourcePosition & position) {
+        std::ostringstream out;
+        out << position.file << ":" << position.line << ":" << position.column;
+        return out.str();
+    }
+
     void Engine::declareGlobal(const std::string & name) {
-        auto & d = _runtime->_dictionary;
-        if (d.find(name) != d.end()) {
+        bool redeclared;
+        _runtime->_dictionary.declare(name, redeclared);
+        if (redeclared) {
             std::cerr << "Redeclaring global: " << name << std::endl;
         }
-        Ident * ident = new Ident(Cell::makeSmall(0));
-        d[name] = ident;
+    }
+
+    Cell * Engine::declareRecordClass(const std::string & name, const std::vector<std::string> & fields) {
+        Builder builder(getHeap());
+        builder.addKey(KeyKeyValue);
+        builder.addCell(Cell::makeSmall(fields.size()));
+        builder.addCell(Cell::makeSymbol(symbolIndex(name)));
+        for (auto & f : fields) {
+            builder.addCell(Cell::makeSymbol(symbolIndex(f)));
+        }
+        Cell * key = builder.object();
+        declareGlobal(name);
+        assign(_runtime->_dictionary.lookup(name), Cell::makePtr(key));
+        return key;
+    }
+
+    CompactLibrary & Engine::addCompactLibrary() {
+        _runtime->_compact.push_back(std::make_unique<CompactLibrary>());
+        return *_runtime->_compact.back();
+    }
+
+    //  The procedure is CALL_NATIVE, RETURN, and needs the arguments on the
+    //  stack and room for the result.
+    const NativeFunction * Engine::defineNative(const std::string & name, int arity, NativeCode code, bool fast) {
+        const NativeFunction * native = _runtime->_natives.add(name, arity, code, fast);
+        Builder builder(getHeap());
+        builder.addCell(Cell::makeSymbol(symbolIndex(name)));
+        builder.addCell(Cell::makeSmall(ProcedureLayout::InstructionsOffset + 3));
+        builder.addCell(Cell::makeSmall(ProcedureLayout::InstructionsOffset + 6));
+        builder.addKey(ProcedureKeyValue);
+        builder.addCell(Cell::makeU64(0));
+        builder.addCell(StackNeeds::make(arity, arity == 0 ? 1 : 0));
+        builder.addCell(Cell{ .ref = _opcode_map.at(Instruction::CALL_NATIVE) });
+        builder.addCell(Cell{ .ref = const_cast<NativeFunction *>(native) });
+        builder.addCell(Cell{ .ref = _opcode_map.at(Instruction::RETURN) });
+        builder.addCell(Cell::makeU64(0));                  // no source
+        builder.addCell(Cell::makeU64(0));                  // no line table
+        builder.addCell(Cell::makeU64(0));                  // no handlers
+        Cell * key = builder.object();
+        bool redeclared;
+        assign(_runtime->_dictionary.declare(name, redeclared), Cell::makePtr(key));
+        return native;
+    }
+
+    Cell * Engine::expanded(Cell * procedure) {
+        Cell * code = procedure + ProcedureLayout::InstructionsOffset;
+        if (code[0].ref == _opcode_map.at(Instruction::EXPAND)) {
+            return static_cast<CompactLibrary *>(code[1].ref)->expand(*this, code[2].u64);
+        }
+        return procedure;
+    }
+
+    //  The pc is that of the feedback operand.
+    void Engine::quicken(Cell * pc, Instruction inst) {
+        pc[-1].ref = _opcode_map.at(inst);
+    }
+
+    void Engine::despecialise(Cell * pc, Instruction inst) {
+        pc[-1].ref = _opcode_map.at(inst);
+        pc->u64 = ArithmeticFeedback::Unstable;
+    }
+
+    //  A stub counts as the procedure it expands to.
+    void Engine::registerInlineSite(Cell * marker) {
+        Ident * ident = marker[1].refIdent;
+        Cell value = ident->value();
+        bool same = value.u64 == marker[2].u64 || (value.isProcedure() && marker[2].isProcedure() && expanded(marker[2].deref()) == value.deref());
+        if (!same) {
+            deoptimiseSite(marker);
+            return;
+        }
+        _runtime->_inline_sites[ident].push_back(marker);
+        ident->setInlined(true);
+    }
+
+    void Engine::deoptimise(Ident * ident) {
+        auto it = _runtime->_inline_sites.find(ident);
+        if (it != _runtime->_inline_sites.end()) {
+            for (Cell * marker : it->second) {
+                deoptimiseSite(marker);
+            }
+            _runtime->_inline_sites.erase(it);
+        }
+        ident->setInlined(false);
+    }
+
+    //  The inlined code starts with a CHECK_STACK, which is overwritten by
+    //  a GOTO to the CALL_GLOBAL that follows the marker. The call returns
+    //  to a GOTO to the end of the inlined code, so the rest of it is no
+    //  longer run, but it is still well-formed code for anything that
+    //  walks the procedure.
+    void Engine::deoptimiseSite(Cell * marker) {
+        Cell * inlined = &marker[3] + marker[3].i64;
+        if (inlined[0].ref != _untraced_map.at(Instruction::CHECK_STACK) && inlined[0].ref != _traced_map.at(Instruction::CHECK_STACK)) {
+            return;     //  Already deoptimised.
+        }
+        inlined[0] = Cell{ .ref = _opcode_map.at(Instruction::GOTO) };
+        inlined[1] = Cell::makeI64(&marker[4] - &inlined[1]);
+    }
+
+    //  A boxed local gets its box from the POP that declares it, see
+    //  INIT_LOCAL_BOXED, except for a loop variable, which the loop
+    //  instructions write unboxed and which is boxed again when it is next
+    //  accessed. So a boxed slot holds either a box or an unboxed value.
+    Cell * Engine::box(Cell * slot) {
+        if (!slot->isBox()) {
+            Cell * b = getHeap().allocate(BoxLayout::Size);
+            b[0] = BoxKeyValue;
+            b[BoxLayout::ValueOffset] = *slot;
+            *slot = Cell::makePtr(b);
+        }
+        return slot->deref();
     }
 
     void Engine::init_or_run(Cell * pc, bool init) {
@@ -87,30 +385,143 @@ namespace poppy {
         // have a separate initialisation pass, so that the labels are
         // in scope while we populate the map.
         if (init) {
-            _opcode_map = {
+            _untraced_map = {
                 {Instruction::ADD, &&L_ADD},
+                {Instruction::ADD_SS, &&L_ADD_SS},
+                {Instruction::APPLY, &&L_APPLY},
                 {Instruction::CALL_GLOBAL, &&L_CALL_GLOBAL},
                 {Instruction::CALL_LOCAL, &&L_CALL_LOCAL},
+                {Instruction::CALL_LOCAL_BOXED, &&L_CALL_LOCAL_BOXED},
+                {Instruction::CALL_NATIVE, &&L_CALL_NATIVE},
+                {Instruction::CASE, &&L_CASE},
+                {Instruction::CATCH, &&L_CATCH},
+                {Instruction::CHECK_STACK, &&L_CHECK_STACK},
+                {Instruction::EQ, &&L_EQ},
+                {Instruction::EXPAND, &&L_EXPAND},
+                {Instruction::FOR_RANGE_INIT, &&L_FOR_RANGE_INIT},
+                {Instruction::FOR_RANGE_NEXT, &&L_FOR_RANGE_NEXT},
+                {Instruction::IF_EQ, &&L_IF_EQ},
+                {Instruction::IF_GT, &&L_IF_GT},
+                {Instruction::IF_GTE, &&L_IF_GTE},
+                {Instruction::IF_LT, &&L_IF_LT},
+                {Instruction::IF_LTE, &&L_IF_LTE},
+                {Instruction::IF_NEQ, &&L_IF_NEQ},
                 {Instruction::IFNOT, &&L_IFNOT},
                 {Instruction::IFSO, &&L_IFSO},
+                {Instruction::INLINED, &&L_INLINED},
                 {Instruction::GOTO, &&L_GOTO},
+                {Instruction::GT, &&L_GT},
+                {Instruction::GTE, &&L_GTE},
                 {Instruction::HALT, &&L_HALT},
+                {Instruction::GET_FIELD, &&L_GET_FIELD},
+                {Instruction::LT, &&L_LT},
+                {Instruction::LTE, &&L_LTE},
+                {Instruction::MAKE_CLOSURE, &&L_MAKE_CLOSURE},
                 {Instruction::MUL, &&L_MUL},
+                {Instruction::MUL_SS, &&L_MUL_SS},
+                {Instruction::NEQ, &&L_NEQ},
+                {Instruction::NEW_RECORD, &&L_NEW_RECORD},
                 {Instruction::PASSIGN, &&L_PASSIGN},
+                {Instruction::POP_CAPTURED_BOXED, &&L_POP_CAPTURED_BOXED},
                 {Instruction::POP_GLOBAL, &&L_POP_GLOBAL},
                 {Instruction::POP_LOCAL, &&L_POP_LOCAL},
+                {Instruction::POP_LOCAL_BOXED, &&L_POP_LOCAL_BOXED},
+                {Instruction::INIT_LOCAL_BOXED, &&L_INIT_LOCAL_BOXED},
+                {Instruction::PUSH_CAPTURED, &&L_PUSH_CAPTURED},
+                {Instruction::PUSH_CAPTURED_BOXED, &&L_PUSH_CAPTURED_BOXED},
                 {Instruction::PUSH_GLOBAL, &&L_PUSH_GLOBAL},
                 {Instruction::PUSH_LOCAL, &&L_PUSH_LOCAL},
+                {Instruction::PUSH_LOCAL_BOX, &&L_PUSH_LOCAL_BOX},
+                {Instruction::PUSH_LOCAL_BOXED, &&L_PUSH_LOCAL_BOXED},
                 {Instruction::PUSHQ, &&L_PUSHQ},
                 {Instruction::PUSHS, &&L_PUSHS},
                 {Instruction::RETURN, &&L_RETURN},
+                {Instruction::R_ADD, &&L_R_ADD},
+                {Instruction::R_LOADQ, &&L_R_LOADQ},
+                {Instruction::R_MOVE, &&L_R_MOVE},
+                {Instruction::R_MUL, &&L_R_MUL},
+                {Instruction::R_SUB, &&L_R_SUB},
+                {Instruction::SET_FIELD, &&L_SET_FIELD},
                 {Instruction::SUB, &&L_SUB},
+                {Instruction::SUB_SS, &&L_SUB_SS},
+                {Instruction::SWITCH, &&L_SWITCH},
+                {Instruction::SWITCH_SPARSE, &&L_SWITCH_SPARSE},
+                {Instruction::THROW, &&L_THROW},
+                {Instruction::TRY, &&L_TRY},
             };
+            _traced_map = {
+                {Instruction::ADD, &&T_ADD},
+                {Instruction::ADD_SS, &&T_ADD_SS},
+                {Instruction::APPLY, &&T_APPLY},
+                {Instruction::CALL_GLOBAL, &&T_CALL_GLOBAL},
+                {Instruction::CALL_LOCAL, &&T_CALL_LOCAL},
+                {Instruction::CALL_LOCAL_BOXED, &&T_CALL_LOCAL_BOXED},
+                {Instruction::CALL_NATIVE, &&T_CALL_NATIVE},
+                {Instruction::CASE, &&T_CASE},
+                {Instruction::CATCH, &&T_CATCH},
+                {Instruction::CHECK_STACK, &&T_CHECK_STACK},
+                {Instruction::EQ, &&T_EQ},
+                {Instruction::EXPAND, &&T_EXPAND},
+                {Instruction::FOR_RANGE_INIT, &&T_FOR_RANGE_INIT},
+                {Instruction::FOR_RANGE_NEXT, &&T_FOR_RANGE_NEXT},
+                {Instruction::IF_EQ, &&T_IF_EQ},
+                {Instruction::IF_GT, &&T_IF_GT},
+                {Instruction::IF_GTE, &&T_IF_GTE},
+                {Instruction::IF_LT, &&T_IF_LT},
+                {Instruction::IF_LTE, &&T_IF_LTE},
+                {Instruction::IF_NEQ, &&T_IF_NEQ},
+                {Instruction::IFNOT, &&T_IFNOT},
+                {Instruction::IFSO, &&T_IFSO},
+                {Instruction::INLINED, &&T_INLINED},
+                {Instruction::GOTO, &&T_GOTO},
+                {Instruction::GT, &&T_GT},
+                {Instruction::GTE, &&T_GTE},
+                {Instruction::HALT, &&T_HALT},
+                {Instruction::GET_FIELD, &&T_GET_FIELD},
+                {Instruction::LT, &&T_LT},
+                {Instruction::LTE, &&T_LTE},
+                {Instruction::MAKE_CLOSURE, &&T_MAKE_CLOSURE},
+                {Instruction::MUL, &&T_MUL},
+                {Instruction::MUL_SS, &&T_MUL_SS},
+                {Instruction::NEQ, &&T_NEQ},
+                {Instruction::NEW_RECORD, &&T_NEW_RECORD},
+                {Instruction::PASSIGN, &&T_PASSIGN},
+                {Instruction::POP_CAPTURED_BOXED, &&T_POP_CAPTURED_BOXED},
+                {Instruction::POP_GLOBAL, &&T_POP_GLOBAL},
+                {Instruction::POP_LOCAL, &&T_POP_LOCAL},
+                {Instruction::POP_LOCAL_BOXED, &&T_POP_LOCAL_BOXED},
+                {Instruction::INIT_LOCAL_BOXED, &&T_INIT_LOCAL_BOXED},
+                {Instruction::PUSH_CAPTURED, &&T_PUSH_CAPTURED},
+                {Instruction::PUSH_CAPTURED_BOXED, &&T_PUSH_CAPTURED_BOXED},
+                {Instruction::PUSH_GLOBAL, &&T_PUSH_GLOBAL},
+                {Instruction::PUSH_LOCAL, &&T_PUSH_LOCAL},
+                {Instruction::PUSH_LOCAL_BOX, &&T_PUSH_LOCAL_BOX},
+                {Instruction::PUSH_LOCAL_BOXED, &&T_PUSH_LOCAL_BOXED},
+                {Instruction::PUSHQ, &&T_PUSHQ},
+                {Instruction::PUSHS, &&T_PUSHS},
+                {Instruction::RETURN, &&T_RETURN},
+                {Instruction::R_ADD, &&T_R_ADD},
+                {Instruction::R_LOADQ, &&T_R_LOADQ},
+                {Instruction::R_MOVE, &&T_R_MOVE},
+                {Instruction::R_MUL, &&T_R_MUL},
+                {Instruction::R_SUB, &&T_R_SUB},
+                {Instruction::SET_FIELD, &&T_SET_FIELD},
+                {Instruction::SUB, &&T_SUB},
+                {Instruction::SUB_SS, &&T_SUB_SS},
+                {Instruction::SWITCH, &&T_SWITCH},
+                {Instruction::SWITCH_SPARSE, &&T_SWITCH_SPARSE},
+                {Instruction::THROW, &&T_THROW},
+                {Instruction::TRY, &&T_TRY},
+            };
+            _opcode_map = _untraced_map;
 
             //  A tiny scrap of code to elegantly exit from the interpreter.
+            //  It is returned to like a call, so it starts with the stack
+            //  word of the code after the call.
             #pragma GCC diagnostic push
             //#pragma GCC diagnostic ignored "-Wdangling-pointer"
-            _exit_code[0] = Cell{ .ref = &&L_HALT };
+            _exit_code[0] = StackNeeds::make(0, 0);
+            _exit_code[1] = Cell{ .ref = &&L_HALT };
             #pragma GCC diagnostic pop
             return;
         }
@@ -125,83 +536,507 @@ namespace poppy {
 
         Cell nextProcedure{Cell::makeSmall(0)};
         currentProcedure = pc;
+        currentClosure = nullptr;
         uint64_t nlocals = (currentProcedure + ProcedureLayout::NumLocalsOffset)->u64;
         _callStack.push_back( Cell{ .ref = nullptr } );     // Dummy.
-        _callStack.push_back( Cell{ .refCell = &_exit_code[0] } );
+        _callStack.push_back( Cell{ .ref = nullptr } );     // Dummy.
+        _callStack.push_back( Cell{ .refCell = &_exit_code[1] } );
         if (nlocals != 0) {
             _callStack.resize(_callStack.size() + nlocals, Cell::makeSmall(0));
         }
+        checkStack(currentProcedure[ProcedureLayout::StackOffset]);
         pc += ProcedureLayout::InstructionsOffset;          // Skip the procedure header.
+
+        //  A Mishap from an instruction is caught at the end and, if a
+        //  handler covers the instruction, the engine carries on from the
+        //  handler, see unwind. Control cannot jump into a try block from
+        //  outside it, hence the loop. The pc is the only state the catch
+        //  needs, so the handlers run as they would without it.
+        for (;;) try {
+
         goto *pc++->ref;
 
+        //  Branch offsets are relative to the cell holding the offset.
         L_IFNOT: {
-            int64_t delta = (pc++)->i64;
+            int64_t delta = pc->i64;
             Cell v = _valueStack.back();
             _valueStack.pop_back();
             if (v.isFalse()) {
                 pc += delta;
-                goto *(pc->ref);
             } else {
-                goto *(pc++->ref);
+                pc += 1;
             }
+            goto *(pc++->ref);
         }
 
         L_IFSO: {
-            int64_t delta = (pc++)->i64;
+            int64_t delta = pc->i64;
             Cell v = _valueStack.back();
             _valueStack.pop_back();
             if (v.isntFalse()) {
                 pc += delta;
-                goto *(pc->ref);
             } else {
-                goto *(pc++->ref);
+                pc += 1;
             }
+            goto *(pc++->ref);
+        }
+
+        //  Comparisons. Only Smalls are ordered, which is the order of their
+        //  cells, but any two values can be compared for equality, which is
+        //  identity. The IF_ forms are fused with the branch that follows,
+        //  see CodePlanter::optimise.
+        L_EQ: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            _valueStack.back() = a.u64 == b.u64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_NEQ: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            _valueStack.back() = a.u64 != b.u64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_LT: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.back() = a.i64 < b.i64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_LTE: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.back() = a.i64 <= b.i64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_GT: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.back() = a.i64 > b.i64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_GTE: {
+            Cell b = _valueStack.back();
+            _valueStack.pop_back();
+            Cell a = _valueStack.back();
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.back() = a.i64 >= b.i64 ? TrueValue : FalseValue;
+            goto *(pc++->ref);
+        }
+
+        L_IF_EQ: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.u64 == b.u64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        L_IF_NEQ: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.u64 != b.u64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        L_IF_LT: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.i64 < b.i64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        L_IF_LTE: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.i64 <= b.i64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        L_IF_GT: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.i64 > b.i64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        L_IF_GTE: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                throw Mishap("Cannot compare non-small values");
+            }
+            _valueStack.resize(_valueStack.size() - 2);
+            pc += a.i64 >= b.i64 ? pc->i64 : 1;
+            goto *(pc++->ref);
+        }
+
+        //  A marker that heads the out-of-line call for some inlined code,
+        //  see CodePlanter::tryInline. It is never run.
+        L_INLINED: {
+            throw Unreachable();
         }
 
         L_GOTO: {
             int64_t delta = pc->i64;
             pc += delta;
-            goto *(pc->ref);
+            goto *(pc++->ref);
+        }
+
+        //  A switch pops its key and branches through the CASE for it in
+        //  its table, or through the last CASE, which is the default. The
+        //  table of a SWITCH has a CASE for every Small from its first key
+        //  on, so it is indexed directly. The keys of a SWITCH_SPARSE table
+        //  are in the order of their cells and are found by binary search.
+        L_SWITCH: {
+            uint64_t n = pc[0].u64;
+            Cell * table = pc + 1 + pc[1].i64;
+            Cell key = _valueStack.back();
+            _valueStack.pop_back();
+            uint64_t i = (key.u64 - table[CaseLayout::KeyOffset].u64) >> TAG_WIDTH;
+            if (!key.isSmall() || i >= n) {
+                i = n;
+            }
+            pc = table + i * CaseLayout::Size + CaseLayout::BranchOffset;
+            pc += pc->i64;
+            goto *(pc++->ref);
+        }
+
+        L_SWITCH_SPARSE: {
+            uint64_t n = pc[0].u64;
+            Cell * table = pc + 1 + pc[1].i64;
+            uint64_t key = _valueStack.back().u64;
+            _valueStack.pop_back();
+            uint64_t lo = 0;
+            uint64_t hi = n;
+            while (lo < hi) {
+                uint64_t mid = (lo + hi) / 2;
+                if (table[mid * CaseLayout::Size + CaseLayout::KeyOffset].u64 < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < n && table[lo * CaseLayout::Size + CaseLayout::KeyOffset].u64 != key) {
+                lo = n;
+            }
+            pc = table + lo * CaseLayout::Size + CaseLayout::BranchOffset;
+            pc += pc->i64;
+            goto *(pc++->ref);
+        }
+
+        //  An entry in the table of a switch, which is only ever read.
+        L_CASE: {
+            throw Unreachable();
+        }
+
+        //  Operands: loop variable, counter and branch to the loop exit.
+        //  The counter is followed in the frame by the limit and the step.
+        //  The limit is the last value the counter will take, so the loop
+        //  can never overflow and FOR_RANGE_NEXT needs no checks.
+        L_FOR_RANGE_INIT: {
+            Cell * frame = &_callStack.back();
+            Cell * var = frame - pc[0].u64;
+            Cell * counter = frame - pc[1].u64;
+            Cell to = _valueStack.back();
+            _valueStack.pop_back();
+            Cell by = _valueStack.back();
+            _valueStack.pop_back();
+            Cell from = _valueStack.back();
+            _valueStack.pop_back();
+            if (!(from.isSmall() && by.isSmall() && to.isSmall())) {
+                throw Mishap("Non-integer loop range").culprit("From", from.u64).culprit("By", by.u64).culprit("To", to.u64);
+            }
+            int64_t f = from.i64 >> TAG_WIDTH;
+            int64_t s = by.i64 >> TAG_WIDTH;
+            int64_t t = to.i64 >> TAG_WIDTH;
+            if (s == 0) {
+                throw Mishap("Loop step must not be zero");
+            }
+            if (s > 0 ? f > t : f < t) {
+                pc += 2;
+                pc += pc->i64;
+                goto *(pc++->ref);
+            }
+            //  Smalls are 61-bit so neither the span nor the last value
+            //  can overflow.
+            uint64_t span = s > 0 ? static_cast<uint64_t>(t - f) : static_cast<uint64_t>(f - t);
+            uint64_t nsteps = span / static_cast<uint64_t>(s > 0 ? s : -s);
+            counter[0] = from;
+            counter[1] = Cell::makeSmall(f + static_cast<int64_t>(nsteps) * s);
+            counter[2] = by;
+            *var = from;
+            pc += 3;
+            goto *(pc++->ref);
+        }
+
+        L_FOR_RANGE_NEXT: {
+            Cell * frame = &_callStack.back();
+            Cell * counter = frame - pc[1].u64;
+            if (counter[0].i64 != counter[1].i64) {
+                counter[0].i64 += counter[2].i64;
+                *(frame - pc[0].u64) = counter[0];
+                pc += 2;
+                pc += pc->i64;
+            } else {
+                pc += 3;
+            }
+            goto *(pc++->ref);
         }
 
         L_PASSIGN: {
             Ident * ident = (pc++)->refIdent;
             Cell proc{ *pc++ };
-            ident->value() = proc;
+            assign(ident, proc);
+            goto *(pc++->ref);
+        }
+
+        //  The native's result replaces its arguments. A native that is not
+        //  fast may allocate, so the pc is left where a collector can find
+        //  it, see nativeSafepoint.
+        L_CALL_NATIVE: {
+            const NativeFunction * native = static_cast<const NativeFunction *>(pc->ref);
+            Cell * args = _valueStack.end() - native->arity;
+            Cell result;
+            if (native->fast) {
+                result = native->code(*this, args);
+            } else {
+                _native_safepoint = pc;
+                try {
+                    result = native->code(*this, args);
+                } catch (...) {
+                    pc = _native_safepoint;
+                    _native_safepoint = nullptr;
+                    throw;
+                }
+                pc = _native_safepoint;
+                _native_safepoint = nullptr;
+            }
+            _valueStack.resize(_valueStack.size() - native->arity);
+            _valueStack.push_back(result);
+            pc += 1;
             goto *(pc++->ref);
         }
 
         L_CALL_GLOBAL: {
-            Ident * ident = (pc++)->refIdent;
+            Ident * ident = pc->refIdent;
+            pc += 2;
             nextProcedure = ident->value();
             goto COMMON_CALL;
         }
 
         L_CALL_LOCAL: {
-            uint64_t n = pc++->u64;
+            uint64_t n = pc->u64;
+            pc += 2;
             nextProcedure = *( &_callStack.back() - n );
+            goto COMMON_CALL;
+        }
+
+        L_CALL_LOCAL_BOXED: {
+            uint64_t n = pc->u64;
+            pc += 2;
+            nextProcedure = box( &_callStack.back() - n )[BoxLayout::ValueOffset];
+            goto COMMON_CALL;
+        }
+
+        //  Planted where the depth of the stack depends on the path taken,
+        //  such as the top of a loop that pushes a value each time round.
+        L_CHECK_STACK: {
+            checkStack(*pc++);
+            goto *(pc++->ref);
+        }
+
+        //  A try block only records the depth of the value stack, in a
+        //  local, for its CATCH to go back to. The handler that covers the
+        //  block is found from the handler table, see unwind.
+        L_TRY: {
+            uint64_t n = pc++->u64;
+            Cell * c = &_callStack.back() - n;
+            *c = Cell::makeSmall(_valueStack.size());
+            goto *(pc++->ref);
+        }
+
+        //  The first instruction of a handler. Drops whatever the try block
+        //  left on the stack and pushes the value thrown.
+        L_CATCH: {
+            uint64_t n = pc++->u64;
+            Cell * c = &_callStack.back() - n;
+            std::size_t depth = static_cast<std::size_t>(c->getSmall());
+            if (_valueStack.size() > depth) {
+                _valueStack.resize(depth);
+            }
+            //  The check that follows the CATCH does not cover its push.
+            _valueStack.ensure(1);
+            _valueStack.push_back(_thrown);
+            goto *(pc++->ref);
+        }
+
+        L_THROW: {
+            _thrown = _valueStack.back();
+            _valueStack.pop_back();
+            Cell * handler = unwind(pc);
+            if (handler == nullptr) {
+                throw Mishap("Uncaught exception").culprit("Value", _thrown.u64);
+            }
+            pc = handler;
             goto *(pc++->ref);
         }
 
+        //  The only instruction of a stub. The stub's frame has no locals,
+        //  so the expansion simply takes it over.
+        L_EXPAND: {
+            currentProcedure = static_cast<CompactLibrary *>(pc[0].ref)->expand(*this, pc[1].u64);
+            uint64_t nlocals = (currentProcedure + ProcedureLayout::NumLocalsOffset)->u64;
+            if (nlocals != 0) {
+                _callStack.resize(_callStack.size() + nlocals, Cell::makeSmall(0));
+            }
+            pc = currentProcedure + ProcedureLayout::InstructionsOffset;
+            checkStack(currentProcedure[ProcedureLayout::StackOffset]);
+            goto *(pc++->ref);
+        }
+
+        L_APPLY: {
+            nextProcedure = _valueStack.back();
+            _valueStack.pop_back();
+            pc += 1;
+            goto COMMON_CALL;
+        }
+
         COMMON_CALL: {
+            Cell * nextClosure = nullptr;
+            if (nextProcedure.isClosure()) {
+                nextClosure = nextProcedure.deref();
+                nextProcedure = nextClosure[ClosureLayout::ProcedureOffset];
+            }
             if (nextProcedure.isProcedure()) {
                 _callStack.push_back( Cell{ .refCell = currentProcedure } );
+                _callStack.push_back( Cell{ .refCell = currentClosure } );
                 _callStack.push_back( Cell{ .refCell = pc } );
                 currentProcedure = nextProcedure.deref();
+                currentClosure = nextClosure;
                 uint64_t nlocals = (currentProcedure + ProcedureLayout::NumLocalsOffset)->u64;
                 if (nlocals != 0) {
                     _callStack.resize(_callStack.size() + nlocals, Cell::makeSmall(0));
                 }
+                //  The pc moves first, so that a Mishap from the check is
+                //  raised in the callee rather than at a stray offset.
                 pc = currentProcedure + ProcedureLayout::InstructionsOffset;
+                checkStack(currentProcedure[ProcedureLayout::StackOffset]);
             } else {
                 throw Mishap("Trying to call non-procedure").culprit("Value", nextProcedure.u64);
             }
             goto *(pc++->ref);
         }
 
+        L_MAKE_CLOSURE: {
+            uint64_t n = pc++->u64;
+            Cell proc = _valueStack.back();
+            _valueStack.pop_back();
+            Cell * closure = getHeap().allocate(ClosureLayout::CapturedOffset + n);
+            closure[0] = ClosureKeyValue;
+            closure[ClosureLayout::ProcedureOffset] = proc;
+            closure[ClosureLayout::NumCapturedOffset] = Cell::makeSmall(n);
+            Cell * values = _valueStack.data() + _valueStack.size() - n;
+            for (uint64_t i = 0; i < n; i++) {
+                closure[ClosureLayout::CapturedOffset + i] = values[i];
+            }
+            _valueStack.resize(_valueStack.size() - n);
+            _valueStack.push_back(Cell::makePtr(closure));
+            goto *(pc++->ref);
+        }
+
+        L_PUSH_CAPTURED: {
+            uint64_t n = pc++->u64;
+            _valueStack.push_back(currentClosure[ClosureLayout::CapturedOffset + n]);
+            goto *(pc++->ref);
+        }
+
+        L_PUSH_CAPTURED_BOXED: {
+            uint64_t n = pc++->u64;
+            Cell * b = currentClosure[ClosureLayout::CapturedOffset + n].deref();
+            _valueStack.push_back(b[BoxLayout::ValueOffset]);
+            goto *(pc++->ref);
+        }
+
+        L_POP_CAPTURED_BOXED: {
+            uint64_t n = pc++->u64;
+            Cell * b = currentClosure[ClosureLayout::CapturedOffset + n].deref();
+            b[BoxLayout::ValueOffset] = _valueStack.back();
+            _valueStack.pop_back();
+            goto *(pc++->ref);
+        }
+
+        L_PUSH_LOCAL_BOX: {
+            uint64_t n = pc++->u64;
+            Cell * b = box( &_callStack.back() - n );
+            _valueStack.push_back(Cell::makePtr(b));
+            goto *(pc++->ref);
+        }
+
+        L_PUSH_LOCAL_BOXED: {
+            uint64_t n = pc++->u64;
+            Cell * b = box( &_callStack.back() - n );
+            _valueStack.push_back(b[BoxLayout::ValueOffset]);
+            goto *(pc++->ref);
+        }
+
+        L_POP_LOCAL_BOXED: {
+            uint64_t n = pc++->u64;
+            Cell * b = box( &_callStack.back() - n );
+            b[BoxLayout::ValueOffset] = _valueStack.back();
+            _valueStack.pop_back();
+            goto *(pc++->ref);
+        }
+
+        //  The POP that declares a boxed local, which gets a new box each
+        //  time it runs, so that closures made by earlier iterations of a
+        //  loop keep their own.
+        L_INIT_LOCAL_BOXED: {
+            uint64_t n = pc++->u64;
+            Cell * slot = &_callStack.back() - n;
+            *slot = _valueStack.back();
+            _valueStack.pop_back();
+            box(slot);
+            goto *(pc++->ref);
+        }
+
         L_POP_GLOBAL: {
             Ident * ident = (pc++)->refIdent;
-            ident->value() = _valueStack.back();
+            assign(ident, _valueStack.back());
             _valueStack.pop_back();
             goto *(pc++->ref);
         }
@@ -227,6 +1062,9 @@ namespace poppy {
             goto *(pc++->ref);
         }
 
+        //  Arithmetic is quickened on its type feedback, see
+        //  ArithmeticFeedback. The _SS forms leave reporting an overflow to
+        //  the generic form.
         L_ADD: {
             Cell b = _valueStack.back();
             _valueStack.pop_back();
@@ -239,9 +1077,31 @@ namespace poppy {
                 } else {
                     _valueStack.back() = Cell{ .i64 = r };
                 }
+                if (pc->u64 < ArithmeticFeedback::QuickenAfter && ++pc->u64 == ArithmeticFeedback::QuickenAfter) {
+                    quicken(pc, Instruction::ADD_SS);
+                }
             } else {
+                pc->u64 = ArithmeticFeedback::Unstable;
                 throw Mishap("Cannot add non-small values");
             }
+            pc += 1;
+            goto *(pc++->ref);
+        }
+
+        L_ADD_SS: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            int64_t r;
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                despecialise(pc, Instruction::ADD);
+                goto L_ADD;
+            }
+            if (__builtin_add_overflow(a.i64, b.i64, &r)) {
+                goto L_ADD;
+            }
+            _valueStack.pop_back();
+            _valueStack.back() = Cell{ .i64 = r };
+            pc += 1;
             goto *(pc++->ref);
         }
 
@@ -257,9 +1117,31 @@ namespace poppy {
                 } else {
                     _valueStack.back() = Cell{ .i64 = r };
                 }
+                if (pc->u64 < ArithmeticFeedback::QuickenAfter && ++pc->u64 == ArithmeticFeedback::QuickenAfter) {
+                    quicken(pc, Instruction::SUB_SS);
+                }
             } else {
+                pc->u64 = ArithmeticFeedback::Unstable;
                 throw Mishap("Cannot subtract non-small values");
             }
+            pc += 1;
+            goto *(pc++->ref);
+        }
+
+        L_SUB_SS: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            int64_t r;
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                despecialise(pc, Instruction::SUB);
+                goto L_SUB;
+            }
+            if (__builtin_sub_overflow(a.i64, b.i64, &r)) {
+                goto L_SUB;
+            }
+            _valueStack.pop_back();
+            _valueStack.back() = Cell{ .i64 = r };
+            pc += 1;
             goto *(pc++->ref);
         }
 
@@ -275,9 +1157,141 @@ namespace poppy {
                 } else {
                     _valueStack.back() = Cell{ .i64 = r };
                 }
+                if (pc->u64 < ArithmeticFeedback::QuickenAfter && ++pc->u64 == ArithmeticFeedback::QuickenAfter) {
+                    quicken(pc, Instruction::MUL_SS);
+                }
             } else {
+                pc->u64 = ArithmeticFeedback::Unstable;
                 throw Mishap("Cannot multiply non-small values");
             }
+            pc += 1;
+            goto *(pc++->ref);
+        }
+
+        L_MUL_SS: {
+            Cell b = _valueStack.end()[-1];
+            Cell a = _valueStack.end()[-2];
+            int64_t r;
+            if (((a.u64 | b.u64) & TAG_MASK) != 0) {
+                despecialise(pc, Instruction::MUL);
+                goto L_MUL;
+            }
+            if (__builtin_mul_overflow( a.i64 >> TAG_WIDTH, b.i64, &r )) {
+                goto L_MUL;
+            }
+            _valueStack.pop_back();
+            _valueStack.back() = Cell{ .i64 = r };
+            pc += 1;
+            goto *(pc++->ref);
+        }
+
+        //  The register tier. The operands are frame slots, the destination
+        //  first, and the destination is only written once the result is
+        //  known, so it may also be a source.
+        L_R_MOVE: {
+            Cell * frame = &_callStack.back();
+            *(frame - pc[0].u64) = *(frame - pc[1].u64);
+            pc += 2;
+            goto *(pc++->ref);
+        }
+
+        L_R_LOADQ: {
+            Cell * frame = &_callStack.back();
+            *(frame - pc[0].u64) = pc[1];
+            pc += 2;
+            goto *(pc++->ref);
+        }
+
+        L_R_ADD: {
+            Cell * frame = &_callStack.back();
+            Cell a = *(frame - pc[1].u64);
+            Cell b = *(frame - pc[2].u64);
+            if (a.isSmall() && b.isSmall()) {
+                int64_t r;
+                if (__builtin_add_overflow(a.i64, b.i64, &r)) {
+                    throw Mishap("Integer overflow trapped").culprit("Arg #1", a.i64).culprit("Arg #2", b.i64);
+                }
+                *(frame - pc[0].u64) = Cell{ .i64 = r };
+            } else {
+                throw Mishap("Cannot add non-small values");
+            }
+            pc += 3;
+            goto *(pc++->ref);
+        }
+
+        L_R_SUB: {
+            Cell * frame = &_callStack.back();
+            Cell a = *(frame - pc[1].u64);
+            Cell b = *(frame - pc[2].u64);
+            if (a.isSmall() && b.isSmall()) {
+                int64_t r;
+                if (__builtin_sub_overflow(a.i64, b.i64, &r)) {
+                    throw Mishap("Integer overflow trapped").culprit("Arg #1", a.i64).culprit("Arg #2", b.i64);
+                }
+                *(frame - pc[0].u64) = Cell{ .i64 = r };
+            } else {
+                throw Mishap("Cannot subtract non-small values");
+            }
+            pc += 3;
+            goto *(pc++->ref);
+        }
+
+        L_R_MUL: {
+            Cell * frame = &_callStack.back();
+            Cell a = *(frame - pc[1].u64);
+            Cell b = *(frame - pc[2].u64);
+            if (a.isSmall() && b.isSmall()) {
+                int64_t r;
+                if (__builtin_mul_overflow(a.i64 >> 3, b.i64, &r)) {
+                    throw Mishap("Integer overflow trapped").culprit("Arg #1", a.i64).culprit("Arg #2", b.i64);
+                }
+                *(frame - pc[0].u64) = Cell{ .i64 = r };
+            } else {
+                throw Mishap("Cannot multiply non-small values");
+            }
+            pc += 3;
+            goto *(pc++->ref);
+        }
+
+        L_NEW_RECORD: {
+            Cell key = *pc++;
+            uint64_t nfields = key.deref()[RecordKeyLayout::NumFieldsOffset].getSmall();
+            Cell * record = getHeap().allocate(RecordLayout::FieldsOffset + nfields);
+            record[0] = key;
+            Cell * values = _valueStack.data() + _valueStack.size() - nfields;
+            for (uint64_t i = 0; i < nfields; i++) {
+                record[RecordLayout::FieldsOffset + i] = values[i];
+            }
+            _valueStack.resize(_valueStack.size() - nfields);
+            _valueStack.push_back(Cell::makePtr(record));
+            goto *(pc++->ref);
+        }
+
+        //  The field offset was resolved when the code was planted, so
+        //  all we need is a single comparison of the record's key.
+        L_GET_FIELD: {
+            Cell key = *pc++;
+            uint64_t offset = pc++->u64;
+            Cell r = _valueStack.back();
+            if (r.isTaggedPtr() && r.deref()->u64 == key.u64) {
+                _valueStack.back() = r.deref()[offset];
+            } else {
+                throw Mishap("Wrong type of record for field access").culprit("Value", r.u64);
+            }
+            goto *(pc++->ref);
+        }
+
+        L_SET_FIELD: {
+            Cell key = *pc++;
+            uint64_t offset = pc++->u64;
+            Cell r = _valueStack.back();
+            _valueStack.pop_back();
+            if (r.isTaggedPtr() && r.deref()->u64 == key.u64) {
+                r.deref()[offset] = _valueStack.back();
+                _valueStack.pop_back();
+            } else {
+                throw Mishap("Wrong type of record for field update").culprit("Value", r.u64);
+            }
             goto *(pc++->ref);
         }
 
@@ -298,8 +1312,13 @@ namespace poppy {
             }
             pc = _callStack.back().refCell;
             _callStack.pop_back();
+            currentClosure = _callStack.back().refCell;
+            _callStack.pop_back();
             currentProcedure = _callStack.back().refCell;
             _callStack.pop_back();
+            //  The callee may have left any number of values, so the code
+            //  after the call is checked as it is returned to.
+            checkStack(pc[-1]);
             goto *(pc++->ref);
         }
 
@@ -307,6 +1326,86 @@ namespace poppy {
             if ( DEBUG ) std::cout << "DONE!" << std::endl;
             return;
         }
+
+        //  The traced twins of the handlers, see startTracing.
+        T_ADD: traceStep(Instruction::ADD, pc); goto L_ADD;
+        T_ADD_SS: traceStep(Instruction::ADD_SS, pc); goto L_ADD_SS;
+        T_APPLY: traceStep(Instruction::APPLY, pc); goto L_APPLY;
+        T_CALL_GLOBAL: traceStep(Instruction::CALL_GLOBAL, pc); goto L_CALL_GLOBAL;
+        T_CALL_LOCAL: traceStep(Instruction::CALL_LOCAL, pc); goto L_CALL_LOCAL;
+        T_CALL_LOCAL_BOXED: traceStep(Instruction::CALL_LOCAL_BOXED, pc); goto L_CALL_LOCAL_BOXED;
+        T_CALL_NATIVE: traceStep(Instruction::CALL_NATIVE, pc); goto L_CALL_NATIVE;
+        T_CASE: traceStep(Instruction::CASE, pc); goto L_CASE;
+        T_CATCH: traceStep(Instruction::CATCH, pc); goto L_CATCH;
+        T_CHECK_STACK: traceStep(Instruction::CHECK_STACK, pc); goto L_CHECK_STACK;
+        T_EQ: traceStep(Instruction::EQ, pc); goto L_EQ;
+        T_EXPAND: traceStep(Instruction::EXPAND, pc); goto L_EXPAND;
+        T_FOR_RANGE_INIT: traceStep(Instruction::FOR_RANGE_INIT, pc); goto L_FOR_RANGE_INIT;
+        T_FOR_RANGE_NEXT: traceStep(Instruction::FOR_RANGE_NEXT, pc); goto L_FOR_RANGE_NEXT;
+        T_IF_EQ: traceStep(Instruction::IF_EQ, pc); goto L_IF_EQ;
+        T_IF_GT: traceStep(Instruction::IF_GT, pc); goto L_IF_GT;
+        T_IF_GTE: traceStep(Instruction::IF_GTE, pc); goto L_IF_GTE;
+        T_IF_LT: traceStep(Instruction::IF_LT, pc); goto L_IF_LT;
+        T_IF_LTE: traceStep(Instruction::IF_LTE, pc); goto L_IF_LTE;
+        T_IF_NEQ: traceStep(Instruction::IF_NEQ, pc); goto L_IF_NEQ;
+        T_IFNOT: traceStep(Instruction::IFNOT, pc); goto L_IFNOT;
+        T_IFSO: traceStep(Instruction::IFSO, pc); goto L_IFSO;
+        T_INLINED: traceStep(Instruction::INLINED, pc); goto L_INLINED;
+        T_GOTO: traceStep(Instruction::GOTO, pc); goto L_GOTO;
+        T_GT: traceStep(Instruction::GT, pc); goto L_GT;
+        T_GTE: traceStep(Instruction::GTE, pc); goto L_GTE;
+        T_HALT: traceStep(Instruction::HALT, pc); goto L_HALT;
+        T_GET_FIELD: traceStep(Instruction::GET_FIELD, pc); goto L_GET_FIELD;
+        T_LT: traceStep(Instruction::LT, pc); goto L_LT;
+        T_LTE: traceStep(Instruction::LTE, pc); goto L_LTE;
+        T_MAKE_CLOSURE: traceStep(Instruction::MAKE_CLOSURE, pc); goto L_MAKE_CLOSURE;
+        T_MUL: traceStep(Instruction::MUL, pc); goto L_MUL;
+        T_MUL_SS: traceStep(Instruction::MUL_SS, pc); goto L_MUL_SS;
+        T_NEQ: traceStep(Instruction::NEQ, pc); goto L_NEQ;
+        T_NEW_RECORD: traceStep(Instruction::NEW_RECORD, pc); goto L_NEW_RECORD;
+        T_PASSIGN: traceStep(Instruction::PASSIGN, pc); goto L_PASSIGN;
+        T_POP_CAPTURED_BOXED: traceStep(Instruction::POP_CAPTURED_BOXED, pc); goto L_POP_CAPTURED_BOXED;
+        T_POP_GLOBAL: traceStep(Instruction::POP_GLOBAL, pc); goto L_POP_GLOBAL;
+        T_POP_LOCAL: traceStep(Instruction::POP_LOCAL, pc); goto L_POP_LOCAL;
+        T_POP_LOCAL_BOXED: traceStep(Instruction::POP_LOCAL_BOXED, pc); goto L_POP_LOCAL_BOXED;
+        T_INIT_LOCAL_BOXED: traceStep(Instruction::INIT_LOCAL_BOXED, pc); goto L_INIT_LOCAL_BOXED;
+        T_PUSH_CAPTURED: traceStep(Instruction::PUSH_CAPTURED, pc); goto L_PUSH_CAPTURED;
+        T_PUSH_CAPTURED_BOXED: traceStep(Instruction::PUSH_CAPTURED_BOXED, pc); goto L_PUSH_CAPTURED_BOXED;
+        T_PUSH_GLOBAL: traceStep(Instruction::PUSH_GLOBAL, pc); goto L_PUSH_GLOBAL;
+        T_PUSH_LOCAL: traceStep(Instruction::PUSH_LOCAL, pc); goto L_PUSH_LOCAL;
+        T_PUSH_LOCAL_BOX: traceStep(Instruction::PUSH_LOCAL_BOX, pc); goto L_PUSH_LOCAL_BOX;
+        T_PUSH_LOCAL_BOXED: traceStep(Instruction::PUSH_LOCAL_BOXED, pc); goto L_PUSH_LOCAL_BOXED;
+        T_PUSHQ: traceStep(Instruction::PUSHQ, pc); goto L_PUSHQ;
+        T_PUSHS: traceStep(Instruction::PUSHS, pc); goto L_PUSHS;
+        T_RETURN: traceStep(Instruction::RETURN, pc); goto L_RETURN;
+        T_R_ADD: traceStep(Instruction::R_ADD, pc); goto L_R_ADD;
+        T_R_LOADQ: traceStep(Instruction::R_LOADQ, pc); goto L_R_LOADQ;
+        T_R_MOVE: traceStep(Instruction::R_MOVE, pc); goto L_R_MOVE;
+        T_R_MUL: traceStep(Instruction::R_MUL, pc); goto L_R_MUL;
+        T_R_SUB: traceStep(Instruction::R_SUB, pc); goto L_R_SUB;
+        T_SET_FIELD: traceStep(Instruction::SET_FIELD, pc); goto L_SET_FIELD;
+        T_SUB: traceStep(Instruction::SUB, pc); goto L_SUB;
+        T_SUB_SS: traceStep(Instruction::SUB_SS, pc); goto L_SUB_SS;
+        T_SWITCH: traceStep(Instruction::SWITCH, pc); goto L_SWITCH;
+        T_SWITCH_SPARSE: traceStep(Instruction::SWITCH_SPARSE, pc); goto L_SWITCH_SPARSE;
+        T_THROW: traceStep(Instruction::THROW, pc); goto L_THROW;
+        T_TRY: traceStep(Instruction::TRY, pc); goto L_TRY;
+
+        } catch (Mishap & m) {
+            if (!m.isExecutionTimeError()) {
+                throw;
+            }
+            _thrown = Cell::makeSymbol(symbolIndex(m.getMessage()));
+            Cell * handler = unwind(pc);
+            if (handler == nullptr) {
+                SourcePosition position;
+                if (sourcePosition(currentProcedure, pc - 1, position)) {
+                    m.culprit("Source", positionString(position));
+                }
+                throw;
+            }
+            pc = handler;
+        }
     }
 
     void Engine::initialise() {
@@ -316,15 +1415,158 @@ namespace poppy {
         init_or_run(nullptr, true);
     }
 
+    Cell * Engine::handlers(Cell * procedure, int & n) {
+        Cell * count = procedure + procedure[ProcedureLayout::LengthOffset].getSmall() - 1;
+        n = static_cast<int>(count->u64);
+        return count - n * HandlerLayout::Size;
+    }
+
+    const uint8_t * Engine::lineTable(Cell * procedure, std::size_t & nbytes, uint64_t & source) {
+        int n;
+        Cell * h = handlers(procedure, n);
+        nbytes = h[LineTableLayout::BytesOffset].u64;
+        source = h[LineTableLayout::SourceOffset].u64;
+        return reinterpret_cast<const uint8_t *>(h - LineTableLayout::Size - lineTableCells(nbytes));
+    }
+
+    bool Engine::sourcePosition(Cell * procedure, const Cell * pc, SourcePosition & position) const {
+        if (procedure == nullptr || pc < procedure + ProcedureLayout::InstructionsOffset || pc >= procedure + procedure[ProcedureLayout::QBlockOffset].getSmall()) {
+            return false;
+        }
+        std::size_t nbytes;
+        uint64_t source;
+        const uint8_t * table = lineTable(procedure, nbytes, source);
+        uint32_t offset;
+        return lookupLineTable(table, nbytes, pc - procedure, offset) && _runtime->_sources.resolve(source, offset, position);
+    }
+
+    //  A frame is the caller's procedure, closure and return address,
+    //  followed by the locals of the callee, so the frames are walked
+    //  down from the top of the call stack.
+    Cell * Engine::unwind(Cell * pc) {
+        Cell * procedure = currentProcedure;
+        Cell * closure = currentClosure;
+        std::size_t top = _callStack.size();
+        for (;;) {
+            uint64_t offset = pc - 1 - procedure;
+            int n;
+            Cell * h = handlers(procedure, n);
+            for (int i = 0; i < n; i++, h += HandlerLayout::Size) {
+                if (h[HandlerLayout::StartOffset].u64 <= offset && offset < h[HandlerLayout::EndOffset].u64) {
+                    _callStack.resize(top);
+                    currentProcedure = procedure;
+                    currentClosure = closure;
+                    return procedure + h[HandlerLayout::HandlerOffset].u64;
+                }
+            }
+            std::size_t base = top - (procedure + ProcedureLayout::NumLocalsOffset)->u64;
+            pc = _callStack[base - 1].refCell;
+            if (pc == &_exit_code[1]) {
+                return nullptr;
+            }
+            closure = _callStack[base - 2].refCell;
+            procedure = _callStack[base - 3].refCell;
+            top = base - 3;
+        }
+    }
+
     void Engine::run(Cell * pc) {
-        init_or_run(pc, false);
+        try {
+            init_or_run(pc, false);
+        } catch (Mishap & m) {
+            if (_trace) {
+                for (auto & line : traceLines(_trace_shown)) {
+                    m.culprit("Trace", line);
+                }
+            }
+            throw;
+        }
+    }
+
+    void Engine::relink(const std::map<Instruction, void *> & handlers) {
+        std::map<void *, Instruction> rev_map;
+        for (auto & [inst, addr] : _opcode_map) {
+            rev_map[addr] = inst;
+        }
+        Heap & heap = getHeap();
+        for (CellRef p = heap.firstObject(); p.isntNull(); p = heap.nextObject(p)) {
+            if (!p.isProcedure()) continue;
+            Cell * code_end = p.cellRef + p.cellRef[ProcedureLayout::QBlockOffset].getSmall();
+            for (Cell * c = p.cellRef + ProcedureLayout::InstructionsOffset; c < code_end; ) {
+                auto it = rev_map.find(c->ref);
+                if (it == rev_map.end()) {
+                    throw Unreachable();
+                }
+                int nargs;
+                unsigned int bitmask;
+                instructionInfo(it->second, nargs, bitmask);
+                c->ref = handlers.at(it->second);
+                c += 1 + nargs;
+            }
+        }
+        _exit_code[1] = Cell{ .ref = handlers.at(Instruction::HALT) };
+        _opcode_map = handlers;
+    }
+
+    void Engine::startTracing(std::size_t capacity, std::size_t shown) {
+        _trace = std::make_unique<TraceBuffer>(capacity);
+        _trace_shown = shown;
+        relink(_traced_map);
+    }
+
+    void Engine::stopTracing() {
+        relink(_untraced_map);
+        _trace.reset();
+    }
+
+    //  Each line is the procedure and offset, where in the source that is
+    //  if known, the instruction and its operands, then the depth of the
+    //  stack and the value on top.
+    std::vector<std::string> Engine::traceLines(std::size_t n) {
+        std::vector<std::string> lines;
+        if (!_trace) {
+            return lines;
+        }
+        for (const TraceEntry & e : _trace->last(n)) {
+            std::ostringstream line;
+            int nargs;
+            unsigned int bitmask;
+            const char * name = instructionInfo(e.inst, nargs, bitmask);
+            if (e.procedure == nullptr) {
+                line << "<exit>";
+                nargs = 0;
+            } else {
+                line << getSymbolName(CellRef(e.procedure).procName()) << "+" << e.offset;
+                SourcePosition position;
+                if (sourcePosition(e.procedure, e.procedure + e.offset, position)) {
+                    line << " (" << positionString(position) << ")";
+                }
+            }
+            line << " " << name;
+            for (int k = 0; k < nargs; k++) {
+                line << " " << e.procedure[e.offset + 1 + k].i64;
+            }
+            line << " [" << e.depth << "]";
+            if (e.depth != 0) {
+                line << " " << e.top.u64;
+            }
+            lines.push_back(line.str());
+        }
+        return lines;
+    }
+
+    void Engine::dumpTrace(std::ostream & out, std::size_t n) {
+        for (auto & line : traceLines(n)) {
+            out << line << std::endl;
+        }
     }
 
     void Engine::run(const std::string & main) {
-        auto & dictionary = _runtime->_dictionary;
-        Ident * idptr = dictionary[main];
-        Ident id = *idptr;
-        Cell m = id.value();
+        Ident * idptr = _runtime->_dictionary.lookup(main);
+        if (idptr == nullptr) {
+            throw Mishap("Entry point not declared").culprit("Entry point", main);
+        }
+        Cell m = idptr->value();
         if (m.isProcedure()) {
             run(m.deref());
         } else {
@@ -340,16 +1582,55 @@ namespace poppy {
             std::cout << "  Procedure" << std::endl;
             std::cout << "    ProcName : " << this->getSymbolName(CellRef(pk).procName()) << std::endl;
             std::cout << "    NumLocals: " << (pk + ProcedureLayout::NumLocalsOffset)->u64 << std::endl;
+            Cell stack = pk[ProcedureLayout::StackOffset];
+            std::cout << "    Stack    : " << StackNeeds::need(stack) << " needed, " << StackNeeds::growth(stack) << " more" << std::endl;
             int pl = (pk + ProcedureLayout::LengthOffset)->getSmall();
             std::cout << "    Length   : " << pl << std::endl;
             int qb = (pk + ProcedureLayout::QBlockOffset)->getSmall();
             std::cout << "    QBlock   : " << qb << std::endl;
-            for (int i = qb; i < pl; i++) {
+            int nhandlers;
+            Cell * h = handlers(pk, nhandlers);
+            std::size_t nbytes;
+            uint64_t source;
+            const Cell * lines = reinterpret_cast<const Cell *>(lineTable(pk, nbytes, source));
+            for (int i = qb; pk + i < lines; i++) {
                 int offset = (pk + i)->i64;
                 std::cout << "      offset[" << i - qb << "]: " << offset << " -> ";
                 Cell q = pk[offset];
                 std::cout << q.u64 << std::endl;
             }
+            std::cout << "    Lines    : " << nbytes << " bytes";
+            if (source != 0) {
+                std::cout << " from " << sourceName(source);
+            }
+            std::cout << std::endl;
+            for (int i = 0; i < nhandlers; i++, h += HandlerLayout::Size) {
+                std::cout << "    Handler  : [" << h[HandlerLayout::StartOffset].u64 << ", " << h[HandlerLayout::EndOffset].u64 << ") -> " << h[HandlerLayout::HandlerOffset].u64 << std::endl;
+            }
+        } else if (p.isClosure()) {
+            Cell * k = p.deref();
+            int ncaptured = k[ClosureLayout::NumCapturedOffset].getSmall();
+            std::cout << "  Closure" << std::endl;
+            std::cout << "    ProcName : " << this->getSymbolName(CellRef(k[ClosureLayout::ProcedureOffset].deref()).procName()) << std::endl;
+            for (int i = 0; i < ncaptured; i++) {
+                std::cout << "    Captured[" << i << "]: " << k[ClosureLayout::CapturedOffset + i].u64 << std::endl;
+            }
+        } else if (p.isRecordClass()) {
+            Cell * k = p.deref();
+            int nfields = k[RecordKeyLayout::NumFieldsOffset].getSmall();
+            std::cout << "  RecordClass" << std::endl;
+            std::cout << "    ClassName: " << this->getSymbolName(k[RecordKeyLayout::ClassNameOffset]) << std::endl;
+            for (int i = 0; i < nfields; i++) {
+                std::cout << "    Field[" << i << "] : " << this->getSymbolName(k[RecordKeyLayout::FieldNamesOffset + i]) << std::endl;
+            }
+        } else if (p.isRecord()) {
+            Cell * r = p.deref();
+            Cell * k = r->deref();
+            int nfields = k[RecordKeyLayout::NumFieldsOffset].getSmall();
+            std::cout << "  Record " << this->getSymbolName(k[RecordKeyLayout::ClassNameOffset]) << std::endl;
+            for (int i = 0; i < nfields; i++) {
+                std::cout << "    " << this->getSymbolName(k[RecordKeyLayout::FieldNamesOffset + i]) << ": " << r[RecordLayout::FieldsOffset + i].u64 << std::endl;
+            }
         } else {
             std::cout << p.u64 << std::endl;
         }
@@ -362,17 +1643,25 @@ namespace poppy {
         }
         std::cout << std::endl;
         std::cout << "Dictionary" << std::endl;
-        for (auto & [name, ident] : _runtime->_dictionary) {
+        _runtime->_dictionary.forEach([this](std::string_view name, Ident & ident) {
             std::cout << name << ":" << std::endl;
-            multiLineDisplay(ident->value());
-        }
+            multiLineDisplay(ident.value());
+        });
     }
 
     void Engine::showObject(const CellRef p) {
         if (p.isProcedure()) {
             Cell c = p.procName();
-            const std::string & name = this->getSymbolName(c);
+            std::string_view name = this->getSymbolName(c);
             std::cout << "<procedure " << name << ">";
+        } else if (p.isClosure()) {
+            Cell * proc = p.cellRef[ClosureLayout::ProcedureOffset].deref();
+            std::cout << "<closure " << this->getSymbolName(CellRef(proc).procName()) << ">";
+        } else if (p.isRecordClass()) {
+            std::cout << "<recordclass " << this->getSymbolName(p.cellRef[RecordKeyLayout::ClassNameOffset]) << ">";
+        } else if (p.isRecord()) {
+            Cell * k = p.cellRef->deref();
+            std::cout << "<record " << this->getSymbolName(k[RecordKeyLayout::ClassNameOffset]) << ">";
         } else {
             std::cout << "<" << std::hex << p.u64() << std::dec << ">";
         }
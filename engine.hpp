@@ -10,6 +10,7 @@
 #include <ios>
 #include <map>
 #include <memory>
+#include <unordered_map>
 
 #include "itemizer.hpp"
 #include "itemrole.hpp"
@@ -18,27 +19,79 @@
 #include "mishap.hpp"
 #include "layout.hpp"
 #include "xroots.hpp"
+#include "symboltable.hpp"
+#include "dictionary.hpp"
+#include "compactcode.hpp"
+#include "valuestack.hpp"
+#include "trace.hpp"
+#include "native.hpp"
+#include "linetable.hpp"
 
 namespace poppy {
 
 enum class Instruction {
     ADD,
+    ADD_SS,
+    APPLY,
     CALL_GLOBAL,
     CALL_LOCAL,
+    CALL_LOCAL_BOXED,
+    CALL_NATIVE,
+    CASE,
+    CATCH,
+    CHECK_STACK,
+    EQ,
+    EXPAND,
+    FOR_RANGE_INIT,
+    FOR_RANGE_NEXT,
     GOTO,
+    GT,
+    GTE,
     HALT,
+    IF_EQ,
+    IF_GT,
+    IF_GTE,
+    IF_LT,
+    IF_LTE,
+    IF_NEQ,
     IFNOT,
     IFSO,
+    INIT_LOCAL_BOXED,
+    INLINED,
+    GET_FIELD,
+    LT,
+    LTE,
+    MAKE_CLOSURE,
     MUL,
+    MUL_SS,
+    NEQ,
+    NEW_RECORD,
     PASSIGN,
+    POP_CAPTURED_BOXED,
     POP_GLOBAL,
     POP_LOCAL,
+    POP_LOCAL_BOXED,
+    PUSH_CAPTURED,
+    PUSH_CAPTURED_BOXED,
     PUSH_GLOBAL,
     PUSH_LOCAL,
+    PUSH_LOCAL_BOX,
+    PUSH_LOCAL_BOXED,
     PUSHQ,
     PUSHS,
     RETURN,
+    R_ADD,
+    R_LOADQ,
+    R_MOVE,
+    R_MUL,
+    R_SUB,
+    SET_FIELD,
     SUB,
+    SUB_SS,
+    SWITCH,
+    SWITCH_SPARSE,
+    THROW,
+    TRY,
 };
 
 // Required for garbage collection - using this info it is possible to scan a
@@ -46,33 +99,114 @@ enum class Instruction {
 // has and the bitmask indicates which arguments are tagged pointers.
 const char * instructionInfo( const Instruction inst, int & nargs, unsigned int & bitmask );
 
+//  What the operands of an instruction hold, for code that must rewrite
+//  them: a branch offset relative to the operand, an Ident pointer, a
+//  literal cell (which may be a heap reference), a frame slot counted
+//  down from the top of the frame, a NativeFunction pointer, or anything
+//  else, which is position independent.
+enum class OperandKind {
+    Raw,
+    Branch,
+    Ident,
+    Literal,
+    Local,
+    Native
+};
+
+OperandKind operandKind( const Instruction inst, int n );
+
+//  The instruction that a quickened instruction was rewritten from, see
+//  ArithmeticFeedback, or the instruction itself.
+Instruction genericForm( const Instruction inst );
+
+//  The instruction sets a CodePlanter can target. The register tier adds
+//  R_ instructions whose operands are all frame slots, so that arithmetic
+//  on locals does not go through the value stack. Both tiers share frames
+//  and the calling convention, so procedures of either tier call each
+//  other freely, passing arguments and results on the value stack.
+enum class CodeTier {
+    Stack,
+    Register
+};
+
+//  The stack needs of a stretch of code that runs without calls: how many
+//  values must be on the stack when it starts and how many more it may
+//  push. They are packed into one word, which is found in the procedure
+//  header for the stretch at its start, in the last operand of a call for
+//  the stretch after it returns, and in a CHECK_STACK operand for a loop
+//  or join whose depth varies.
+class StackNeeds {
+public:
+    static const uint64_t Limit = uint64_t(1) << 32;
+    static Cell make(uint64_t need, uint64_t growth) { return Cell{ .u64 = need << 32 | growth }; }
+    static uint64_t need(Cell word) { return word.u64 >> 32; }
+    static uint64_t growth(Cell word) { return word.u64 & (Limit - 1); }
+};
+
+//  The operand of ADD, SUB and MUL is type feedback: how many times the
+//  site has found two Smalls. When that reaches QuickenAfter the site is
+//  rewritten to its _SS form, which guards both operands with one test. If
+//  the guard fails, the site goes back to the generic form for good and
+//  the feedback becomes Unstable.
+class ArithmeticFeedback {
+public:
+    static const uint64_t QuickenAfter = 16;
+    static const uint64_t Unstable = ~uint64_t(0);
+};
+
 class Runtime {
     friend class Engine;
 private:
-    std::map<std::string, RefIdent> _dictionary;
     Heap _heap;
-    std::map<std::size_t, std::string> _symbols;
-    std::map<const std::string, std::size_t> _symbolIndex;
+    SymbolTable _symbols;
+    Dictionary _dictionary;
+    std::vector<std::unique_ptr<CompactLibrary>> _compact;
+    NativeRegistry _natives;
+    SourceRegistry _sources;
+    //  The INLINED markers of the code that inlined each global.
+    std::unordered_map<Ident *, std::vector<Cell *>> _inline_sites;
+public:
+    Runtime() : _dictionary(_symbols) {}
 };
 
 // TODO: This will become the couroutine class.
 class Engine {
     friend class CodePlanter;
+    friend class BytecodeCache;
+    friend class CompactLibrary;
 private:
     // TODO: This should be moved into the runtime class.
     std::map<Instruction, void *> _opcode_map;
-    Cell _exit_code[1];
+    Cell _exit_code[2];
+
+    //  The handlers, and their twins that record each instruction before
+    //  running it. _opcode_map is one or the other, as is all the code.
+    std::map<Instruction, void *> _untraced_map;
+    std::map<Instruction, void *> _traced_map;
+    std::unique_ptr<TraceBuffer> _trace;
+    std::size_t _trace_shown = 0;
 
 private:
-    std::vector<Cell> _valueStack;
+    ValueStack _valueStack;
     
     Cell * currentProcedure;
+    Cell * currentClosure;
     std::vector<Cell> _callStack;
 
     std::shared_ptr<Runtime> _runtime;
 
     XRootsRegistry _xrootsRegistry;
 
+    CodeTier _default_tier = CodeTier::Stack;
+    std::size_t _inline_limit = 16;
+
+    //  Where a native that is not fast was called from, while it runs.
+    Cell * _native_safepoint = nullptr;
+
+    //  The value being thrown, from when a handler is found until its
+    //  CATCH pushes it.
+    Cell _thrown;
+
 public:
     Engine() {
         _runtime = std::make_shared<Runtime>();
@@ -81,27 +215,116 @@ public:
     ~Engine() = default;
 
 public:
-    const std::string & symbol(int index) const { return _runtime->_symbols[index]; }
-    int symbolIndex(const std::string & name) const { 
-        auto it = _runtime->_symbolIndex.find(name);
-        if (it == _runtime->_symbolIndex.end()) {
-            std::size_t n = _runtime->_symbols.size();
-            _runtime->_symbols[n] = name;
-            _runtime->_symbolIndex[name] = n;
-            return n;
-        } else {
-            return it->second;
-        }
-    }
+    std::string_view symbol(int index) const { return _runtime->_symbols.name(index); }
+    int symbolIndex(std::string_view name) const { return _runtime->_symbols.intern(name); }
+    SymbolTable & getSymbolTable() { return _runtime->_symbols; }
 
 public:
     Heap & getHeap() { return _runtime->_heap; }
-    std::map<std::string, RefIdent> & getDictionary() { return _runtime->_dictionary; }
+    Dictionary & getDictionary() { return _runtime->_dictionary; }
     void declareGlobal(const std::string & name);
+    Cell * declareRecordClass(const std::string & name, const std::vector<std::string> & fields);
+
+    //  Keeps a library of compact procedures for as long as the engine.
+    CompactLibrary & addCompactLibrary();
+
+    //  The procedure itself, expanded, if this is a stub.
+    Cell * expanded(Cell * procedure);
+
+public:
+    //  Registers a native function and binds the global of the same name
+    //  to a procedure that calls it, see NativeRegistry.
+    const NativeFunction * defineNative(const std::string & name, int arity, NativeCode code, bool fast = false);
+
+    //  Returns nullptr if there is no native of that name.
+    const NativeFunction * native(const std::string & name) const { return _runtime->_natives.lookup(name); }
+
+    //  The pc of the CALL_NATIVE whose native is running, if it is not a
+    //  fast one, else nullptr. This is the safepoint at which a native may
+    //  allocate, and so collect: a collector that moves the code updates
+    //  it, and the engine resumes from it.
+    Cell *& nativeSafepoint() { return _native_safepoint; }
+
+public:
+    //  Registers a source, so that the line tables of code planted from it
+    //  can be resolved. The index is for CodePlanter::setSource.
+    uint64_t addSource(const SourceBuffer & source) { return _runtime->_sources.add(source); }
+
+    //  Empty if there is no such source.
+    std::string_view sourceName(uint64_t source) const { return _runtime->_sources.name(source); }
+
+    //  Where the instruction at pc in a procedure came from. Returns false
+    //  if pc is not in its code or its line table does not say.
+    bool sourcePosition(Cell * procedure, const Cell * pc, SourcePosition & position) const;
+
+public:
+    //  The tier of new CodePlanters.
+    CodeTier defaultTier() const { return _default_tier; }
+    void setDefaultTier(CodeTier tier) { _default_tier = tier; }
+
+    //  Calls to global procedures of at most this many instruction cells
+    //  are inlined by new CodePlanters, see CodePlanter::tryInline. Zero
+    //  turns inlining off.
+    std::size_t inlineLimit() const { return _inline_limit; }
+    void setInlineLimit(std::size_t cells) { _inline_limit = cells; }
+
+public:
+    //  Sets a global. Code that inlined its previous value is deoptimised
+    //  first, so that it calls the new value instead.
+    void assign(Ident * ident, Cell value) {
+        if (ident->isInlined() && ident->value().u64 != value.u64) {
+            deoptimise(ident);
+        }
+        ident->value() = value;
+    }
+
+    //  Registers the inlined code whose INLINED marker this is, or
+    //  deoptimises it at once if the global has already changed.
+    void registerInlineSite(Cell * marker);
+
+private:
+    void quicken(Cell * pc, Instruction inst);
+    void despecialise(Cell * pc, Instruction inst);
+
+private:
+    void deoptimise(Ident * ident);
+    void deoptimiseSite(Cell * marker);
 
 private:
     void init_or_run(Cell * pc, bool init);
 
+    //  The handler table of a procedure and the number of handlers in
+    //  it, see HandlerLayout.
+    static Cell * handlers(Cell * procedure, int & n);
+
+    //  The varints of the line table of a procedure, how many bytes there
+    //  are and the source they refer to, see LineTableLayout.
+    static const uint8_t * lineTable(Cell * procedure, std::size_t & nbytes, uint64_t & source);
+
+    //  Finds the first handler that covers the instruction before pc, in
+    //  the current procedure or in its callers back to the start of run,
+    //  and pops the frames above it. Returns where to carry on, or nullptr,
+    //  having changed nothing, if there is no handler. Nothing is done on
+    //  entry to a try block, so the cost is all here.
+    Cell * unwind(Cell * pc);
+    Cell * box(Cell * slot);
+
+    void traceStep(Instruction inst, Cell * pc) {
+        uint64_t depth = _valueStack.size();
+        _trace->record(currentProcedure, pc - 1, inst, depth, depth == 0 ? Cell{} : _valueStack.back());
+    }
+
+    //  Switches the engine, its code and its _opcode_map to other handlers.
+    void relink(const std::map<Instruction, void *> & handlers);
+
+    //  Checked once per stretch, so that pushes and pops need not be.
+    void checkStack(Cell word) {
+        if (_valueStack.size() < StackNeeds::need(word)) {
+            throw Mishap("Too few values on the stack").culprit("Needed", static_cast<int64_t>(StackNeeds::need(word))).culprit("Found", static_cast<int64_t>(_valueStack.size()));
+        }
+        _valueStack.ensure(StackNeeds::growth(word));
+    }
+
 public:
     void initialise();
 
@@ -109,6 +332,20 @@ public:
 
     void run(const std::string & main);
 
+public:
+    //  Records the instructions executed into a ring buffer of the given
+    //  capacity. The last shown of them are added to any Mishap that
+    //  escapes from run. Tracing relinks the code on the heap to traced
+    //  handlers, so the untraced engine pays nothing for it, but it must
+    //  not be switched while code is being planted or run.
+    void startTracing(std::size_t capacity, std::size_t shown = 16);
+    void stopTracing();
+    const TraceBuffer * trace() const { return _trace.get(); }
+
+    //  The last n instructions traced, oldest first, one per line.
+    std::vector<std::string> traceLines(std::size_t n);
+    void dumpTrace(std::ostream & out, std::size_t n);
+
 public:
     void debugDisplay();
 
@@ -119,9 +356,9 @@ private:
 public:
     void showHeap();
 
-    std::string & getSymbolName(Cell c) {
+    std::string_view getSymbolName(Cell c) {
         int n = c.getSymbolIndex();
-        return _runtime->_symbols[n];
+        return _runtime->_symbols.name(n);
     }
 };
 
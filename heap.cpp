@@ -10,8 +10,8 @@ namespace poppy {
 
     Heap::Heap()
     {
-        size_t capacity = 1024;
-        _block_start = (Cell *)aligned_alloc(sizeof(Cell), capacity);
+        size_t capacity = 2048;
+        _block_start = (Cell *)aligned_alloc(sizeof(Cell), capacity * sizeof(Cell));
         if (_block_start == nullptr ) {
             throw std::runtime_error("Cannot allocate heap store");
         }
@@ -22,7 +22,23 @@ namespace poppy {
     }
 
     CellRef Heap::nextObject(CellRef keyCell) {
+        if (keyCell.isRecord()) {
+            Cell * recordKey = keyCell->deref();
+            int nfields = recordKey[RecordKeyLayout::NumFieldsOffset].getSmall();
+            return firstObjectFrom(keyCell.cellRef + RecordLayout::FieldsOffset + nfields);
+        }
         switch (keyCell.keyCode()) {
+            case KeyCode::KeyKeyCode: {
+                int nfields = keyCell.offset(RecordKeyLayout::NumFieldsOffset)->getSmall();
+                return firstObjectFrom(keyCell.cellRef + RecordKeyLayout::FieldNamesOffset + nfields);
+            }
+            case KeyCode::ClosureKeyCode: {
+                int ncaptured = keyCell.offset(ClosureLayout::NumCapturedOffset)->getSmall();
+                return firstObjectFrom(keyCell.cellRef + ClosureLayout::CapturedOffset + ncaptured);
+            }
+            case KeyCode::BoxKeyCode: {
+                return firstObjectFrom(keyCell.cellRef + BoxLayout::Size);
+            }
             case KeyCode::ProcedureKeyCode: {
                 int length = keyCell.offset(ProcedureLayout::LengthOffset)->getSmall();
                 Cell * p = keyCell.cellRef + length;
@@ -40,7 +56,10 @@ namespace poppy {
     }
 
     CellRef Heap::firstObject() {
-        Cell * p = _block_start;
+        return firstObjectFrom(_block_start);
+    }
+
+    CellRef Heap::firstObjectFrom(Cell * p) {
         while (p < _working_tip) {
             if (p->isKey())
                 return CellRef(p);
@@ -49,6 +68,15 @@ namespace poppy {
         return CellRef();
     }
 
+    Cell * Heap::allocate(size_t n) {
+        if (_working_tip + n >= _working_limit) {
+            throw std::runtime_error("Heap overflow");
+        }
+        Cell * result = _working_tip;
+        _working_tip += n;
+        return result;
+    }
+
     Builder::Builder(Heap & heap) : 
         _heap(heap)
     {
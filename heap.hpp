@@ -24,6 +24,13 @@ namespace poppy {
     public:
         CellRef nextObject(CellRef keyPtr);
         CellRef firstObject();
+
+    public:
+        //  Allocates n cells for an object built at run-time.
+        Cell * allocate(size_t n);
+
+    private:
+        CellRef firstObjectFrom(Cell * p);
     };
 
     class Builder {
@@ -4,33 +4,26 @@
 
 namespace poppy {
 
-Item::Item() :
-    _name(""),
-    _itemCode(ItemCode::unknown_code)
+Item::Item( ItemCode code, uint32_t payload, std::size_t position ) :
+    _payload(payload),
+    _code_and_position(
+        static_cast<uint32_t>(code) |
+        static_cast<uint32_t>(position < MaxPosition ? position : MaxPosition) << 8
+    )
 {}
 
-Item::Item( const std::string & name, ItemCode code, bool lookup ) :
-    _name(name),
-    _itemCode(code)
-{
-    if (lookup) {
-        lookupCode();
-    }
+ItemRole Item::itemRole() const {
+    return itemCodeToItemRole(itemCode());
 }
 
-void Item::lookupCode() {
-    ItemCode code;
-    if (lookupItemCode(_name, code)) {
-        _itemCode = code;
+std::string Item::nameString( const SymbolTable & symbols ) const {
+    if (itemCode() == ItemCode::int_code) {
+        return std::to_string(_payload);
+    } else if (hasSymbol()) {
+        return std::string(symbols.name(_payload));
+    } else {
+        return std::string();
     }
 }
 
-ItemCode Item::itemCode() {
-    return this->_itemCode;
-}
-
-ItemRole Item::itemRole() {
-    return itemCodeToItemRole(this->_itemCode);
-}
-
 } // namespace poppy
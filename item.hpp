@@ -1,41 +1,60 @@
 #ifndef ITEM_HPP
 #define ITEM_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "itemattrs.hpp"
 #include "itemrole.hpp"
+#include "symboltable.hpp"
 
 namespace poppy {
 
+//  A zero-copy view of an item, as a slice of the source buffer. The text
+//  of an int_code slice still includes any '_' digit separators.
+struct ItemSlice {
+    ItemCode code;
+    std::string_view text;
+    std::size_t offset;
+};
+
+/*  An Item is a token as a compact, trivially copyable value. Names are
+    interned into the runtime's symbol table by the itemizer, so the
+    payload of a word or keyword item is its symbol index. The payload
+    of an int_code item is its value; integer literals too big for 32 bits
+    are bigint_code items whose payload is the symbol of their digits.
+    The source position is a byte offset that saturates at MaxPosition.
+*/
 class Item {
 private:
-    std::string 			_name;			//	mandatory
-    
-public:
-    ItemCode 				_itemCode;		//	mandatory
-    
+    uint32_t _payload;
+    uint32_t _code_and_position;
+
 public:
-	inline std::string & nameString() { return this->_name; }
+    static constexpr std::size_t MaxPosition = 0xFFFFFF;
 
 public:
-	Item();
-	Item( const std::string & name, ItemCode code, bool lookup );
+	Item() : _payload(0), _code_and_position(static_cast<uint32_t>(ItemCode::unknown_code)) {}
+	Item( ItemCode code, uint32_t payload, std::size_t position );
 
 public:
-	void lookupCode();
-	ItemCode itemCode();
-	ItemRole itemRole();
-	bool item_is_neg_num();
-	bool item_is_signed_num();
-	int item_int();
-	bool item_is_prefix();
-	bool item_is_postfix( bool break_on_nl );
-	bool item_is_anyfix();
-	bool item_is_binary();
-	bool item_is_name();
+	inline ItemCode itemCode() const { return static_cast<ItemCode>(_code_and_position & 0xFF); }
+	inline std::size_t position() const { return _code_and_position >> 8; }
+	inline uint32_t payload() const { return _payload; }
+	inline uint32_t symbol() const { return _payload; }
+	inline uint32_t intValue() const { return _payload; }
+	inline bool hasSymbol() const { return itemCode() != ItemCode::int_code && itemCode() != ItemCode::unknown_code; }
+	ItemRole itemRole() const;
+
+	//	The source text of the item, without '_' digit separators.
+	std::string nameString( const SymbolTable & symbols ) const;
 };
 
+static_assert(sizeof(Item) == 8, "Items should be 8 bytes");
+static_assert(std::is_trivially_copyable<Item>::value, "Items should be trivially copyable");
+
 } // namespace poppy
 
 #endif
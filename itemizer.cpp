@@ -1,9 +1,10 @@
+#include <limits>
 #include <optional>
-#include <sstream>
+#include <string>
 
 #include "itemizer.hpp"
 #include "item.hpp"
-#include <ctype.h>
+#include "charclass.hpp"
 
 namespace poppy {
 
@@ -12,13 +13,14 @@ Itemizer::~Itemizer()
 }
 
 std::optional<char> Itemizer::getChar() {
-    if (_char) {
-        char ch = _char.value();
-        _char.reset();
+    if (!_pending.empty()) {
+        char ch = _pending.front();
+        _pending.erase(0, 1);
         return ch;
     } else {
         char ch;
-        if (_source >> ch ) {
+        if (*_source >> ch ) {
+            _offset += 1;
             return ch;
         } else {
             return std::optional<char>(); 
@@ -27,12 +29,13 @@ std::optional<char> Itemizer::getChar() {
 }
 
 std::optional<char> Itemizer::peekChar() {
-    if (_char) {
-        return _char;
+    if (!_pending.empty()) {
+        return _pending.front();
     } else {
         char ch;
-        if (_source >> ch ) {
-            _char = ch;
+        if (*_source >> ch ) {
+            _offset += 1;
+            _pending += ch;
             return ch;
         } else {
             return std::optional<char>(); 
@@ -41,35 +44,56 @@ std::optional<char> Itemizer::peekChar() {
 }
 
 std::optional<char> Itemizer::eatWhiteSpace() {
-    if (_char) {
-        if (isspace(*_char)) {
-            _char.reset();
+    while (!_pending.empty()) {
+        if (isSpaceChar(_pending.front())) {
+            _pending.erase(0, 1);
         } else {
-            return _char;
+            return _pending.front();
         }
     }
     char ch;
-    while (_source >> ch) {
-        if (!isspace(ch)) {
-            _char = ch;
-            return _char;
+    while (*_source >> ch) {
+        _offset += 1;
+        if (!isSpaceChar(ch)) {
+            _pending += ch;
+            return ch;
         } 
     }
     return std::optional<char>();
 }
 
 void Itemizer::pushbackChar(char ch) {
-    _char = ch;
+    _pending.insert(_pending.begin(), ch);
 }
 
 void Itemizer::skipChar() {
-    if (_char) {
-        _char.reset();
+    if (!_pending.empty()) {
+        _pending.erase(0, 1);
     } else {
         getChar();
     }
 }
 
+//  The longest sign word in itemattrs.json, which is "!<=>".
+static constexpr std::size_t MaxSignWord = 4;
+
+//  A run of sign characters is split into the sign words that are known
+//  to itemattrs.json, longest first, so that a*-1 is a * - 1 rather than
+//  a *- 1. A sign character that starts no known word is an item by itself.
+static std::size_t signWordLength(const char * p, const char * end) {
+    std::size_t run = 1;
+    while (run < MaxSignWord && p + run < end && isSignChar(p[run])) {
+        run += 1;
+    }
+    for (std::size_t n = run; n > 1; n--) {
+        ItemCode code;
+        if (lookupItemCode(std::string_view(p, n), code)) {
+            return n;
+        }
+    }
+    return 1;
+}
+
 bool Itemizer::nextItem(Item & item) {
     std::optional<Item> optitem = nextItem();
     bool result = optitem.has_value();
@@ -79,41 +103,123 @@ bool Itemizer::nextItem(Item & item) {
     return result;
 }
 
+bool Itemizer::nextSlice(ItemSlice & slice) {
+    const char * end = _limit;
+    const char * p = skipSpace(_cursor, end);
+    if (p == end) {
+        _cursor = p;
+        return false;
+    }
+
+    const char * start = p;
+    char ch = *p++;
+    ItemCode code = ItemCode::word_code;
+    if (isIdentStartChar(ch)) {
+        p = skipIdent(p, end);
+    } else if (isDigitChar(ch)) {
+        p = skipNumber(p, end);
+        code = ItemCode::int_code;
+    } else if (isSignChar(ch)) {
+        p = start + signWordLength(start, end);
+    }
+    _cursor = p;
+
+    slice.text = std::string_view(start, p - start);
+    slice.offset = start - _buffer;
+    slice.code = code;
+    if (code == ItemCode::word_code) {
+        ItemCode keyword;
+        if (lookupItemCode(slice.text, keyword)) {
+            slice.code = keyword;
+        }
+    }
+    return true;
+}
+
+Item Itemizer::makeInt(std::string_view text, std::size_t offset) {
+    std::string digits;
+    digits.reserve(text.size());
+    uint64_t value = 0;
+    bool fits = true;
+    for (char ch : text) {
+        if (ch != '_') {
+            digits += ch;
+            value = value * 10 + (ch - '0');
+            fits = fits && value <= std::numeric_limits<uint32_t>::max();
+        }
+    }
+    if (fits) {
+        return Item(ItemCode::int_code, static_cast<uint32_t>(value), offset);
+    } else {
+        return Item(ItemCode::bigint_code, _symbols.intern(digits), offset);
+    }
+}
+
+Item Itemizer::makeWord(std::string_view text, ItemCode code, std::size_t offset) {
+    return Item(code, _symbols.intern(text), offset);
+}
+
 std::optional<Item> Itemizer::nextItem() {
     if (_optitem) {
         Item item = _optitem.value();
         _optitem.reset();
         return item;
-    } else {
-        std::stringstream sofar;
-        std::optional<char> optch = eatWhiteSpace();
-        if (optch.has_value()) {
-            char ch = optch.value();
-            if (ch == '_' or isalpha(ch)) {
-                while ((optch = peekChar()) and (optch.value() == '_' or isalnum(optch.value()))) {
-                    sofar << optch.value();
-                    skipChar();
-                }
-                return Item(sofar.str(), ItemCode::word_code, true);
-            } else if (isdigit(ch)) {
-                while ((optch = peekChar()) and (optch.value() == '_' or isdigit(optch.value()))) {
-                    if (optch.value() == '_') {
-                        skipChar();
-                    } else {
-                        sofar << optch.value();
-                        skipChar();
-                    }
-                }
-                return Item(sofar.str(), ItemCode::int_code, true);
-            } else {
-                sofar << optch.value();
-                skipChar();
-                return Item(sofar.str(), ItemCode::word_code, true);
-            }
-        } else {
+    } else if (_replay != nullptr) {
+        if (_replay == _replay_end) {
             return std::optional<Item>();
         }
+        return *_replay++;
+    } else if (_source == nullptr) {
+        ItemSlice slice;
+        if (!nextSlice(slice)) {
+            return std::optional<Item>();
+        } else if (slice.code == ItemCode::int_code) {
+            return makeInt(slice.text, slice.offset);
+        } else {
+            return makeWord(slice.text, slice.code, slice.offset);
+        }
+    } else {
+        return nextStreamItem();
+    }
+}
+
+std::optional<Item> Itemizer::nextStreamItem() {
+    std::string sofar;
+    std::optional<char> optch = eatWhiteSpace();
+    if (!optch.has_value()) {
+        return std::optional<Item>();
+    }
+    //  The first character of the item is the first that is pending.
+    std::size_t start = _offset - _pending.size();
+    char ch = optch.value();
+    if (isIdentStartChar(ch)) {
+        while ((optch = peekChar()) and isIdentChar(optch.value())) {
+            sofar += optch.value();
+            skipChar();
+        }
+    } else if (isDigitChar(ch)) {
+        while ((optch = peekChar()) and isNumberChar(optch.value())) {
+            sofar += optch.value();
+            skipChar();
+        }
+        return makeInt(sofar, start);
+    } else if (isSignChar(ch)) {
+        while (sofar.size() < MaxSignWord and (optch = peekChar()) and isSignChar(optch.value())) {
+            sofar += optch.value();
+            skipChar();
+        }
+        std::size_t n = signWordLength(sofar.data(), sofar.data() + sofar.size());
+        _pending.insert(0, sofar, n);
+        sofar.resize(n);
+    } else {
+        sofar += ch;
+        skipChar();
+    }
+    ItemCode code;
+    if (!lookupItemCode(sofar, code)) {
+        code = ItemCode::word_code;
     }
+    return makeWord(sofar, code, start);
 }
 
 void Itemizer::pushback(const Item & item) {
@@ -124,7 +230,7 @@ std::optional<Item> Itemizer::tryNextItem(ItemCode code) {
     if (!_optitem) {
         _optitem = nextItem();
     }
-    if (_optitem->_itemCode == code) {
+    if (_optitem && _optitem->itemCode() == code) {
         Item item = _optitem.value();
         _optitem.reset();
         return item;
@@ -3,29 +3,70 @@
 
 #include <istream>
 #include <optional>
+#include <string>
 
 #include "item.hpp"
+#include "sourcebuffer.hpp"
+#include "symboltable.hpp"
 
 namespace poppy {    
 
+//  The itemizer works in one of three modes. Given a stream it reads one
+//  character at a time. Given a SourceBuffer it walks a raw pointer over
+//  the buffer and can hand out items as slices of it, see nextSlice.
+//  Either way item names are interned into the given symbol table. Given
+//  a range of items it replays them, which only reads the symbol table.
 class Itemizer {
 private:
-    std::optional<char> _char;
-    std::istream & _source;
+    SymbolTable & _symbols;
+    std::string _pending;          //  Read from the stream but not used yet.
+    std::istream * _source = nullptr;
+    std::size_t _offset = 0;       //  Characters read from the stream.
     std::optional<Item> _optitem;
 
+    //  Buffered mode.
+    const char * _buffer = nullptr;
+    const char * _cursor = nullptr;
+    const char * _limit = nullptr;
+
+    //  Replay mode.
+    const Item * _replay = nullptr;
+    const Item * _replay_end = nullptr;
+
 private:
     std::optional<char> getChar();
     std::optional<char> peekChar();
     void skipChar();
     void pushbackChar(char ch);
     std::optional<char> eatWhiteSpace();
+    std::optional<Item> nextStreamItem();
+    Item makeInt(std::string_view text, std::size_t offset);
+    Item makeWord(std::string_view text, ItemCode code, std::size_t offset);
     
 public:
-    Itemizer(std::istream & source) : _source(source) {}
+    Itemizer(std::istream & source, SymbolTable & symbols) : 
+        _symbols(symbols),
+        _source(&source) 
+    {}
+
+    Itemizer(const SourceBuffer & source, SymbolTable & symbols) : 
+        _symbols(symbols),
+        _buffer(source.begin()),
+        _cursor(source.begin()),
+        _limit(source.end())
+    {}
+
+    Itemizer(const Item * begin, const Item * end, SymbolTable & symbols) :
+        _symbols(symbols),
+        _replay(begin),
+        _replay_end(end)
+    {}
     
     ~Itemizer();
 
+    //  Buffered mode only. The slice is only valid while the SourceBuffer is.
+    bool nextSlice(ItemSlice & slice);
+
     bool nextItem(Item & item);
 
     std::optional<Item> nextItem();
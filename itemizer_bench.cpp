@@ -0,0 +1,188 @@
+/*  Itemizer throughput benchmark.
+
+    Usage: itemizer_bench [FILE] [REPEATS]
+
+    Builds a source of a few megabytes (by repeating FILE, or a built-in
+    sample that exercises long identifiers, '_' separated numbers, deep
+    indentation and adjacent operators) and reports MB/s for:
+
+        stream      - Itemizer over a std::istream, one character at a time
+        libc        - pointer walk using isspace/isalnum/isdigit per byte
+        table       - pointer walk using the character class table
+        simd        - pointer walk using the vectorised run scanners
+        nextSlice   - the buffered Itemizer, including keyword lookup,
+                      which scans runs with the table
+        nextItem    - the buffered Itemizer, also interning names
+
+    The libc, table and simd loops itemize in the same way as
+    Itemizer::nextSlice minus the keyword lookup, except that they take a
+    whole run of sign characters as one item, and their item counts are
+    checked against each other. So are the counts of the three Itemizers,
+    which must split sign characters into the same words.
+*/
+
+#include <chrono>
+#include <cstring>
+#include <ctype.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "charclass.hpp"
+#include "itemizer.hpp"
+#include "sourcebuffer.hpp"
+
+using namespace poppy;
+
+static const char * sample =
+    "define fibonacci_sequence_generator( upper_limit_of_the_sequence ):\n"
+    "    var previous_fibonacci_number := 0;\n"
+    "    var current_fibonacci_number := 1;\n"
+    "    for index_into_the_sequence from 1 by 1 to 1_000_000_000 do\n"
+    "        if current_fibonacci_number > upper_limit_of_the_sequence then\n"
+    "            return previous_fibonacci_number\n"
+    "        endif;\n"
+    "        current_fibonacci_number + previous_fibonacci_number -> previous_fibonacci_number;\n"
+    "    endfor\n"
+    "enddefine\n"
+    "\n"
+    "def foo(x):\n"
+    "    var y:=-x;\n"
+    "    y*-1 + 1_001\n"
+    "end\n\n";
+
+static std::string makeSource(const std::string & seed, std::size_t target) {
+    std::string source;
+    source.reserve(target + seed.size());
+    while (source.size() < target) {
+        source += seed;
+    }
+    return source;
+}
+
+static const char * signs = "!#$%&*+-./:<=>?@\\^|~";
+
+typedef std::size_t (*Scanner)(const char * p, const char * end);
+
+static std::size_t scanLibc(const char * p, const char * end) {
+    std::size_t n = 0;
+    for (;;) {
+        while (p < end && isspace(static_cast<unsigned char>(*p))) p += 1;
+        if (p == end) return n;
+        unsigned char ch = *p++;
+        if (ch == '_' or isalpha(ch)) {
+            while (p < end && (*p == '_' or isalnum(static_cast<unsigned char>(*p)))) p += 1;
+        } else if (isdigit(ch)) {
+            while (p < end && (*p == '_' or isdigit(static_cast<unsigned char>(*p)))) p += 1;
+        } else if (ch != 0 && strchr(signs, ch) != nullptr) {
+            while (p < end && *p != 0 && strchr(signs, *p) != nullptr) p += 1;
+        }
+        n += 1;
+    }
+}
+
+template <
+    const char * (*SkipSpace)(const char *, const char *),
+    const char * (*SkipIdent)(const char *, const char *),
+    const char * (*SkipNumber)(const char *, const char *)
+>
+static std::size_t scanWith(const char * p, const char * end) {
+    std::size_t n = 0;
+    for (;;) {
+        p = SkipSpace(p, end);
+        if (p == end) return n;
+        char ch = *p++;
+        if (isIdentStartChar(ch)) {
+            p = SkipIdent(p, end);
+        } else if (isDigitChar(ch)) {
+            p = SkipNumber(p, end);
+        } else if (isSignChar(ch)) {
+            while (p < end && isSignChar(*p)) p += 1;
+        }
+        n += 1;
+    }
+}
+
+static std::size_t scanStream(const char * p, const char * end) {
+    std::istringstream in(std::string(p, end));
+    in.unsetf(std::ios_base::skipws);
+    SymbolTable symbols;
+    Itemizer itemizer(in, symbols);
+    std::size_t n = 0;
+    while (itemizer.nextItem()) n += 1;
+    return n;
+}
+
+//  Built before timing starts, copying the source is not what we measure.
+static SourceBuffer * sliceBuffer = nullptr;
+
+static std::size_t scanSlices(const char *, const char *) {
+    SymbolTable symbols;
+    Itemizer itemizer(*sliceBuffer, symbols);
+    ItemSlice slice;
+    std::size_t n = 0;
+    while (itemizer.nextSlice(slice)) n += 1;
+    return n;
+}
+
+static std::size_t scanItems(const char *, const char *) {
+    SymbolTable symbols;
+    Itemizer itemizer(*sliceBuffer, symbols);
+    Item item;
+    std::size_t n = 0;
+    while (itemizer.nextItem(item)) n += 1;
+    return n;
+}
+
+static std::size_t report(const char * name, Scanner scan, const std::string & source, int repeats) {
+    std::size_t count = 0;
+    double best = 0.0;
+    for (int i = 0; i < repeats; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        count = scan(source.data(), source.data() + source.size());
+        auto t1 = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        double mbs = source.size() / secs / 1e6;
+        if (mbs > best) best = mbs;
+    }
+    std::cout << std::left << std::setw(12) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1) << best << " MB/s"
+              << std::setw(12) << count << " items" << std::endl;
+    return count;
+}
+
+int main(int argc, char * argv[]) {
+    std::string seed = sample;
+    if (argc > 1) {
+        std::ifstream in(argv[1], std::ios::binary);
+        std::stringstream text;
+        text << in.rdbuf();
+        seed = text.str();
+    }
+    int repeats = argc > 2 ? std::stoi(argv[2]) : 5;
+    if (seed.empty() || repeats < 1) {
+        std::cerr << "Nothing to itemize" << std::endl;
+        return 1;
+    }
+    std::string source = makeSource(seed, 8 << 20);
+
+    std::cout << "Itemizing " << source.size() << " bytes, best of " << repeats
+              << ", scanner: " << charClassScanner() << std::endl;
+    std::size_t stream = report("stream", scanStream, source, repeats);
+    std::size_t libc = report("libc", scanLibc, source, repeats);
+    std::size_t table = report("table", scanWith<skipSpace, skipIdent, skipNumber>, source, repeats);
+    std::size_t simd = report("simd", scanWith<skipSpaceVector, skipIdentVector, skipNumberVector>, source, repeats);
+    std::istringstream in(source);
+    SourceBuffer buffer(in);
+    sliceBuffer = &buffer;
+    std::size_t slices = report("nextSlice", scanSlices, source, repeats);
+    std::size_t items = report("nextItem", scanItems, source, repeats);
+
+    if (libc != table || libc != simd || stream != slices || stream != items) {
+        std::cerr << "Item counts disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
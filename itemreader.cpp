@@ -0,0 +1,161 @@
+#include <string>
+
+#include "itemreader.hpp"
+#include "precedences.hpp"
+#include "cell.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+//  The largest integer that fits in a Small.
+static constexpr uint64_t MaxSmall = (static_cast<uint64_t>(1) << (63 - TAG_WIDTH)) - 1;
+
+bool infixPrecedence(ItemCode code, int & prec) {
+    switch (code) {
+        #define X(name, p) case ItemCode::name##_code: prec = p; return true;
+        #include "precedences.xpp"
+        #undef X
+        default: return false;
+    }
+}
+
+bool isStatementTerminator(ItemCode code) {
+    switch (code) {
+        case ItemCode::end_code:
+        case ItemCode::enddefine_code:
+        case ItemCode::endif_code:
+        case ItemCode::endfor_code:
+        case ItemCode::endfn_code:
+        case ItemCode::endtry_code:
+        case ItemCode::catch_code:
+        case ItemCode::endswitch_code:
+        case ItemCode::case_code:
+        case ItemCode::default_code:
+        case ItemCode::else_code:
+        case ItemCode::elseif_code:
+        case ItemCode::then_code:
+        case ItemCode::do_code:
+        case ItemCode::from_code:
+        case ItemCode::by_code:
+        case ItemCode::to_code:
+        case ItemCode::cparen_code:
+        case ItemCode::semi_code:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::optional<Item> ItemReader::peek() {
+    std::optional<Item> item = _itemizer.nextItem();
+    if (item) {
+        _itemizer.pushback(*item);
+    }
+    return item;
+}
+
+Item ItemReader::next() {
+    std::optional<Item> item = _itemizer.nextItem();
+    if (!item) {
+        throw CompileTimeError("Unexpected end of input");
+    }
+    return *item;
+}
+
+bool ItemReader::tryRead(ItemCode code) {
+    return _itemizer.tryNextItem(code).has_value();
+}
+
+void ItemReader::mustRead(ItemCode code) {
+    Item item = next();
+    if (item.itemCode() != code) {
+        unexpected(item, itemCodeToItemKey(code));
+    }
+}
+
+//  Every closing keyword may also be written as plain 'end'.
+void ItemReader::mustReadEnd(ItemCode closer) {
+    Item item = next();
+    if (item.itemCode() != closer && item.itemCode() != ItemCode::end_code) {
+        unexpected(item, itemCodeToItemKey(closer));
+    }
+}
+
+std::string ItemReader::name(const Item & item) {
+    return std::string(_symbols.name(item.symbol()));
+}
+
+std::string ItemReader::readName() {
+    Item item = next();
+    if (item.itemCode() != ItemCode::word_code) {
+        unexpected(item, "a name");
+    }
+    return name(item);
+}
+
+void ItemReader::unexpected(const Item & item, const char * expected) {
+    throw (
+        CompileTimeError("Unexpected item")
+        .culprit("Expected", expected)
+        .culprit("Found", item.nameString(_symbols))
+        .culprit("Position", static_cast<int64_t>(item.position()))
+    );
+}
+
+int64_t ItemReader::intValue(const Item & item) {
+    if (item.itemCode() == ItemCode::int_code) {
+        return item.intValue();
+    }
+    std::string_view digits = _symbols.name(item.symbol());
+    uint64_t value = 0;
+    for (char ch : digits) {
+        if (value > (MaxSmall - (ch - '0')) / 10) {
+            throw CompileTimeError("Integer literal too large").culprit("Integer", std::string(digits));
+        }
+        value = value * 10 + (ch - '0');
+    }
+    return static_cast<int64_t>(value);
+}
+
+bool ItemReader::isQuote(const Item & item) {
+    return item.itemCode() == ItemCode::word_code && _symbols.name(item.symbol()) == "\"";
+}
+
+std::size_t ItemReader::readQuoted() {
+    Item item = next();
+    if (item.itemCode() != ItemCode::word_code || isQuote(item)) {
+        unexpected(item, "a name");
+    }
+    Item quote = next();
+    if (!isQuote(quote)) {
+        unexpected(quote, "\"");
+    }
+    return item.symbol();
+}
+
+Cell ItemReader::readCaseKey() {
+    Item item = next();
+    switch (item.itemCode()) {
+        case ItemCode::int_code:
+        case ItemCode::bigint_code:
+            return Cell::makeSmall(intValue(item));
+        case ItemCode::sub_code: {
+            Item literal = next();
+            if (literal.itemCode() != ItemCode::int_code && literal.itemCode() != ItemCode::bigint_code) {
+                unexpected(literal, "an integer");
+            }
+            return Cell::makeSmall(-intValue(literal));
+        }
+        case ItemCode::True_code:
+            return TrueValue;
+        case ItemCode::False_code:
+            return FalseValue;
+        default:
+            if (isQuote(item)) {
+                return Cell::makeSymbol(readQuoted());
+            }
+            unexpected(item, "a case key");
+    }
+}
+
+} // namespace poppy
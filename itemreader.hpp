@@ -0,0 +1,60 @@
+#ifndef ITEMREADER_HPP
+#define ITEMREADER_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "cell.hpp"
+#include "itemizer.hpp"
+#include "symboltable.hpp"
+
+namespace poppy {
+
+//  The binding power of an infix operator, false if it is not one.
+bool infixPrecedence(ItemCode code, int & prec);
+
+//  Items that end a sequence of statements.
+bool isStatementTerminator(ItemCode code);
+
+//  Single-item lookahead over an Itemizer, shared by the parsers.
+class ItemReader {
+protected:
+    Itemizer & _itemizer;
+    SymbolTable & _symbols;
+
+public:
+    ItemReader(Itemizer & itemizer, SymbolTable & symbols) :
+        _itemizer(itemizer),
+        _symbols(symbols)
+    {}
+
+protected:
+    std::optional<Item> peek();
+    Item next();
+    bool tryRead(ItemCode code);
+    void mustRead(ItemCode code);
+    void mustReadEnd(ItemCode closer);
+    std::string readName();
+    std::string name(const Item & item);
+    [[noreturn]] void unexpected(const Item & item, const char * expected);
+
+    //  The value of an int_code or bigint_code item, which must fit in a
+    //  Small.
+    int64_t intValue(const Item & item);
+
+    //  Whether the item opens a quoted word, "name", which stands for the
+    //  Symbol of the name rather than for a variable.
+    bool isQuote(const Item & item);
+
+    //  The symbol of a quoted word, whose opening quote has been read.
+    std::size_t readQuoted();
+
+    //  The key of a case: an integer, which may be negated, a Boolean or a
+    //  quoted word.
+    Cell readCaseKey();
+};
+
+} // namespace poppy
+
+#endif
@@ -33,6 +33,7 @@ namespace poppy {
         switch (code) {
             case ItemCode::unknown_code: return ItemRole::UNKNOWN;
             case ItemCode::int_code: return ItemRole::CONSTANT;
+            case ItemCode::bigint_code: return ItemRole::CONSTANT;
             case ItemCode::float_code: return ItemRole::CONSTANT;
             case ItemCode::word_code: return ItemRole::VARIABLE;
             case ItemCode::string_code: return ItemRole::CONSTANT;
@@ -40,9 +41,10 @@ namespace poppy {
             case ItemCode::and_code: return ItemRole::UNKNOWN;
             case ItemCode::append_code: return ItemRole::UNKNOWN;
             case ItemCode::assign_code: return ItemRole::UNKNOWN;
+            case ItemCode::bind_code: return ItemRole::UNKNOWN;
             case ItemCode::by_code: return ItemRole::UNKNOWN;
             case ItemCode::case_code: return ItemRole::PUNCTUATION;
-            case ItemCode::catch_code: return ItemRole::RESERVED;
+            case ItemCode::catch_code: return ItemRole::PUNCTUATION;
             case ItemCode::cbrace_code: return ItemRole::RESERVED;
             case ItemCode::cbracket_code: return ItemRole::RESERVED;
             case ItemCode::colon_code: return ItemRole::PUNCTUATION;
@@ -50,9 +52,10 @@ namespace poppy {
             case ItemCode::cparen_code: return ItemRole::PUNCTUATION;
             case ItemCode::fat_cparen_code: return ItemRole::PUNCTUATION;
             case ItemCode::define_code: return ItemRole::PREFIX;
+            case ItemCode::def_code: return ItemRole::PREFIX;
             case ItemCode::Discard_code: return ItemRole::VARIABLE;
             case ItemCode::dsemi_code: return ItemRole::UNKNOWN;
-            case ItemCode::default_code: return ItemRole::UNKNOWN;
+            case ItemCode::default_code: return ItemRole::PUNCTUATION;
             case ItemCode::div_code: return ItemRole::UNKNOWN;
             case ItemCode::divmod_code: return ItemRole::UNKNOWN;
             case ItemCode::do_code: return ItemRole::UNKNOWN;
@@ -67,7 +70,7 @@ namespace poppy {
             case ItemCode::endfor_code: return ItemRole::PUNCTUATION;
             case ItemCode::endif_code: return ItemRole::PUNCTUATION;
             case ItemCode::endswitch_code: return ItemRole::PUNCTUATION;
-            case ItemCode::endtry_code: return ItemRole::RESERVED;
+            case ItemCode::endtry_code: return ItemRole::PUNCTUATION;
             case ItemCode::endunless_code: return ItemRole::PUNCTUATION;
             case ItemCode::envvar_code: return ItemRole::UNKNOWN;
             case ItemCode::equal_code: return ItemRole::UNKNOWN;
@@ -111,16 +114,20 @@ namespace poppy {
             case ItemCode::or_code: return ItemRole::UNKNOWN;
             case ItemCode::panic_code: return ItemRole::UNKNOWN;
             case ItemCode::pow_code: return ItemRole::UNKNOWN;
+            case ItemCode::quo_code: return ItemRole::UNKNOWN;
+            case ItemCode::quomod_code: return ItemRole::UNKNOWN;
             case ItemCode::return_code: return ItemRole::UNKNOWN;
             case ItemCode::semi_code: return ItemRole::UNKNOWN;
             case ItemCode::skip_code: return ItemRole::UNKNOWN;
             case ItemCode::slashgt_code: return ItemRole::UNKNOWN;
             case ItemCode::sub_code: return ItemRole::UNKNOWN;
-            case ItemCode::switch_code: return ItemRole::UNKNOWN;
+            case ItemCode::switch_code: return ItemRole::PREFIX;
             case ItemCode::Termin_code: return ItemRole::RESERVED;
             case ItemCode::then_code: return ItemRole::PUNCTUATION;
+            case ItemCode::throw_code: return ItemRole::PREFIX;
             case ItemCode::True_code: return ItemRole::CONSTANT;
             case ItemCode::to_code: return ItemRole::UNKNOWN;
+            case ItemCode::try_code: return ItemRole::PREFIX;
             case ItemCode::unless_code: return ItemRole::RESERVED;
             case ItemCode::until_code: return ItemRole::RESERVED;
             case ItemCode::val_code: return ItemRole::UNKNOWN;
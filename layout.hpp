@@ -8,8 +8,75 @@ public:
     static const int LengthOffset = -1;
     static const int KeyOffsetFromStart = 3;
     static const int NumLocalsOffset = 1;
-    static const int InstructionsOffset = 2;
+    static const int StackOffset = 2;
+    static const int InstructionsOffset = 3;
     static const int HeaderSize = KeyOffsetFromStart + InstructionsOffset;
 };
 
+//  The Q-block of a procedure is followed by its line table, then by its
+//  exception handlers and the number of handlers, so the last cell of
+//  every procedure is that count. A handler covers the instructions that start in the
+//  range [start, end) and is entered at its CATCH, all three being offsets
+//  from the key. Inner handlers come before the handlers that enclose
+//  them, so the first that covers an instruction is the one to use.
+class HandlerLayout {
+public:
+    static const int StartOffset = 0;
+    static const int EndOffset = 1;
+    static const int HandlerOffset = 2;
+    static const int Size = 3;
+};
+
+//  The line table of a procedure, see linetable.hpp, is its varints packed
+//  into cells, then the index of its source in the runtime's registry, or
+//  zero, and the number of bytes of varints. The offsets are from the
+//  handler table, which it comes just before.
+class LineTableLayout {
+public:
+    static const int SourceOffset = -2;
+    static const int BytesOffset = -1;
+    static const int Size = 2;
+};
+
+//  The table of a switch is a run of CASE instructions, one for each key
+//  in order and then one for the default, so that the code can still be
+//  walked an instruction at a time. A CASE has the key, which is never a
+//  pointer, and the branch to take for it.
+class CaseLayout {
+public:
+    static const int KeyOffset = 1;
+    static const int BranchOffset = 2;
+    static const int Size = 3;
+};
+
+//  A record class is represented by a key object. The instances of the
+//  class start with a key cell that points at it.
+class RecordKeyLayout {
+public:
+    static const int NumFieldsOffset = 1;
+    static const int ClassNameOffset = 2;
+    static const int FieldNamesOffset = 3;
+    static const int HeaderSize = 3;
+};
+
+class RecordLayout {
+public:
+    static const int FieldsOffset = 1;
+};
+
+//  A closure pairs a procedure with a flat, immutable vector of captured
+//  values. Captured variables that are assigned are shared via boxes.
+class ClosureLayout {
+public:
+    static const int ProcedureOffset = 1;
+    static const int NumCapturedOffset = 2;
+    static const int CapturedOffset = 3;
+};
+
+class BoxLayout {
+public:
+    static const int ValueOffset = 1;
+    static const int Size = 2;
+};
+
 #endif
\ No newline at end of file
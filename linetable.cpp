@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstring>
+
+#include "linetable.hpp"
+#include "varint.hpp"
+
+namespace poppy {
+
+uint64_t SourceRegistry::add(const SourceBuffer & source) {
+    Source & s = _sources.emplace_back();
+    s.name = source.name();
+    s.line_starts.push_back(0);
+    for (const char * p = source.begin(); (p = static_cast<const char *>(std::memchr(p, '\n', source.end() - p))) != nullptr; ) {
+        p += 1;
+        s.line_starts.push_back(static_cast<uint32_t>(p - source.begin()));
+    }
+    return _sources.size();
+}
+
+bool SourceRegistry::resolve(uint64_t source, uint32_t offset, SourcePosition & position) const {
+    if (source == 0 || source > _sources.size()) {
+        return false;
+    }
+    const Source & s = _sources[source - 1];
+    auto it = std::upper_bound(s.line_starts.begin(), s.line_starts.end(), offset);
+    position.file = s.name;
+    position.line = static_cast<uint32_t>(it - s.line_starts.begin());
+    position.column = offset - it[-1] + 1;
+    return true;
+}
+
+std::string_view SourceRegistry::name(uint64_t source) const {
+    if (source == 0 || source > _sources.size()) {
+        return std::string_view();
+    }
+    return _sources[source - 1].name;
+}
+
+std::size_t encodeLineTable(const std::vector<std::pair<uint64_t, uint32_t>> & entries, std::vector<uint64_t> & cells) {
+    std::vector<uint8_t> bytes;
+    uint64_t pc = 0;
+    int64_t offset = 0;
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        if (i + 1 < entries.size() && entries[i + 1].first == entries[i].first) {
+            continue;
+        }
+        auto [at, here] = entries[i];
+        if (!bytes.empty() && here == offset) {
+            continue;
+        }
+        writeVarint(bytes, at - pc);
+        writeVarint(bytes, zigzag(here - offset));
+        pc = at;
+        offset = here;
+    }
+    std::size_t at = cells.size();
+    cells.resize(at + lineTableCells(bytes.size()));
+    if (!bytes.empty()) {
+        std::memcpy(cells.data() + at, bytes.data(), bytes.size());
+    }
+    return bytes.size();
+}
+
+bool lookupLineTable(const uint8_t * table, std::size_t nbytes, uint64_t pc, uint32_t & offset) {
+    const uint8_t * p = table;
+    const uint8_t * end = table + nbytes;
+    uint64_t start = 0;
+    int64_t here = 0;
+    bool found = false;
+    while (p < end) {
+        start += readVarint(p);
+        if (start > pc) {
+            break;
+        }
+        here += unzigzag(readVarint(p));
+        found = true;
+    }
+    offset = static_cast<uint32_t>(here);
+    return found;
+}
+
+} // namespace poppy
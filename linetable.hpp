@@ -0,0 +1,70 @@
+#ifndef LINETABLE_HPP
+#define LINETABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "sourcebuffer.hpp"
+
+namespace poppy {
+
+//  Where some code came from. Lines and columns count from 1.
+struct SourcePosition {
+    std::string_view file;
+    uint32_t line = 0;
+    uint32_t column = 0;
+};
+
+/*  The sources that code has been planted from, so that the byte offsets
+    of line tables can be turned into lines and columns. A source is known
+    by its index, which starts from 1 so that 0 can mean none. Only the
+    name and where each line starts are kept, not the text. Like natives,
+    sources are never removed and are added by the thread that owns the
+    runtime.
+*/
+
+class SourceRegistry {
+private:
+    struct Source {
+        std::string name;
+        std::vector<uint32_t> line_starts;
+    };
+    std::deque<Source> _sources;
+
+public:
+    uint64_t add(const SourceBuffer & source);
+
+    //  Returns false if there is no such source.
+    bool resolve(uint64_t source, uint32_t offset, SourcePosition & position) const;
+
+    //  The name of a source, empty if there is no such source.
+    std::string_view name(uint64_t source) const;
+};
+
+/*  A line table maps the instructions of a procedure to byte offsets in
+    its source, as runs. Each run is the distance in cells from the start
+    of the one before, the first from the key, and the change in offset,
+    zigzag encoded, both as LEB128 varints. A run lasts until the next, so
+    the offset of an instruction is that of the last run that starts at or
+    before it. The varints are packed into cells, see LineTableLayout.
+*/
+
+//  The entries are (offset from the key, byte offset) in order of the
+//  first. Of entries for the same cell the last wins. Returns the number
+//  of bytes of varints, which are appended to the cells.
+std::size_t encodeLineTable(const std::vector<std::pair<uint64_t, uint32_t>> & entries, std::vector<uint64_t> & cells);
+
+//  The byte offset for the instruction at pc, an offset from the key. False
+//  if the table has no run that starts at or before it.
+bool lookupLineTable(const uint8_t * table, std::size_t nbytes, uint64_t pc, uint32_t & offset);
+
+inline std::size_t lineTableCells(std::size_t nbytes) { return (nbytes + 7) / 8; }
+
+} // namespace poppy
+
+#endif
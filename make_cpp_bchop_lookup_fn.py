@@ -194,6 +194,82 @@ def altMakeTree( words ):
         return SwitchOnLength( { L: makeTree( words, L=L ) for ( L, words ) in words_by_len.items() } )   
 
 
+### PerfectHash finds a collision-free hash for a list of words.
+
+"""
+The hash packs the length and a few characters into a 64-bit word,
+multiplies by a constant and keeps the top bits. The characters are taken
+from the first, last, second, second-to-last ... positions, adding
+positions only until every word packs differently. We then search
+deterministically for a multiplier that maps every word to a distinct
+slot of a power-of-two table.
+"""
+class PerfectHash:
+
+    MAX_TRIES = 100000
+    CANDIDATE_POSITIONS = ( 0, -1, 1, -2, 2, -3, 3 )
+
+    def __init__( self, words: List[ str ] ):
+        self._words = words
+        self.min_len = min( map( len, words ) )
+        self.max_len = max( map( len, words ) )
+        if self.max_len > 255:
+            raise Exception( 'Perfect hash needs words shorter than 256 characters' )
+        self.first_chars = sorted( set( ord( w[0] ) for w in words ) )
+        self.positions = self.choosePositions()
+        self.bits, self.multiplier = self.search()
+
+    def choosePositions( self ):
+        for n in range( 1, len( self.CANDIDATE_POSITIONS ) + 1 ):
+            positions = self.CANDIDATE_POSITIONS[:n]
+            if len( set( self.packed( w, positions ) for w in self._words ) ) == len( self._words ):
+                return positions
+        raise Exception( 'Perfect hash cannot tell apart some words' )
+
+    @staticmethod
+    def hasPosition( length, k ):
+        return length > k if k >= 0 else length >= -k
+
+    def packed( self, word, positions=None ):
+        if positions is None:
+            positions = self.positions
+        x = len( word )
+        for i, k in enumerate( positions ):
+            if self.hasPosition( len( word ), k ):
+                x |= ord( word[k] ) << ( 8 * ( i + 1 ) )
+        return x
+
+    def slot( self, x, bits, multiplier ):
+        return ( ( x * multiplier ) & 0xFFFFFFFFFFFFFFFF ) >> ( 64 - bits )
+
+    def search( self ):
+        keys = [ self.packed( w ) for w in self._words ]
+        bits = max( 1, ( len( keys ) - 1 ).bit_length() )
+        for bits in range( bits, bits + 4 ):
+            seed = 0x9E3779B97F4A7C15
+            for _ in range( self.MAX_TRIES ):
+                multiplier = seed | 1
+                if len( set( self.slot( x, bits, multiplier ) for x in keys ) ) == len( keys ):
+                    return ( bits, multiplier )
+                seed = ( seed * 6364136223846793005 + 1442695040888963407 ) & 0xFFFFFFFFFFFFFFFF
+        raise Exception( 'No perfect hash found' )
+
+    def table( self ):
+        slots = [ None ] * ( 1 << self.bits )
+        for w in self._words:
+            slots[ self.slot( self.packed( w ), self.bits, self.multiplier ) ] = w
+        return slots
+
+    def firstCharBitmap( self ):
+        bitmap = [ 0, 0, 0, 0 ]
+        for ch in self.first_chars:
+            bitmap[ ch >> 6 ] |= 1 << ( ch & 63 )
+        return bitmap
+
+def cppString( word ):
+    return word.replace( '\\', '\\\\' ).replace( '"', '\\"' )
+
+
 ### CodeGenerator generates the code for the decision tree.
 
 class CodeGenerator:
@@ -202,8 +278,14 @@ class CodeGenerator:
         self._jdata = jdata
         self._jtemplate = jdata['template']
         words: List[ str ] = list( jdata['map'].keys() )
-        self._tree = altMakeTree( words )
         self._include_empty = '' in words
+        self._strategy = jdata.get( 'lookup-strategy', 'bchop' )
+        if self._strategy == 'bchop':
+            self._tree = altMakeTree( words )
+        elif self._strategy == 'perfect-hash':
+            self._hash = PerfectHash( [ w for w in words if w != '' ] )
+        else:
+            raise Exception( f'Unknown lookup-strategy: {self._strategy}' )
 
     def makeWriter( self, file ):
         fields = tuple( field['name'] for field in self._jdata['fields'] )
@@ -292,7 +374,7 @@ class CodeGenerator:
         lookup = self.name_LookupFunction()
         extra_fields = ''.join( f""", {field['type']} & {field['name']}""" for field in self._jdata['fields'] )
 
-        writer( f"""bool {lookup}( const std::string & s, {code_class} & code {extra_fields});""" )
+        writer( f"""bool {lookup}( std::string_view s, {code_class} & code {extra_fields});""" )
         writer()
         
         if code_to_key := self.name_of_FromCodeToKeyFunction():
@@ -304,11 +386,11 @@ class CodeGenerator:
             writer()
 
         if string_to_code := self.name_FromKeyToCodeFunction():
-            writer( f"""{codes_classname} {string_to_code}( const std::string & s );""" )
+            writer( f"""{codes_classname} {string_to_code}( std::string_view s );""" )
             writer()
 
         if has_code := self.name_HasCodeFunction():
-            writer( f"""bool {has_code}( const std::string & s );""" )
+            writer( f"""bool {has_code}( std::string_view s );""" )
             writer()
         
 
@@ -318,6 +400,7 @@ class CodeGenerator:
         writer( f"""#define {jtemplate['include-once']}""" )
         writer()
         writer( """#include <string>""" )
+        writer( """#include <string_view>""" )
         writer()
         for i in jtemplate['header']['include']:
             writer( i )
@@ -334,6 +417,9 @@ class CodeGenerator:
     def generateSource( self, writer ):
         jtemplate = self._jtemplate
         writer( """#include <string>""" )
+        if self._strategy == 'perfect-hash':
+            writer( """#include <cstdint>""" )
+            writer( """#include <cstring>""" )
         writer()
         writer( f"""#include "{jtemplate['header']['file']}" """ )
         writer()
@@ -358,7 +444,7 @@ class CodeGenerator:
         if lookup := self.name_LookupFunction():
             code_class = self.name_of_CodeClass()
             extra_fields = ''.join( f""", {field['type']} & {field['name']}""" for field in self._jdata['fields'] )
-            writer( f"""bool {lookup}( const std::string & s, {code_class} & code {extra_fields}) {{""" )
+            writer( f"""bool {lookup}( std::string_view s, {code_class} & code {extra_fields}) {{""" )
             with indent(writer):
                 writer( """size_t len = s.length();""" )
                 dc = self.defaultCode()
@@ -370,10 +456,59 @@ class CodeGenerator:
                     with indent(writer):
                         writer( """return true;""" )
                     writer( f"""return {self._include_empty};""" )
-                self._tree.generateCode( writer )
+                if self._strategy == 'perfect-hash':
+                    self.generatePerfectHashLookup( writer )
+                else:
+                    self._tree.generateCode( writer )
             writer( """}""" )
             writer()
 
+    def generatePerfectHashTable( self, writer ):
+        h = self._hash
+        code_class = self.name_of_CodeClass()
+        extra_members = ''.join( f""" {field['type']} {field['name']};""" for field in self._jdata['fields'] )
+        writer( """namespace {""" )
+        writer()
+        writer( f"""struct PerfectHashEntry {{ const char * key; unsigned char len; {code_class} code;{extra_members} }};""" )
+        writer()
+        writer( f"""constexpr PerfectHashEntry perfectHashTable[{len( h.table() )}] = {{""" )
+        with indent(writer):
+            for w in h.table():
+                if w is None:
+                    extra = ''.join( f""", {field['default']}""" for field in self._jdata['fields'] )
+                    writer( f"""{{ "", 0, {self.defaultCode()}{extra} }},""" )
+                else:
+                    extra = ''.join( f""", {self._jdata['map'][w][field['name']]}""" for field in self._jdata['fields'] )
+                    writer( f"""{{ "{cppString( w )}", {len( w )}, {writer.code( w )}{extra} }},""" )
+        writer( """};""" )
+        writer()
+        bitmap = ', '.join( f"""0x{b:016X}ull""" for b in h.firstCharBitmap() )
+        writer( f"""constexpr uint64_t perfectHashFirstChars[4] = {{ {bitmap} }};""" )
+        writer()
+        writer( """} // namespace""" )
+        writer()
+
+    def generatePerfectHashLookup( self, writer ):
+        h = self._hash
+        if not self._include_empty:
+            writer( f"""if ( len < {h.min_len} || len > {h.max_len} ) return false;""" )
+        else:
+            writer( f"""if ( len > {h.max_len} ) return false;""" )
+        writer( """unsigned char first = s[0];""" )
+        writer( """if ( ( perfectHashFirstChars[first >> 6] >> ( first & 63 ) & 1 ) == 0 ) return false;""" )
+        writer( """uint64_t x = len;""" )
+        for i, k in enumerate( h.positions ):
+            index = f"""{k}""" if k >= 0 else f"""len - {-k}"""
+            needed = k + 1 if k >= 0 else -k
+            guard = f"""if ( len >= {needed} ) """ if needed > h.min_len else ""
+            writer( f"""{guard}x |= uint64_t( (unsigned char)s[{index}] ) << {8 * ( i + 1 )};""" )
+        writer( f"""const PerfectHashEntry & e = perfectHashTable[( x * {h.multiplier}ull ) >> {64 - h.bits}];""" )
+        writer( """if ( e.len != len || memcmp( e.key, s.data(), len ) != 0 ) return false;""" )
+        writer( """code = e.code;""" )
+        for extra in self._jdata['fields']:
+            writer( f"""{extra['name']} = e.{extra['name']};""" )
+        writer( """return true;""" )
+
     def generateCodeToKeyFunction( self, writer ):
         if code_to_key := self.name_of_FromCodeToKeyFunction():
             codes_classname = self.name_of_CodeClass()
@@ -412,7 +547,7 @@ class CodeGenerator:
         if key_to_code := self.name_FromKeyToCodeFunction():
             lookup = self.name_LookupFunction()
             codes_classname = self.name_of_CodeClass()
-            writer( f"""{codes_classname} {key_to_code}( const std::string & key )""" )
+            writer( f"""{codes_classname} {key_to_code}( std::string_view key )""" )
             writer( """{""", )
             with indent(writer):
                 writer( f"""{codes_classname} code;""" )
@@ -427,7 +562,7 @@ class CodeGenerator:
     def generateHasCodeFunction( self, writer ):
         if has_code := self.name_HasCodeFunction():
             lookup = self.name_LookupFunction()
-            writer( f"""bool {has_code}( const std::string & key )""" )
+            writer( f"""bool {has_code}( std::string_view key )""" )
             writer( """{""", )
             with indent(writer):
                 writer( f"""{self.name_of_CodeClass()} code;""" )
@@ -440,6 +575,8 @@ class CodeGenerator:
 
     def generateInnerSource( self, writer ):
         self.generateNameDefinitions( writer )
+        if self._strategy == 'perfect-hash':
+            self.generatePerfectHashTable( writer )
         self.generateLookupFunction( writer )
         self.generateCodeToKeyFunction( writer )
         self.generateCodeToStringFunction( writer )
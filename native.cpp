@@ -0,0 +1,67 @@
+#include <chrono>
+
+#include "native.hpp"
+#include "engine.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+const NativeFunction * NativeRegistry::add(const std::string & name, int arity, NativeCode code, bool fast) {
+    if (arity < 0) {
+        throw Mishap("Negative arity for native").culprit("Name", name);
+    }
+    auto it = _by_name.find(name);
+    if (it != _by_name.end()) {
+        if (it->second->arity != arity) {
+            throw Mishap("Cannot change the arity of a native").culprit("Name", name).culprit("Arity", static_cast<int64_t>(it->second->arity));
+        }
+        it->second->code = code;
+        it->second->fast = fast;
+        return it->second;
+    }
+    _functions.push_back(NativeFunction{ name, arity, code, fast });
+    return _by_name[name] = &_functions.back();
+}
+
+const NativeFunction * NativeRegistry::lookup(const std::string & name) const {
+    auto it = _by_name.find(name);
+    return it == _by_name.end() ? nullptr : it->second;
+}
+
+//  FNV-1a of the cell, which is identity for anything on the heap. The
+//  result is cut down to a non-negative Small.
+static Cell nativeHash(Engine &, Cell * args) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < 8; i++) {
+        h = (h ^ ((args[0].u64 >> (8 * i)) & 0xFF)) * 1099511628211ULL;
+    }
+    return Cell::makeSmall(static_cast<int64_t>(h >> (TAG_WIDTH + 1)));
+}
+
+static Cell nativeNanotime(Engine &, Cell *) {
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return Cell::makeSmall(std::chrono::duration_cast<std::chrono::nanoseconds>(t).count());
+}
+
+//  The number of bytes in the unsigned LEB128 encoding of n, as used by
+//  compact code.
+static Cell nativeVarintSize(Engine &, Cell * args) {
+    if (!args[0].isSmall() || args[0].i64 < 0) {
+        throw Mishap("Non-negative Small needed").culprit("Value", static_cast<int64_t>(args[0].i64));
+    }
+    uint64_t n = static_cast<uint64_t>(args[0].getSmall());
+    int64_t size = 1;
+    while (n >= 0x80) {
+        n >>= 7;
+        size += 1;
+    }
+    return Cell::makeSmall(size);
+}
+
+void defineStandardNatives(Engine & engine) {
+    engine.defineNative("hash", 1, nativeHash, true);
+    engine.defineNative("nanotime", 0, nativeNanotime, true);
+    engine.defineNative("varintsize", 1, nativeVarintSize, true);
+}
+
+} // namespace poppy
@@ -0,0 +1,55 @@
+#ifndef NATIVE_HPP
+#define NATIVE_HPP
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include "cell.hpp"
+
+namespace poppy {
+
+class Engine;
+
+//  A native function finds its arguments in place on the value stack, the
+//  first at args[0], and returns the one result that replaces them.
+typedef Cell (*NativeCode)(Engine & engine, Cell * args);
+
+struct NativeFunction {
+    std::string name;
+    int arity;
+    NativeCode code;
+    //  A fast native does not allocate, so its call need not be a
+    //  safepoint, see Engine::nativeSafepoint.
+    bool fast;
+};
+
+/*  The native functions of a runtime, by name. A native is called through
+    a global bound to a procedure whose body is a CALL_NATIVE, see
+    Engine::defineNative, so it can be passed around and rebound like any
+    other procedure, and a call to the global is inlined into a bare
+    CALL_NATIVE. Natives are never removed or moved, so planted code holds
+    pointers to them. The bytecode cache refers to them by name.
+*/
+
+class NativeRegistry {
+private:
+    std::deque<NativeFunction> _functions;
+    std::unordered_map<std::string, NativeFunction *> _by_name;
+
+public:
+    //  Redefining a native replaces its code, for the code that already
+    //  calls it too, so the arity must not change.
+    const NativeFunction * add(const std::string & name, int arity, NativeCode code, bool fast);
+
+    //  Returns nullptr if there is no native of that name.
+    const NativeFunction * lookup(const std::string & name) const;
+};
+
+//  Defines the natives that expose the runtime's hashing, time and
+//  encoding routines: hash(x), nanotime() and varintsize(n).
+void defineStandardNatives(Engine & engine);
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+
+#include "parallelcompiler.hpp"
+#include "parser.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+ParallelCompiler::ParallelCompiler(Engine & engine, unsigned int threads) :
+    _engine(engine),
+    _threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+//  Only the nesting matters here, the parser checks that the keywords
+//  match. Every construct may be closed by plain end.
+static int nesting(ItemCode code) {
+    switch (code) {
+        case ItemCode::define_code:
+        case ItemCode::def_code:
+        case ItemCode::if_code:
+        case ItemCode::for_code:
+        case ItemCode::fn_code:
+        case ItemCode::switch_code:
+        case ItemCode::try_code:
+            return 1;
+        case ItemCode::enddefine_code:
+        case ItemCode::endif_code:
+        case ItemCode::endfor_code:
+        case ItemCode::endfn_code:
+        case ItemCode::endswitch_code:
+        case ItemCode::endtry_code:
+        case ItemCode::end_code:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+struct Definition {
+    const Item * begin;
+    const Item * end;
+    std::string name;
+    std::unique_ptr<CodePlanter> planter;
+    std::exception_ptr error;
+};
+
+std::vector<std::string> ParallelCompiler::compile(const SourceBuffer & source) {
+    SymbolTable & symbols = _engine.getSymbolTable();
+    uint64_t index = _engine.addSource(source);
+    std::vector<Item> items;
+    {
+        Itemizer itemizer(source, symbols);
+        Item item;
+        while (itemizer.nextItem(item)) {
+            items.push_back(item);
+        }
+    }
+
+    //  A definition runs up to the next define at the top level. Anything
+    //  that is not a definition stays attached to the one before, so that
+    //  the parser reports it.
+    std::vector<Definition> definitions;
+    const Item * start = items.data();
+    int depth = 0;
+    for (const Item & item : items) {
+        ItemCode code = item.itemCode();
+        if (depth == 0 && (code == ItemCode::define_code || code == ItemCode::def_code) && &item != start) {
+            definitions.push_back(Definition{ start, &item });
+            start = &item;
+        }
+        depth = std::max(0, depth + nesting(code));
+    }
+    if (start != items.data() + items.size()) {
+        definitions.push_back(Definition{ start, items.data() + items.size() });
+    }
+    auto & dictionary = _engine.getDictionary();
+    for (auto & d : definitions) {
+        if (d.end - d.begin >= 2 && d.begin[1].itemCode() == ItemCode::word_code) {
+            std::string name(symbols.name(d.begin[1].symbol()));
+            if (dictionary.lookup(name) == nullptr) {
+                _engine.declareGlobal(name);
+            }
+        }
+    }
+
+    std::atomic<std::size_t> next{ 0 };
+    auto work = [&]() {
+        for (;;) {
+            std::size_t i = next++;
+            if (i >= definitions.size()) {
+                return;
+            }
+            Definition & d = definitions[i];
+            try {
+                Itemizer itemizer(d.begin, d.end, symbols);
+                Parser parser(_engine, itemizer);
+                parser.setSource(index);
+                d.planter = parser.plantDefinition(d.name);
+                std::string extra;
+                if (parser.plantDefinition(extra)) {
+                    throw CompileTimeError("Cannot separate definitions").culprit("Name", extra);
+                }
+                if (d.planter) {
+                    d.planter->seal();
+                }
+            } catch (...) {
+                d.error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    std::size_t nthreads = std::min<std::size_t>(_threads, definitions.size());
+    for (std::size_t t = 1; t < nthreads; t++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto & t : pool) {
+        t.join();
+    }
+
+    for (auto & d : definitions) {
+        if (d.error) {
+            std::rethrow_exception(d.error);
+        }
+    }
+    std::vector<std::string> names;
+    for (auto & d : definitions) {
+        if (d.planter) {
+            d.planter->buildAndBind(d.name);
+            names.push_back(d.name);
+        }
+    }
+    return names;
+}
+
+} // namespace poppy
@@ -0,0 +1,41 @@
+#ifndef PARALLELCOMPILER_HPP
+#define PARALLELCOMPILER_HPP
+
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+#include "sourcebuffer.hpp"
+
+namespace poppy {
+
+/*  Compiles the top-level definitions of a source on a pool of threads.
+
+    1.  The source is itemized on the calling thread, which interns every
+        name, and split into definitions. Each definition's name is
+        declared, so that calls between them resolve to their Idents.
+    2.  The workers parse and seal one definition at a time, each into a
+        CodePlanter of its own. This only reads the symbol table, the
+        dictionary and the opcode map.
+    3.  The planters are committed to the heap and bound, in source order,
+        on the calling thread. Nothing is bound unless every definition
+        compiled, and the first error in source order is rethrown.
+*/
+
+class ParallelCompiler {
+private:
+    Engine & _engine;
+    unsigned int _threads;
+
+public:
+    //  Zero threads means one per hardware thread.
+    ParallelCompiler(Engine & engine, unsigned int threads = 0);
+
+public:
+    //  Compiles and binds every definition, returns their names in order.
+    std::vector<std::string> compile(const SourceBuffer & source);
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,401 @@
+#include <string>
+
+#include "parser.hpp"
+#include "precedences.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+Parser::Parser(Engine & engine, Itemizer & itemizer) :
+    ItemReader(itemizer, engine.getSymbolTable()),
+    _engine(engine)
+{
+}
+
+std::unique_ptr<CodePlanter> Parser::plantDefinition(std::string & procname) {
+    if (!peek()) {
+        return nullptr;
+    }
+    Item item = next();
+    if (item.itemCode() != ItemCode::define_code && item.itemCode() != ItemCode::def_code) {
+        unexpected(item, "define");
+    }
+    procname = readName();
+
+    std::unique_ptr<CodePlanter> planter(new CodePlanter(_engine));
+    planter->setSource(_source);
+    _planter = planter.get();
+    //  Declared before the body so that it can call itself.
+    if (_engine.getDictionary().lookup(procname) == nullptr) {
+        planter->global(procname);
+    }
+    parseParameters(*planter);
+    tryRead(ItemCode::colon_code);
+    parseProcedureBody(*planter, ItemCode::enddefine_code);
+    _planter = nullptr;
+    return planter;
+}
+
+bool Parser::compileDefinition() {
+    std::string procname;
+    std::unique_ptr<CodePlanter> planter = plantDefinition(procname);
+    if (!planter) {
+        return false;
+    }
+    planter->buildAndBind(procname);
+    _defined.push_back(procname);
+    return true;
+}
+
+int Parser::compileDefinitions() {
+    int n = 0;
+    while (compileDefinition()) {
+        n += 1;
+    }
+    return n;
+}
+
+//  The arguments are on the stack, the last one on top.
+void Parser::parseParameters(CodePlanter & planter) {
+    std::vector<std::string> params;
+    mustRead(ItemCode::oparen_code);
+    if (!tryRead(ItemCode::cparen_code)) {
+        do {
+            params.push_back(readName());
+            planter.local(params.back());
+        } while (tryRead(ItemCode::comma_code));
+        mustRead(ItemCode::cparen_code);
+    }
+    for (auto it = params.rbegin(); it != params.rend(); ++it) {
+        planter.POP_LOCAL(*it);
+    }
+}
+
+void Parser::parseProcedureBody(CodePlanter & planter, ItemCode closer) {
+    parseStatements();
+    mustReadEnd(closer);
+    planter.RETURN();
+}
+
+void Parser::parseStatements() {
+    for (;;) {
+        std::optional<Item> item = peek();
+        if (!item || isStatementTerminator(item->itemCode())) {
+            return;
+        }
+        parseExpr(prec_max);
+        if (!tryRead(ItemCode::semi_code)) {
+            return;
+        }
+    }
+}
+
+//  Parses an expression whose infix operators all bind tighter than limit.
+void Parser::parseExpr(int limit) {
+    parsePrefix(next());
+    for (;;) {
+        std::optional<Item> op = peek();
+        int prec;
+        if (!op || !infixPrecedence(op->itemCode(), prec) || prec >= limit) {
+            return;
+        }
+        next();
+        if (op->itemCode() == ItemCode::assign_code) {
+            _planter->POP(readName());
+        } else {
+            parseExpr(prec);
+            plantInfix(*op);
+        }
+    }
+}
+
+void Parser::parsePrefix(const Item & item) {
+    _planter->position(item.position());
+    switch (item.itemCode()) {
+        case ItemCode::int_code:
+        case ItemCode::bigint_code:
+            plantInt(item);
+            break;
+        case ItemCode::word_code:
+            if (isQuote(item)) {
+                _planter->PUSHQ(Cell::makeSymbol(readQuoted()));
+            } else {
+                parseIdentifier(item);
+            }
+            break;
+        case ItemCode::True_code:
+            _planter->PUSHQ(TrueValue);
+            break;
+        case ItemCode::False_code:
+            _planter->PUSHQ(FalseValue);
+            break;
+        case ItemCode::oparen_code:
+            if (!tryRead(ItemCode::cparen_code)) {
+                parseExpr(prec_max);
+                mustRead(ItemCode::cparen_code);
+            }
+            break;
+        case ItemCode::sub_code: {
+            std::optional<Item> literal = _itemizer.tryNextItem(ItemCode::int_code);
+            if (literal) {
+                _planter->PUSHQ(-static_cast<int64_t>(literal->intValue()));
+            } else {
+                _planter->PUSHQ(0);
+                parseExpr(prec_negate);
+                _planter->position(item.position());
+                _planter->SUB();
+            }
+            break;
+        }
+        case ItemCode::var_code:
+        case ItemCode::val_code:
+            parseVar();
+            break;
+        case ItemCode::if_code:
+            parseIf();
+            break;
+        case ItemCode::for_code:
+            parseFor();
+            break;
+        case ItemCode::fn_code:
+            parseLambda();
+            break;
+        case ItemCode::return_code:
+            parseReturn();
+            break;
+        case ItemCode::try_code:
+            parseTry();
+            break;
+        case ItemCode::throw_code:
+            parseThrow(item);
+            break;
+        case ItemCode::switch_code:
+            parseSwitch();
+            break;
+        default:
+            unexpected(item, "an expression");
+    }
+}
+
+void Parser::plantInt(const Item & item) {
+    _planter->PUSHQ(intValue(item));
+}
+
+void Parser::plantInfix(const Item & op) {
+    _planter->position(op.position());
+    switch (op.itemCode()) {
+        case ItemCode::comma_code:
+            //  Both sides have already pushed their results.
+            break;
+        case ItemCode::add_code:
+            _planter->ADD();
+            break;
+        case ItemCode::sub_code:
+            _planter->SUB();
+            break;
+        case ItemCode::mul_code:
+            _planter->MUL();
+            break;
+        case ItemCode::lt_code:
+            _planter->LT();
+            break;
+        case ItemCode::lte_code:
+            _planter->LTE();
+            break;
+        case ItemCode::gt_code:
+            _planter->GT();
+            break;
+        case ItemCode::gte_code:
+            _planter->GTE();
+            break;
+        //  Until there are values with structural equality, = is ==.
+        case ItemCode::equal_code:
+        case ItemCode::exact_equal_code:
+            _planter->EQ();
+            break;
+        case ItemCode::not_equal_code:
+        case ItemCode::not_exact_equal_code:
+            _planter->NEQ();
+            break;
+        default:
+            throw CompileTimeError("Operator not supported").culprit("Operator", op.nameString(_symbols));
+    }
+}
+
+//  The value is computed before the local is declared, so that it may
+//  refer to a variable of the same name in an outer scope. The planter
+//  does not enforce that a val is never reassigned.
+void Parser::parseVar() {
+    std::string varname = readName();
+    mustRead(ItemCode::bind_code);
+    parseExpr(prec_comma);
+    _planter->local(varname);
+    _planter->POP_LOCAL(varname);
+}
+
+void Parser::parseIdentifier(const Item & item) {
+    std::string varname = name(item);
+    if (tryRead(ItemCode::oparen_code)) {
+        if (!tryRead(ItemCode::cparen_code)) {
+            parseExpr(prec_max);
+            mustRead(ItemCode::cparen_code);
+        }
+        _planter->position(item.position());
+        _planter->CALL(varname);
+    } else if (tryRead(ItemCode::bind_code)) {
+        parseExpr(prec_comma);
+        _planter->POP(varname);
+    } else {
+        _planter->PUSH(varname);
+    }
+}
+
+void Parser::parseIf() {
+    Label done = _planter->newLabel();
+    for (;;) {
+        parseExpr(prec_max);
+        mustRead(ItemCode::then_code);
+        Label otherwise = _planter->newLabel();
+        _planter->IFNOT(otherwise);
+        int scope = _planter->enterScope();
+        parseStatements();
+        _planter->exitScope(scope);
+
+        Item item = next();
+        switch (item.itemCode()) {
+            case ItemCode::elseif_code:
+                _planter->GOTO(done);
+                _planter->LABEL(otherwise);
+                break;
+            case ItemCode::else_code: {
+                _planter->GOTO(done);
+                _planter->LABEL(otherwise);
+                int scope = _planter->enterScope();
+                parseStatements();
+                _planter->exitScope(scope);
+                mustReadEnd(ItemCode::endif_code);
+                _planter->LABEL(done);
+                return;
+            }
+            case ItemCode::endif_code:
+            case ItemCode::end_code:
+                _planter->LABEL(otherwise);
+                _planter->LABEL(done);
+                return;
+            default:
+                unexpected(item, "endif");
+        }
+    }
+}
+
+void Parser::parseFor() {
+    std::string varname = readName();
+    if (tryRead(ItemCode::from_code)) {
+        parseExpr(prec_max);
+    } else {
+        _planter->PUSHQ(1);
+    }
+    if (tryRead(ItemCode::by_code)) {
+        parseExpr(prec_max);
+    } else {
+        _planter->PUSHQ(1);
+    }
+    mustRead(ItemCode::to_code);
+    parseExpr(prec_max);
+    mustRead(ItemCode::do_code);
+
+    int outer = _planter->enterScope();
+    _planter->local(varname);
+    ForRange loop = _planter->newForRange(varname);
+    _planter->FOR_RANGE_INIT(loop);
+    int inner = _planter->enterScope();
+    parseStatements();
+    _planter->exitScope(inner);
+    _planter->FOR_RANGE_NEXT(loop);
+    mustReadEnd(ItemCode::endfor_code);
+    _planter->exitScope(outer);
+}
+
+void Parser::parseLambda() {
+    CodePlanter * outer = _planter;
+    CodePlanter & lambda = outer->lambda();
+    _planter = &lambda;
+    parseParameters(lambda);
+    tryRead(ItemCode::colon_code);
+    parseProcedureBody(lambda, ItemCode::endfn_code);
+    _planter = outer;
+    _planter->CLOSURE(lambda);
+}
+
+void Parser::parseReturn() {
+    std::optional<Item> item = peek();
+    if (item && !isStatementTerminator(item->itemCode())) {
+        parseExpr(prec_max);
+    }
+    _planter->RETURN();
+}
+
+//  The variable of the handler is a local of the handler. A Mishap raised
+//  by the engine is caught as a Symbol of its message.
+void Parser::parseTry() {
+    TryBlock block = _planter->newTryBlock();
+    _planter->TRY(block);
+    int scope = _planter->enterScope();
+    parseStatements();
+    _planter->exitScope(scope);
+    mustRead(ItemCode::catch_code);
+    std::string varname = readName();
+    tryRead(ItemCode::colon_code);
+    _planter->CATCH(block);
+    scope = _planter->enterScope();
+    _planter->local(varname);
+    _planter->POP_LOCAL(varname);
+    parseStatements();
+    _planter->exitScope(scope);
+    mustReadEnd(ItemCode::endtry_code);
+    _planter->ENDTRY(block);
+}
+
+void Parser::parseThrow(const Item & item) {
+    parseExpr(prec_max);
+    _planter->position(item.position());
+    _planter->THROW();
+}
+
+//  Each case is planted in a scope of its own. There is no fall-through
+//  from one case to the next, and a key that matches no case runs the
+//  default, if there is one.
+void Parser::parseSwitch() {
+    parseExpr(prec_max);
+    SwitchBlock block = _planter->newSwitchBlock();
+    _planter->SWITCH(block);
+    for (;;) {
+        Item item = next();
+        switch (item.itemCode()) {
+            case ItemCode::case_code: {
+                std::vector<Cell> keys;
+                do {
+                    keys.push_back(readCaseKey());
+                } while (tryRead(ItemCode::comma_code));
+                mustRead(ItemCode::colon_code);
+                _planter->CASE(block, keys);
+                break;
+            }
+            case ItemCode::default_code:
+                tryRead(ItemCode::colon_code);
+                _planter->DEFAULT(block);
+                break;
+            case ItemCode::endswitch_code:
+            case ItemCode::end_code:
+                _planter->ENDSWITCH(block);
+                return;
+            default:
+                unexpected(item, "endswitch");
+        }
+        int scope = _planter->enterScope();
+        parseStatements();
+        _planter->exitScope(scope);
+    }
+}
+
+} // namespace poppy
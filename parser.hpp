@@ -0,0 +1,101 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "itemizer.hpp"
+#include "itemreader.hpp"
+#include "engine.hpp"
+#include "codeplanter.hpp"
+
+namespace poppy {
+
+/*  The parser is a Pratt (top-down operator precedence) parser that reads
+    items from an Itemizer and plants code straight into a CodePlanter,
+    without building a syntax tree. Infix operators and their binding
+    powers come from precedences.xpp; lower precedences bind tighter.
+
+    Expressions follow the open-stack convention: every expression pushes
+    its results, comma-separated expressions push all of theirs and a
+    procedure returns whatever it leaves on the stack. The top level is a
+    sequence of definitions:
+
+        define NAME( PARAM, ... ): STATEMENTS enddefine
+
+    STATEMENTS are expressions separated by semi-colons, including:
+
+        var NAME := EXPR            and val NAME := EXPR
+        NAME := EXPR                and EXPR -> NAME
+        NAME( ARGS )
+        if EXPR then ... elseif EXPR then ... else ... endif
+        for NAME from EXPR by EXPR to EXPR do ... endfor
+        fn( PARAM, ... ): STATEMENTS endfn
+        return EXPR
+        try STATEMENTS catch NAME: STATEMENTS endtry
+        throw EXPR
+        switch EXPR case KEY, ...: STATEMENTS ... default: STATEMENTS endswitch
+
+    The closing keywords may all be written as end; define may be written
+    as def; from and by may be omitted and default to 1. The keys of a
+    case are integer or Boolean literals.
+
+    Each expression, and each operator, call and throw, is marked with the
+    position of its item for the line table of the code.
+*/
+
+class Parser : public ItemReader {
+private:
+    Engine & _engine;
+    CodePlanter * _planter = nullptr;
+    std::vector<std::string> _defined;
+    uint64_t _source = 0;
+
+public:
+    Parser(Engine & engine, Itemizer & itemizer);
+
+public:
+    //  Compiles and binds the next top-level definition, returning false
+    //  at the end of input.
+    bool compileDefinition();
+
+    //  Plants the next top-level definition without building it, returning
+    //  nullptr at the end of input. If the name is already declared, as
+    //  ParallelCompiler arranges, this only reads the engine's state.
+    std::unique_ptr<CodePlanter> plantDefinition(std::string & procname);
+
+    //  Compiles definitions to the end of input, returns how many.
+    int compileDefinitions();
+
+    //  The names bound so far, in order.
+    const std::vector<std::string> & defined() const { return _defined; }
+
+    //  The source being parsed, an index from Engine::addSource, so that
+    //  the code planted has a line table. Zero, the default, means none.
+    void setSource(uint64_t source) { _source = source; }
+
+private:
+    void parseStatements();
+    void parseExpr(int limit);
+    void parsePrefix(const Item & item);
+    void parseParameters(CodePlanter & planter);
+    void parseProcedureBody(CodePlanter & planter, ItemCode closer);
+
+    void parseVar();
+    void parseIdentifier(const Item & item);
+    void parseIf();
+    void parseFor();
+    void parseLambda();
+    void parseReturn();
+    void parseTry();
+    void parseThrow(const Item & item);
+    void parseSwitch();
+    void plantInt(const Item & item);
+    void plantInfix(const Item & item);
+};
+
+} // namespace poppy
+
+#endif
@@ -5,6 +5,7 @@
 #include <ios>
 #include <map>
 #include <memory>
+#include <sstream>
 
 #include "itemizer.hpp"
 #include "itemrole.hpp"
@@ -15,6 +16,12 @@
 #include "xroots.hpp"
 #include "engine.hpp"
 #include "codeplanter.hpp"
+#include "parser.hpp"
+#include "astparser.hpp"
+#include "astpasses.hpp"
+#include "astplanter.hpp"
+#include "bytecodecache.hpp"
+#include "parallelcompiler.hpp"
 
 #define DEBUG 1
 
@@ -42,12 +49,11 @@ int main(int argc, char **argv) {
         
         //  Test out the itemization.
         printSection("Itemization example");
-        std::ifstream source( "poem.txt" );
-        source.unsetf(std::ios_base::skipws);
-        Itemizer itemizer( source );
+        SourceBuffer source( "poem.txt" );
+        Itemizer itemizer( source, engine.getSymbolTable() );
         Item item;
         while (itemizer.nextItem(item)) {
-            std::cout << item.nameString() << std::endl;
+            std::cout << item.nameString( engine.getSymbolTable() ) << " @" << item.position() << std::endl;
             const char * k = itemCodeToItemKey(item.itemCode());
             std::cout << (k == nullptr ? "?" : k) << std::endl;
             std::cout << itemRoleToString(item.itemRole()) << std::endl;
@@ -86,6 +92,125 @@ int main(int argc, char **argv) {
         main.global( "main" );
         main.buildAndBind( "main" );
 
+        //  Records: build a point and fetch its y field.
+        engine.declareRecordClass( "point", { "x", "y" } );
+        CodePlanter gety(engine);
+        gety.PUSHQ(3);
+        gety.PUSHQ(4);
+        gety.NEW_RECORD( "point" );
+        gety.GET_FIELD( "point", "y" );
+        gety.RETURN();
+        gety.global( "gety" );
+        gety.buildAndBind( "gety" );
+
+        //  Compile source text.
+        printSection("Parser example");
+        {
+            SourceBuffer poem( "poem.txt" );
+            Itemizer items( poem, engine.getSymbolTable() );
+            Parser parser( engine, items );
+            parser.compileDefinitions();
+        }
+        {
+            std::istringstream text(
+                "define sumto(n):\n"
+                "    var total := 0;\n"
+                "    for i from 1 to n do total + i -> total endfor;\n"
+                "    total\n"
+                "enddefine\n"
+                "define compiled():\n"
+                "    val add5 := fn(x): x + 5 endfn;\n"
+                "    if False then 0 else sumto(100) - add5(foo(-1)) endif\n"
+                "enddefine\n"
+                "define signs():\n"
+                "    var a:=-2;\n"
+                "    a*-3\n"
+                "enddefine\n"
+            );
+            SourceBuffer source( text );
+            Itemizer items( source, engine.getSymbolTable() );
+            Parser parser( engine, items );
+            parser.compileDefinitions();
+        }
+
+        printSection("AST example");
+        {
+            std::istringstream text(
+                "define folded():\n"
+                "    if False then sumto(1_000) else 60 * 60 * 24 endif\n"
+                "enddefine\n"
+            );
+            SourceBuffer source( text );
+            Itemizer items( source, engine.getSymbolTable() );
+            Ast ast;
+            AstParser( ast, items, engine.getSymbolTable() ).parseDefinitions();
+            AstOptimiser optimiser( ast );
+            optimiser.run();
+            std::cout << "Nodes:  " << ast.size() << " (" << ast.bytes() << " bytes)" << std::endl;
+            std::cout << "Folded: " << optimiser.folded << ", pruned: " << optimiser.pruned << std::endl;
+            AstPlanter( engine, ast ).plantDefinitions();
+        }
+
+        printSection("Bytecode cache example");
+        {
+            std::istringstream text(
+                "define cube(n): n * n * n enddefine\n"
+                "define colour(c):\n"
+                "    switch c\n"
+                "    case \"red\": 1\n"
+                "    case \"green\", \"blue\": 2\n"
+                "    default: 0\n"
+                "    endswitch\n"
+                "enddefine\n"
+                "define cached():\n"
+                "    val twice := fn(f): fn(x): f(f(x)) endfn endfn;\n"
+                "    val cube_twice := twice(cube);\n"
+                "    cube_twice(2) + colour(\"blue\")\n"
+                "enddefine\n"
+            );
+            SourceBuffer source( text );
+            BytecodeCache cache( engine, ".poppy-cache" );
+            if ( cache.load( source, true ) ) {
+                std::cout << "Loaded compact code from " << cache.pathFor( source ) << std::endl;
+            } else {
+                Itemizer items( source, engine.getSymbolTable() );
+                Parser parser( engine, items );
+                parser.compileDefinitions();
+                cache.store( source, parser.defined() );
+                std::cout << "Compiled and saved to " << cache.pathFor( source ) << std::endl;
+            }
+        }
+
+        printSection("Parallel compilation example");
+        {
+            std::istringstream text(
+                "define sq(n): n * n enddefine\n"
+                "define sumsq(a, b): sq(a) + sq(b) enddefine\n"
+                "define pythagoras(): sumsq(3, 4) - sq(5) enddefine\n"
+            );
+            SourceBuffer source( text );
+            for ( auto & name : ParallelCompiler( engine, 4 ).compile( source ) ) {
+                std::cout << "Compiled " << name << std::endl;
+            }
+        }
+
+        printSection("Register tier example");
+        {
+            std::istringstream text(
+                "define registers():\n"
+                "    var total := 0;\n"
+                "    for i from 1 to 10 do total + i * i - sq(i) + i -> total endfor;\n"
+                "    total\n"
+                "enddefine\n"
+            );
+            SourceBuffer source( text );
+            engine.setDefaultTier( CodeTier::Register );
+            Itemizer items( source, engine.getSymbolTable() );
+            Parser parser( engine, items );
+            parser.compileDefinitions();
+            engine.setDefaultTier( CodeTier::Stack );
+        }
+
         printSection("Show Procedure record");
         main.debugDisplay();
         
@@ -94,10 +219,37 @@ int main(int argc, char **argv) {
 
         printSection("Execute planted code");
         engine.run( "main" );
+        engine.run( "gety" );
+        engine.run( "compiled" );
+        engine.run( "signs" );
+        engine.run( "folded" );
+        engine.run( "cached" );
+        engine.run( "pythagoras" );
+        engine.run( "registers" );
 
         printSection("Show Engine final state");
         engine.debugDisplay();
 
+        printSection("Tracing example");
+        {
+            std::istringstream text(
+                "define traced(): sq(3) + sq enddefine\n"
+            );
+            SourceBuffer source( text, "traced.pop" );
+            Itemizer items( source, engine.getSymbolTable() );
+            Parser parser( engine, items );
+            parser.setSource( engine.addSource( source ) );
+            parser.compileDefinitions();
+            engine.startTracing( 1024, 6 );
+            try {
+                engine.run( "traced" );
+            } catch (Mishap & mishap) {
+                mishap.report();
+            }
+            std::cout << "Traced " << engine.trace()->count() << " instructions" << std::endl;
+            engine.stopTracing();
+        }
+
         return EXIT_SUCCESS;
 
     } catch (Mishap & mex) {
@@ -29,6 +29,8 @@ enum {
     prec_gt             =   1300,
     prec_lte            =   1400,
     prec_gte            =   1500,
+    prec_ltgt           =   1500,
+    prec_ltegt          =   1500,
     prec_not            =   1600,
     prec_bang           =   1650,
     prec_abs_and        =   1700,
@@ -0,0 +1,56 @@
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sourcebuffer.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+SourceBuffer::SourceBuffer(const std::string & filename) :
+    _name(filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Mishap("Cannot open source file").culprit("File", filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void * p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            _mapping = p;
+            _start = static_cast<const char *>(p);
+            _size = st.st_size;
+            madvise(p, _size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+
+    if (_mapping == nullptr) {
+        //  Empty files, pipes and so on.
+        std::ifstream in(filename, std::ios::binary);
+        _owned.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        _start = _owned.data();
+        _size = _owned.size();
+    }
+}
+
+SourceBuffer::SourceBuffer(std::istream & source, const std::string & name) :
+    _owned(std::istreambuf_iterator<char>(source), std::istreambuf_iterator<char>()),
+    _name(name)
+{
+    _start = _owned.data();
+    _size = _owned.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (_mapping != nullptr) {
+        munmap(_mapping, _size);
+    }
+}
+
+} // namespace poppy
@@ -0,0 +1,46 @@
+#ifndef SOURCEBUFFER_HPP
+#define SOURCEBUFFER_HPP
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace poppy {
+
+/*  A SourceBuffer holds the complete text of a source so that it can be
+    itemized by walking a pointer over it. Files are memory-mapped where
+    possible; streams (and files that cannot be mapped) are read into an
+    owned string. The buffer must outlive any string_views taken from it.
+*/
+
+class SourceBuffer {
+private:
+    const char * _start = nullptr;
+    std::size_t _size = 0;
+    void * _mapping = nullptr;
+    std::string _owned;
+    std::string _name;
+
+public:
+    SourceBuffer(const std::string & filename);
+    SourceBuffer(std::istream & source, const std::string & name = "<stream>");
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer & operator=(const SourceBuffer &) = delete;
+
+public:
+    inline const char * begin() const { return _start; }
+    inline const char * end() const { return _start + _size; }
+    inline std::size_t size() const { return _size; }
+    inline std::string_view view() const { return std::string_view(_start, _size); }
+    inline bool isMapped() const { return _mapping != nullptr; }
+
+    //  The file name, or the name given to a stream, for source positions.
+    inline const std::string & name() const { return _name; }
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,93 @@
+#include <cstring>
+
+#include "symboltable.hpp"
+#include "mishap.hpp"
+
+namespace poppy {
+
+SymbolTable::SymbolTable() :
+    _slots(64, EmptySlot)
+{
+}
+
+//  FNV-1a, 32-bit. Symbol names are short so this is hard to beat.
+uint32_t SymbolTable::hash(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char ch : name) {
+        h ^= ch;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const char * SymbolTable::store(std::string_view name) {
+    std::size_t n = name.size();
+    if (n > _chunk_free) {
+        //  Oversized names get a chunk of their own.
+        std::size_t size = n > ChunkSize ? n : ChunkSize;
+        _chunks.emplace_back(new char[size]);
+        _chunk_tip = _chunks.back().get();
+        _chunk_free = size;
+    }
+    char * result = _chunk_tip;
+    std::memcpy(result, name.data(), n);
+    _chunk_tip += n;
+    _chunk_free -= n;
+    return result;
+}
+
+void SymbolTable::insertSlot(uint32_t h, uint32_t entry_number) {
+    std::size_t mask = _slots.size() - 1;
+    std::size_t i = h & mask;
+    while (_slots[i] != EmptySlot) {
+        i = (i + 1) & mask;
+    }
+    _slots[i] = entry_number + 1;
+}
+
+void SymbolTable::grow() {
+    _slots.assign(_slots.size() * 2, EmptySlot);
+    for (std::size_t n = 0; n < _entries.size(); n++) {
+        insertSlot(_entries[n]._hash, n);
+    }
+}
+
+std::optional<std::size_t> SymbolTable::find(std::string_view name) const {
+    uint32_t h = hash(name);
+    std::size_t mask = _slots.size() - 1;
+    for (std::size_t i = h & mask; _slots[i] != EmptySlot; i = (i + 1) & mask) {
+        const Entry & e = _entries[_slots[i] - 1];
+        if (e._hash == h && e._length == name.size() && std::memcmp(e._chars, name.data(), e._length) == 0) {
+            return _slots[i] - 1;
+        }
+    }
+    return std::nullopt;
+}
+
+std::size_t SymbolTable::intern(std::string_view name) {
+    uint32_t h = hash(name);
+    std::size_t mask = _slots.size() - 1;
+    std::size_t i = h & mask;
+    for (; _slots[i] != EmptySlot; i = (i + 1) & mask) {
+        const Entry & e = _entries[_slots[i] - 1];
+        if (e._hash == h && e._length == name.size() && std::memcmp(e._chars, name.data(), e._length) == 0) {
+            return _slots[i] - 1;
+        }
+    }
+
+    if (name.size() > UINT32_MAX) {
+        throw Mishap("Symbol name too long").culprit("Length", static_cast<uint64_t>(name.size()));
+    }
+    std::size_t n = _entries.size();
+    _entries.push_back(Entry{ store(name), static_cast<uint32_t>(name.size()), h });
+
+    //  Keep the load factor at or below a half.
+    if ((n + 1) * 2 > _slots.size()) {
+        grow();
+    } else {
+        _slots[i] = n + 1;
+    }
+    return n;
+}
+
+} // namespace poppy
@@ -0,0 +1,73 @@
+#ifndef SYMBOLTABLE_HPP
+#define SYMBOLTABLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace poppy {
+
+/*  The symbol table maps between symbol names and their indexes. The
+    entries are held in a contiguous vector, so that index-to-name is a
+    single array access. The bytes of the names live in an arena of
+    fixed-size chunks that are never moved, so the string_views handed
+    out remain valid for the lifetime of the table. Name-to-index goes
+    through an open-addressing hash index (linear probing) that stores
+    entry numbers, so we can search with a string_view without building
+    a std::string.
+*/
+
+class SymbolTable {
+private:
+    struct Entry {
+        const char * _chars;
+        uint32_t _length;
+        uint32_t _hash;
+    };
+
+    static constexpr std::size_t ChunkSize = 16 * 1024;
+    static constexpr uint32_t EmptySlot = 0;
+
+    std::vector<Entry> _entries;
+
+    //  The arena holding the name bytes.
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    char * _chunk_tip = nullptr;
+    std::size_t _chunk_free = 0;
+
+    //  Hash index: each slot holds entry-number + 1, 0 means empty. The
+    //  size is always a power of two.
+    std::vector<uint32_t> _slots;
+
+public:
+    SymbolTable();
+
+public:
+    //  Returns the index of the symbol, adding it if necessary.
+    std::size_t intern(std::string_view name);
+
+    //  Returns the index of the symbol if it is already present.
+    std::optional<std::size_t> find(std::string_view name) const;
+
+    inline std::string_view name(std::size_t index) const {
+        const Entry & e = _entries[index];
+        return std::string_view(e._chars, e._length);
+    }
+
+    inline std::size_t size() const { return _entries.size(); }
+
+public:
+    static uint32_t hash(std::string_view name);
+
+private:
+    const char * store(std::string_view name);
+    void grow();
+    void insertSlot(uint32_t h, uint32_t entry_number);
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "trace.hpp"
+
+namespace poppy {
+
+static std::size_t powerOfTwoAtLeast(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+TraceBuffer::TraceBuffer(std::size_t capacity) :
+    _slots(powerOfTwoAtLeast(std::max<std::size_t>(capacity, 1))),
+    _mask(_slots.size() - 1)
+{
+}
+
+//  The writer fills in the slots in order, so the entries that it has
+//  overwritten are always the oldest ones.
+std::vector<TraceEntry> TraceBuffer::last(std::size_t n) const {
+    uint64_t end = _count.load(std::memory_order_acquire);
+    uint64_t start = end - std::min<uint64_t>({ n, end, _slots.size() });
+    std::vector<TraceEntry> copy;
+    copy.reserve(end - start);
+    for (uint64_t i = start; i < end; i++) {
+        const Slot & s = _slots[i & _mask];
+        uint64_t stamp = s.stamp.load(std::memory_order_acquire);
+        if (stamp != 2 * i + 2) {
+            copy.clear();
+            continue;
+        }
+        uint64_t words[4];
+        for (int k = 0; k < 4; k++) {
+            words[k] = s.words[k].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.stamp.load(std::memory_order_relaxed) != stamp) {
+            copy.clear();
+            continue;
+        }
+        TraceEntry & e = copy.emplace_back();
+        e.procedure = reinterpret_cast<Cell *>(static_cast<uintptr_t>(words[0]));
+        e.offset = static_cast<uint32_t>(words[1]);
+        e.inst = static_cast<Instruction>(static_cast<uint32_t>(words[1] >> 32));
+        e.depth = words[2];
+        e.top.u64 = words[3];
+    }
+    return copy;
+}
+
+} // namespace poppy
@@ -0,0 +1,77 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cell.hpp"
+
+namespace poppy {
+
+enum class Instruction;
+
+//  One instruction as it was about to run. The offset of the instruction
+//  is from the procedure key, and the top of the stack is only meaningful
+//  if the depth is not zero.
+struct TraceEntry {
+    Cell * procedure;
+    uint32_t offset;
+    Instruction inst;
+    uint64_t depth;
+    Cell top;
+};
+
+/*  A ring buffer of the most recent instructions executed by an engine,
+    see Engine::startTracing. The engine is the only writer and readers
+    may be on other threads, so each slot is a seqlock. Its stamp is odd
+    while the writer fills it in and is otherwise twice the number of the
+    instruction it holds, plus two. A reader keeps a copy only if it saw
+    the stamp it expected both before and after copying the words, which
+    are atomic so that a torn copy is merely discarded rather than a race.
+*/
+
+class TraceBuffer {
+private:
+    struct Slot {
+        std::atomic<uint64_t> stamp{ 0 };
+        std::atomic<uint64_t> words[4]{};    // Procedure, offset and inst, depth, top.
+    };
+    std::vector<Slot> _slots;
+    uint64_t _mask;
+    std::atomic<uint64_t> _count{ 0 };
+
+public:
+    //  The capacity is rounded up to a power of two.
+    explicit TraceBuffer(std::size_t capacity);
+
+public:
+    void record(Cell * procedure, const Cell * pc, Instruction inst, uint64_t depth, Cell top) {
+        uint64_t n = _count.load(std::memory_order_relaxed);
+        Slot & s = _slots[n & _mask];
+        uint32_t offset = procedure == nullptr ? 0 : static_cast<uint32_t>(pc - procedure);
+        s.stamp.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.words[0].store(reinterpret_cast<uintptr_t>(procedure), std::memory_order_relaxed);
+        s.words[1].store(static_cast<uint64_t>(static_cast<uint32_t>(inst)) << 32 | offset, std::memory_order_relaxed);
+        s.words[2].store(depth, std::memory_order_relaxed);
+        s.words[3].store(top.u64, std::memory_order_relaxed);
+        s.stamp.store(2 * n + 2, std::memory_order_release);
+        _count.store(n + 1, std::memory_order_release);
+    }
+
+    std::size_t capacity() const { return _slots.size(); }
+
+    //  How many instructions have been recorded, including those that
+    //  have since been overwritten.
+    uint64_t count() const { return _count.load(std::memory_order_acquire); }
+
+    //  Up to the last n entries, oldest first, less any that the writer
+    //  overwrote while they were being copied.
+    std::vector<TraceEntry> last(std::size_t n) const;
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef VALUESTACK_HPP
+#define VALUESTACK_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+#include "cell.hpp"
+
+namespace poppy {
+
+/*  The value stack. Pushes and pops are unchecked: the code planter works
+    out, for each stretch of code between calls, how many values it needs
+    on the stack and how far it may grow it, and the engine checks both
+    once, with ensure, before running the stretch. See StackNeeds.
+
+    The names follow std::vector so that it can stand in for one.
+*/
+
+class ValueStack {
+private:
+    std::unique_ptr<Cell[]> _cells;
+    Cell * _top = nullptr;
+    Cell * _limit = nullptr;
+
+public:
+    ValueStack() = default;
+    ValueStack(const ValueStack &) = delete;
+    ValueStack & operator=(const ValueStack &) = delete;
+
+public:
+    void push_back(Cell c) { *_top++ = c; }
+    void pop_back() { _top -= 1; }
+    Cell & back() { return _top[-1]; }
+
+    std::size_t size() const { return _top - _cells.get(); }
+    bool empty() const { return _top == _cells.get(); }
+    Cell * data() { return _cells.get(); }
+    Cell * begin() { return _cells.get(); }
+    Cell * end() { return _top; }
+
+    void clear() { _top = _cells.get(); }
+
+    //  Only ever shrinks the stack.
+    void resize(std::size_t n) { _top = _cells.get() + n; }
+
+    //  Makes room for n more values.
+    void ensure(std::size_t n) {
+        if (static_cast<std::size_t>(_limit - _top) < n) {
+            grow(n);
+        }
+    }
+
+private:
+    void grow(std::size_t n) {
+        std::size_t used = size();
+        std::size_t capacity = std::max<std::size_t>({ 2 * static_cast<std::size_t>(_limit - _cells.get()), used + n, 256 });
+        std::unique_ptr<Cell[]> cells(new Cell[capacity]);
+        std::copy(_cells.get(), _top, cells.get());
+        _cells.swap(cells);
+        _top = _cells.get() + used;
+        _limit = _cells.get() + capacity;
+    }
+};
+
+} // namespace poppy
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace poppy {
+
+//  Unsigned LEB128: seven bits a byte, least significant first, with the
+//  top bit set on every byte but the last.
+inline void writeVarint(std::vector<uint8_t> & out, uint64_t n) {
+    while (n >= 0x80) {
+        out.push_back(static_cast<uint8_t>(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(n));
+}
+
+inline uint64_t readVarint(const uint8_t * & p) {
+    uint64_t n = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t b = *p++;
+        n |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (b < 0x80) {
+            return n;
+        }
+    }
+}
+
+//  Signed values are zigzag encoded first, so that small negative numbers
+//  stay short.
+inline uint64_t zigzag(int64_t n) {
+    return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+inline int64_t unzigzag(uint64_t n) {
+    return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+}
+
+} // namespace poppy
+
+#endif
@@ -21,6 +21,9 @@ XRoot::~XRoot() {
 void XRootsRegistry::registerXRoot(XRoot * xroot) {
     xroot->_prev = &_origin;
     xroot->_next = _origin._next;
+    if (_origin._next) {
+        _origin._next->_prev = xroot;
+    }
     _origin._next = xroot;
 }
 